@@ -0,0 +1,546 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <future>
+#include <iostream>
+#include <new>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "synthetic_corpus.hpp"
+#include "classifier.hpp"
+#include "compiled_model.hpp"
+#include "config.hpp"
+#include "document_arena.hpp"
+#include "logger.hpp"
+#include "manager.hpp"
+#include "metrics.hpp"
+#include "report_writer.hpp"
+#include "score_kernel.hpp"
+#include "stream_scorer.hpp"
+#include "task_scheduler.hpp"
+#include "term_bag.hpp"
+#include "thread_pool.hpp"
+#include "tokenizer.hpp"
+#include "train_model.hpp"
+#include "worker.hpp"
+
+#ifndef POI_BUILD_TYPE
+#define POI_BUILD_TYPE "unknown"
+#endif
+
+using namespace std;
+namespace fs = filesystem;
+
+// Every heap allocation the process makes (the replacement operator new below), so each
+// benchmark can report how many its body made per item
+static atomic<uint64_t> heapAllocations{0};
+
+void* operator new(size_t size) {
+    heapAllocations.fetch_add(1, memory_order_relaxed);
+    if (void* p = malloc(size == 0 ? 1 : size)) {
+        return p;
+    }
+    throw bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+    free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    free(p);
+}
+
+namespace {
+
+struct BenchOptions {
+    CorpusSpec corpus;
+    size_t files = 200;          // Documents in the end-to-end corpus
+    size_t fileWords = 20000;    // Mean words per end-to-end document
+    vector<int> workerCounts;    // Empty: powers of two up to the hardware threads
+    int repeat = 3;
+    string workDir = (fs::temp_directory_path() / "poi_bench").string();
+    string output = "poi_bench.json";
+    bool keep = false;
+};
+
+// Timings of one benchmark; throughput is reported against the median sample
+struct BenchResult {
+    string name;
+    vector<double> seconds;
+    double items = 0;   // Work units per sample (documents, tokens, terms, ...)
+    string itemName;
+    double bytes = 0;   // Input bytes per sample, 0 when not meaningful
+    uint64_t allocations = 0;  // Heap allocations of the last sample (setup excluded)
+
+    double median() const {
+        vector<double> sorted = seconds;
+        sort(sorted.begin(), sorted.end());
+        return sorted[sorted.size() / 2];
+    }
+    double minimum() const { return *min_element(seconds.begin(), seconds.end()); }
+    double mean() const {
+        double total = 0.0;
+        for (double s : seconds) total += s;
+        return total / seconds.size();
+    }
+};
+
+struct SweepResult {
+    int workers;
+    BenchResult timing;
+    size_t tasksStolen;
+};
+
+// Swallows cout while the library prints its model tables
+class NullBuffer : public streambuf {
+protected:
+    int overflow(int c) override { return c; }
+};
+
+class QuietCout {
+public:
+    QuietCout() : saved(cout.rdbuf(&sink)) {}
+    ~QuietCout() { cout.rdbuf(saved); }
+
+private:
+    NullBuffer sink;
+    streambuf* saved;
+};
+
+double elapsedSeconds(chrono::steady_clock::time_point start) {
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+// Runs setup (untimed) and body (timed) `repeat` times
+BenchResult measure(const string& name, int repeat, const string& itemName,
+                    const function<void()>& setup, const function<pair<double, double>()>& body) {
+    BenchResult result;
+    result.name = name;
+    result.itemName = itemName;
+    for (int i = 0; i < repeat; ++i) {
+        if (setup) setup();
+        uint64_t allocationsBefore = heapAllocations.load(memory_order_relaxed);
+        auto start = chrono::steady_clock::now();
+        pair<double, double> work = body();
+        double seconds = elapsedSeconds(start);
+        result.allocations = heapAllocations.load(memory_order_relaxed) - allocationsBefore;
+        result.seconds.push_back(seconds);
+        result.items = work.first;
+        result.bytes = work.second;
+    }
+    cout << "  " << name << ": " << result.median() * 1e3 << " ms";
+    if (result.items > 0) cout << ", " << result.items / result.median() << " " << itemName << "/s";
+    if (result.bytes > 0) cout << ", " << result.bytes / result.median() / (1 << 20) << " MiB/s";
+    cout << ", " << result.allocations << " allocations";
+    if (result.items > 0) cout << " (" << result.allocations / result.items << " per " << itemName << ")";
+    cout << endl;
+    return result;
+}
+
+bool matchFlag(const string& arg, const string& name, string& value) {
+    if (arg.compare(0, name.size() + 1, name + "=") != 0) {
+        return false;
+    }
+    value = arg.substr(name.size() + 1);
+    return true;
+}
+
+bool parseOptions(int argc, char* argv[], BenchOptions& options) {
+    try {
+        for (int i = 1; i < argc; ++i) {
+            string arg = argv[i];
+            string value;
+            if (matchFlag(arg, "--docs", value)) options.corpus.documents = stoul(value);
+            else if (matchFlag(arg, "--words", value)) options.corpus.wordsPerDocument = stoul(value);
+            else if (matchFlag(arg, "--vocabulary", value)) options.corpus.vocabularySize = stoul(value);
+            else if (matchFlag(arg, "--seed", value)) options.corpus.seed = stoull(value);
+            else if (matchFlag(arg, "--files", value)) options.files = stoul(value);
+            else if (matchFlag(arg, "--file-words", value)) options.fileWords = stoul(value);
+            else if (matchFlag(arg, "--repeat", value)) options.repeat = max(1, stoi(value));
+            else if (matchFlag(arg, "--work-dir", value)) options.workDir = value;
+            else if (matchFlag(arg, "--output", value)) options.output = value;
+            else if (arg == "--keep") options.keep = true;
+            else if (matchFlag(arg, "--workers", value)) {
+                stringstream list(value);
+                string item;
+                while (getline(list, item, ',')) {
+                    int workers = stoi(item);
+                    if (workers <= 0) throw invalid_argument(item);
+                    options.workerCounts.push_back(workers);
+                }
+            } else {
+                cerr << "Unknown argument " << arg << endl;
+                return false;
+            }
+        }
+    } catch (const exception&) {
+        cerr << "Invalid numeric argument" << endl;
+        return false;
+    }
+
+    if (options.workerCounts.empty()) {
+        int usableThreads = static_cast<int>(ThreadPool::instance().size());
+        for (int workers = 1; workers < usableThreads; workers *= 2) {
+            options.workerCounts.push_back(workers);
+        }
+        options.workerCounts.push_back(usableThreads);
+    }
+    return true;
+}
+
+// One end-to-end run of the manager/workers pipeline over files
+size_t runPipeline(int numWorkers, const vector<string>& files, const string& reportPath) {
+    const CompiledModel& model = Classifier::getInstance().getModel();
+    vector<string> genreNames;
+    for (size_t g = 0; g < model.genreCount(); ++g) {
+        genreNames.emplace_back(model.genreName(g));
+    }
+
+    fs::remove(reportPath);
+    ReportWriter reportWriter(reportPath, ReportFormat::Csv, std::move(genreNames), chrono::milliseconds(200));
+    TaskScheduler scheduler(numWorkers, Config::workerQueueCapacity);
+    RuntimeMetrics metrics(numWorkers);
+    vector<double> efficiencies;
+    Manager manager(numWorkers, scheduler, efficiencies, metrics);
+
+    vector<future<void>> workerJobs;
+    for (int i = 0; i < numWorkers; ++i) {
+        workerJobs.push_back(ThreadPool::instance().start([i, &scheduler, &reportWriter, &metrics] {
+            workerFunction(i, scheduler, reportWriter, metrics, nullptr);
+        }));
+    }
+    manager.distributeTasks(files);
+    for (auto& job : workerJobs) {
+        job.get();
+    }
+    reportWriter.close();
+    return scheduler.stolenTasks();
+}
+
+string jsonEscape(const string& text) {
+    string escaped;
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            escaped += '\\';
+            escaped += c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            char code[8];
+            snprintf(code, sizeof(code), "\\u%04x", c);
+            escaped += code;
+        } else {
+            escaped += c;
+        }
+    }
+    return escaped;
+}
+
+void writeTiming(ostream& out, const BenchResult& result, const string& indent) {
+    out << indent << "\"name\": \"" << jsonEscape(result.name) << "\",\n"
+        << indent << "\"samples\": " << result.seconds.size() << ",\n"
+        << indent << "\"seconds\": {\"min\": " << result.minimum() << ", \"median\": " << result.median()
+        << ", \"mean\": " << result.mean() << "},\n"
+        << indent << "\"items\": " << result.items << ",\n"
+        << indent << "\"itemName\": \"" << jsonEscape(result.itemName) << "\",\n"
+        << indent << "\"itemsPerSecond\": " << result.items / result.median() << ",\n"
+        << indent << "\"bytes\": " << result.bytes << ",\n"
+        << indent << "\"bytesPerSecond\": " << result.bytes / result.median() << ",\n"
+        << indent << "\"allocations\": " << result.allocations << ",\n"
+        << indent << "\"allocationsPerItem\": " << (result.items > 0 ? result.allocations / result.items : 0.0);
+}
+
+void writeJson(ostream& out, const BenchOptions& options, const vector<BenchResult>& results,
+               const vector<SweepResult>& sweep, uint64_t corpusBytes) {
+    char timestamp[32];
+    time_t now = time(nullptr);
+    strftime(timestamp, sizeof(timestamp), "%Y-%m-%dT%H:%M:%SZ", gmtime(&now));
+
+    out.precision(9);
+    out << "{\n"
+        << "  \"schemaVersion\": 1,\n"
+        << "  \"timestamp\": \"" << timestamp << "\",\n"
+        << "  \"build\": {\"type\": \"" << POI_BUILD_TYPE << "\", \"compiler\": \"" << jsonEscape(__VERSION__)
+        << "\", \"logLevel\": " << POI_LOG_LEVEL << "},\n"
+        << "  \"host\": {\"hardwareThreads\": " << thread::hardware_concurrency()
+        << ", \"poolThreads\": " << ThreadPool::instance().size()
+        << ", \"numaNodes\": " << ThreadPool::instance().topology().nodeCount
+        << ", \"cpuQuota\": " << ThreadPool::instance().topology().quotaCpus
+        << ", \"tokenizerKernel\": \"" << Tokenizer::kernelName(Tokenizer::bestKernel())
+        << "\", \"scoreKernel\": \"" << ScoreKernel::isaName(ScoreKernel::bestIsa()) << "\"},\n"
+        << "  \"corpus\": {\"documents\": " << options.corpus.documents
+        << ", \"wordsPerDocument\": " << options.corpus.wordsPerDocument
+        << ", \"vocabularySize\": " << options.corpus.vocabularySize
+        << ", \"seed\": " << options.corpus.seed
+        << ", \"files\": " << options.files
+        << ", \"fileWords\": " << options.fileWords
+        << ", \"fileBytes\": " << corpusBytes << "},\n"
+        << "  \"benchmarks\": [\n";
+    for (size_t i = 0; i < results.size(); ++i) {
+        out << "    {\n";
+        writeTiming(out, results[i], "      ");
+        out << "\n    }" << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    out << "  ],\n"
+        << "  \"workerSweep\": [\n";
+    for (size_t i = 0; i < sweep.size(); ++i) {
+        out << "    {\n"
+            << "      \"workers\": " << sweep[i].workers << ",\n"
+            << "      \"tasksStolen\": " << sweep[i].tasksStolen << ",\n";
+        writeTiming(out, sweep[i].timing, "      ");
+        out << "\n    }" << (i + 1 < sweep.size() ? "," : "") << "\n";
+    }
+    out << "  ]\n"
+        << "}\n";
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    ThreadPool::ShutdownGuard poolShutdown;
+    BenchOptions options;
+    if (!parseOptions(argc, argv, options)) {
+        cerr << "Usage: " << argv[0] << " [--docs=N] [--words=N] [--vocabulary=N] [--seed=N] [--files=N]"
+             << " [--file-words=N] [--workers=1,2,4] [--repeat=N] [--work-dir=DIR] [--output=FILE] [--keep]" << endl;
+        return 1;
+    }
+
+    // Per-document debug lines would dominate every measurement
+    Logger::setLevel(LogLevel::Error);
+
+    string outputPath = fs::absolute(options.output).string();
+    string csvPath = (fs::path(options.workDir) / "output.csv").string();
+    string modelName = "bench_model.dat";
+    string modelPath = (fs::path(options.workDir) / "models" / modelName).string();
+    vector<BenchResult> results;
+    vector<SweepResult> sweep;
+    uint64_t corpusBytes = 0;
+
+    try {
+        SyntheticCorpus corpus(options.corpus);
+        fs::create_directories(options.workDir);
+        fs::current_path(options.workDir);  // saveModel() writes below ./models/
+
+        if (string(POI_BUILD_TYPE) == "Debug") {
+            cerr << "Warning: Debug build; configure with -DCMAKE_BUILD_TYPE=Release for representative numbers" << endl;
+        }
+        cout << "Generating " << options.corpus.documents << " training documents and " << options.files
+             << " test documents in " << options.workDir << endl;
+
+        uint64_t csvBytes = 0;
+        results.push_back(measure("generate_csv", 1, "documents", nullptr, [&] {
+            csvBytes = corpus.writeTrainingCsv(csvPath);
+            return make_pair(double(options.corpus.documents), double(csvBytes));
+        }));
+        vector<string> files = corpus.writeDocuments((fs::path(options.workDir) / "corpus").string(),
+                                                     options.files, options.fileWords);
+        for (const string& file : files) {
+            corpusBytes += fs::file_size(file);
+        }
+
+        // Tokenizer, once per kernel the CPU supports
+        string sample;
+        for (size_t index = 0; sample.size() < (4u << 20); ++index) {
+            string text;
+            corpus.document(index, options.corpus.wordsPerDocument, text);
+            sample += text;
+            sample += '\n';
+        }
+        string work;
+        vector<string_view> tokens;
+        for (auto kernel : {Tokenizer::Kernel::Scalar, Tokenizer::Kernel::SSE2, Tokenizer::Kernel::AVX2}) {
+            if (static_cast<int>(kernel) > static_cast<int>(Tokenizer::bestKernel())) {
+                continue;
+            }
+            Tokenizer::setKernel(kernel);
+            results.push_back(measure(string("tokenize/") + Tokenizer::kernelName(kernel), options.repeat, "tokens",
+                [&] { work = sample; tokens.clear(); },
+                [&] {
+                    Tokenizer::tokenize(work.data(), work.size(), tokens);
+                    return make_pair(double(tokens.size()), double(sample.size()));
+                }));
+        }
+        Tokenizer::setKernel(Tokenizer::bestKernel());
+
+        // Training, model compilation and persistence
+        TrainModel trained;
+        results.push_back(measure("train_naive_bayes", options.repeat, "documents",
+            [&] { trained = TrainModel(); },
+            [&] {
+                QuietCout quiet;
+                trained.trainNaiveBayes(csvPath);
+                return make_pair(double(options.corpus.documents), double(csvBytes));
+            }));
+
+        results.push_back(measure("compile_model", options.repeat, "terms", nullptr, [&] {
+            CompiledModel compiled(trained.genreModels);
+            return make_pair(double(compiled.termCount()), double(compiled.imageSize()));
+        }));
+
+        results.push_back(measure("save_model", options.repeat, "models",
+            [&] { fs::remove(modelPath); },
+            [&] {
+                QuietCout quiet;
+                trained.saveModel(modelName);
+                return make_pair(1.0, double(fs::file_size(modelPath)));
+            }));
+
+        results.push_back(measure("load_model", options.repeat, "models", nullptr, [&] {
+            TrainModel loaded;
+            loaded.loadModel(modelPath);
+            return make_pair(1.0, double(fs::file_size(modelPath)));
+        }));
+
+        results.push_back(measure("map_model", options.repeat, "models", nullptr, [&] {
+            CompiledModel mapped = CompiledModel::mapFile(modelPath);
+            return make_pair(1.0, double(mapped.imageSize()));
+        }));
+
+        // Scoring pre-tokenized words against the model (the per-word log-probability sum)
+        Classifier::initialize(CompiledModel::mapFile(modelPath));
+        const CompiledModel& model = Classifier::getInstance().getModel();
+        work = sample;
+        tokens.clear();
+        Tokenizer::tokenize(work.data(), work.size(), tokens);
+        StreamScorer scorer(model, Config::streamBlockSize);
+        results.push_back(measure("score_tokens", options.repeat, "tokens",
+            [&] { scorer.reset(); },
+            [&] {
+                scorer.addTokens(tokens);
+                scorer.finish();
+                return make_pair(double(tokens.size()), 0.0);
+            }));
+
+        // The row sums alone, once per instruction set the CPU supports; every kernel has to
+        // give the same bits as the generic one
+        vector<uint32_t> termIds;
+        for (string_view token : tokens) {
+            termIds.push_back(model.lookup(token));
+        }
+        vector<double> genericSums;
+        vector<double> sums(model.genreCount());
+        for (auto isa : {ScoreKernel::Isa::Generic, ScoreKernel::Isa::AVX2, ScoreKernel::Isa::AVX512}) {
+            if (static_cast<int>(isa) > static_cast<int>(ScoreKernel::bestIsa())) {
+                continue;
+            }
+            ScoreKernel::setIsa(isa);
+            results.push_back(measure(string("accumulate/") + ScoreKernel::isaName(isa), options.repeat, "tokens",
+                [&] { fill(sums.begin(), sums.end(), 0.0); },
+                [&] {
+                    model.accumulate(termIds.data(), termIds.size(), sums.data());
+                    return make_pair(double(termIds.size()), 0.0);
+                }));
+            if (genericSums.empty()) {
+                genericSums = sums;
+            } else if (sums != genericSums) {
+                cerr << "accumulate/" << ScoreKernel::isaName(isa) << " differs from the generic kernel" << endl;
+            }
+        }
+        ScoreKernel::setIsa(ScoreKernel::bestIsa());
+
+        // Per token: a lookup and a row each, against counting the words and then one lookup
+        // and one weighted row per distinct word
+        results.push_back(measure("lookup_accumulate", options.repeat, "tokens",
+            [&] { fill(sums.begin(), sums.end(), 0.0); },
+            [&] {
+                for (size_t i = 0; i < tokens.size(); ++i) {
+                    termIds[i] = model.lookup(tokens[i]);
+                }
+                model.accumulate(termIds.data(), termIds.size(), sums.data());
+                return make_pair(double(tokens.size()), 0.0);
+            }));
+        TermBag bag;
+        results.push_back(measure("term_bag", options.repeat, "tokens",
+            [&] { fill(sums.begin(), sums.end(), 0.0); },
+            [&] {
+                bag.clear();
+                bag.add(tokens.data(), tokens.size());
+                model.accumulate(bag, sums.data());
+                return make_pair(double(tokens.size()), 0.0);
+            }));
+        cout << "  term bag: " << bag.size() << " distinct words in " << bag.tokenCount() << " tokens" << endl;
+
+        // The weighted rows have to give the same bits on every instruction set too
+        vector<double> genericBagSums;
+        for (auto isa : {ScoreKernel::Isa::Generic, ScoreKernel::Isa::AVX2, ScoreKernel::Isa::AVX512}) {
+            if (static_cast<int>(isa) > static_cast<int>(ScoreKernel::bestIsa())) {
+                continue;
+            }
+            ScoreKernel::setIsa(isa);
+            fill(sums.begin(), sums.end(), 0.0);
+            model.accumulate(bag, sums.data());
+            if (genericBagSums.empty()) {
+                genericBagSums = sums;
+            } else if (sums != genericBagSums) {
+                cerr << "term_bag/" << ScoreKernel::isaName(isa) << " differs from the generic kernel" << endl;
+            }
+        }
+        ScoreKernel::setIsa(ScoreKernel::bestIsa());
+
+        string text;
+        results.push_back(measure("classify_text", options.repeat, "tokens",
+            [&] { text = sample; },
+            [&] {
+                Classifier::getInstance().classifyText(text);
+                return make_pair(double(tokens.size()), double(sample.size()));
+            }));
+
+        // One worker's classification path over the test documents; after a warm-up pass the
+        // result, record and arena storage has grown and a document should allocate nothing
+        ClassificationResult fileResult;
+        for (const string& file : files) {
+            Classifier::getInstance().classifyFile(file, fileResult);
+        }
+        results.push_back(measure("classify_file", options.repeat, "files", nullptr, [&] {
+            for (const string& file : files) {
+                Classifier::getInstance().classifyFile(file, fileResult);
+            }
+            return make_pair(double(files.size()), double(corpusBytes));
+        }));
+        cout << "  document arena: " << DocumentArena::forThread().capacity() << " bytes, "
+             << DocumentArena::forThread().spills() << " spills" << endl;
+
+        // End-to-end: manager, scheduler, workers and report writer over the test documents
+        string reportPath = (fs::path(options.workDir) / "report.csv").string();
+        runPipeline(1, files, reportPath);  // Warm the page cache
+        for (int workers : options.workerCounts) {
+            size_t stolen = 0;
+            BenchResult timing = measure("pipeline/" + to_string(workers) + "_workers", options.repeat, "files",
+                nullptr, [&] {
+                    stolen = runPipeline(workers, files, reportPath);
+                    return make_pair(double(files.size()), double(corpusBytes));
+                });
+            sweep.push_back({workers, std::move(timing), stolen});
+        }
+    } catch (const exception& e) {
+        cerr << "Benchmark failed: " << e.what() << endl;
+        return 1;
+    }
+
+    ofstream out(outputPath);
+    writeJson(out, options, results, sweep, corpusBytes);
+    if (!out) {
+        cerr << "Failed writing " << outputPath << endl;
+        return 1;
+    }
+    cout << "Results written to " << outputPath << endl;
+
+    // Remove only what the benchmark generated, the work directory may be shared
+    if (!options.keep) {
+        fs::path workDir(options.workDir);
+        fs::remove(csvPath);
+        fs::remove(modelPath);
+        fs::remove(workDir / "models");
+        fs::remove(workDir / "report.csv");
+        fs::remove_all(workDir / "corpus");
+    }
+    Logger::flush();
+    return 0;
+}
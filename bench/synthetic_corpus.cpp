@@ -0,0 +1,181 @@
+#include "synthetic_corpus.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <stdexcept>
+
+using namespace std;
+namespace fs = filesystem;
+
+namespace {
+
+const double topicShare = 0.25;     // Fraction of a document's words taken from its genre's topic block
+const size_t wordsPerSentence = 14;  // Mean; sentences end with '.' and start capitalized
+
+const char* const syllables[16] = {
+    "ka", "to", "ri", "mo", "ne", "sa", "lu", "vi",
+    "de", "po", "ra", "ze", "fu", "chi", "an", "el"
+};
+
+// splitmix64: tiny, fast and good enough to drive a benchmark corpus
+struct Random {
+    uint64_t state;
+
+    explicit Random(uint64_t seed) : state(seed) {}
+
+    uint64_t next() {
+        uint64_t z = (state += 0x9E3779B97F4A7C15ull);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        return z ^ (z >> 31);
+    }
+
+    double uniform() { return (next() >> 11) * (1.0 / 9007199254740992.0); }
+    size_t below(size_t bound) { return static_cast<size_t>(next() % bound); }
+};
+
+// Word for vocabulary index i: the base-16 digits of i + 256 spelled as syllables
+// (always three or more, and distinct indices give distinct words)
+string makeWord(size_t index) {
+    string digits;
+    for (size_t value = index + 256; value > 0; value /= 16) {
+        digits += syllables[value % 16];
+    }
+    return digits;
+}
+
+vector<double> zipfCumulative(size_t size) {
+    vector<double> cumulative(size);
+    double total = 0.0;
+    for (size_t rank = 0; rank < size; ++rank) {
+        total += 1.0 / static_cast<double>(rank + 1);
+        cumulative[rank] = total;
+    }
+    for (double& weight : cumulative) {
+        weight /= total;
+    }
+    return cumulative;
+}
+
+} // namespace
+
+SyntheticCorpus::SyntheticCorpus(const CorpusSpec& spec, vector<string> genres)
+    : corpusSpec(spec), genreNames(std::move(genres)) {
+    if (spec.documents < minDocuments || spec.documents > maxDocuments) {
+        throw invalid_argument("Corpus size must be between " + to_string(minDocuments) + " and "
+                               + to_string(maxDocuments) + " documents");
+    }
+    if (genreNames.empty() || spec.wordsPerDocument == 0) {
+        throw invalid_argument("Corpus needs at least one genre and one word per document");
+    }
+    if (spec.vocabularySize < 20 * genreNames.size()) {
+        throw invalid_argument("Vocabulary must have at least " + to_string(20 * genreNames.size()) + " words");
+    }
+
+    vocabulary.reserve(spec.vocabularySize);
+    for (size_t i = 0; i < spec.vocabularySize; ++i) {
+        vocabulary.push_back(makeWord(i));
+    }
+
+    // Topic blocks partition the rare half of the vocabulary between the genres
+    topicBlockSize = (spec.vocabularySize / 2) / genreNames.size();
+    globalWeights = zipfCumulative(spec.vocabularySize);
+    topicWeights = zipfCumulative(topicBlockSize);
+}
+
+size_t SyntheticCorpus::sampleRank(const vector<double>& cumulative, double uniform) const {
+    size_t rank = lower_bound(cumulative.begin(), cumulative.end(), uniform) - cumulative.begin();
+    return min(rank, cumulative.size() - 1);
+}
+
+size_t SyntheticCorpus::document(size_t index, size_t words, string& text) const {
+    Random random(corpusSpec.seed * 0x100000001B3ull + index);
+    size_t genre = random.below(genreNames.size());
+    size_t length = max<size_t>(1, words / 2 + random.below(words + 1));
+    size_t topicBase = corpusSpec.vocabularySize / 2 + genre * topicBlockSize;
+
+    text.clear();
+    bool sentenceStart = true;
+    for (size_t i = 0; i < length; ++i) {
+        size_t wordIndex = random.uniform() < topicShare
+            ? topicBase + sampleRank(topicWeights, random.uniform())
+            : sampleRank(globalWeights, random.uniform());
+
+        if (i > 0) {
+            text += ' ';
+        }
+        size_t start = text.size();
+        text += vocabulary[wordIndex];
+        if (sentenceStart) {
+            text[start] = static_cast<char>(text[start] - ('a' - 'A'));
+            sentenceStart = false;
+        }
+
+        uint64_t roll = random.below(wordsPerSentence);
+        if (roll == 0) {
+            text += '.';
+            sentenceStart = true;
+        } else if (roll == 1) {
+            text += ',';
+        }
+    }
+    text += '.';
+    return genre;
+}
+
+uint64_t SyntheticCorpus::writeTrainingCsv(const string& path) const {
+    FILE* file = fopen(path.c_str(), "w");
+    if (file == nullptr) {
+        throw runtime_error("Unable to create " + path);
+    }
+
+    string text;
+    string row = "index,title,genre,summary\n";
+    uint64_t bytes = 0;
+    for (size_t i = 0; i <= corpusSpec.documents; ++i) {
+        if (fwrite(row.data(), 1, row.size(), file) != row.size()) {
+            fclose(file);
+            throw runtime_error("Failed writing " + path);
+        }
+        bytes += row.size();
+        if (i == corpusSpec.documents) {
+            break;
+        }
+
+        size_t genre = document(i, corpusSpec.wordsPerDocument, text);
+        row = to_string(i) + ",Title " + to_string(i) + "," + genreNames[genre] + "," + text + "\n(less)\n";
+    }
+
+    if (fclose(file) != 0) {
+        throw runtime_error("Failed writing " + path);
+    }
+    return bytes;
+}
+
+vector<string> SyntheticCorpus::writeDocuments(const string& directory, size_t count, size_t words) const {
+    fs::create_directories(directory);
+
+    vector<string> paths;
+    string text;
+    for (size_t i = 0; i < count; ++i) {
+        size_t index = corpusSpec.documents + i;
+        size_t genre = document(index, words, text);
+
+        // Wrap lines like a plain-text book
+        for (size_t pos = 0, column = 0; pos < text.size(); ++pos, ++column) {
+            if (text[pos] == ' ' && column >= 72) {
+                text[pos] = '\n';
+                column = 0;
+            }
+        }
+
+        string path = (fs::path(directory) / ("doc" + to_string(index) + "_" + genreNames[genre] + ".txt")).string();
+        FILE* file = fopen(path.c_str(), "w");
+        if (file == nullptr || fwrite(text.data(), 1, text.size(), file) != text.size() || fclose(file) != 0) {
+            throw runtime_error("Failed writing " + path);
+        }
+        paths.push_back(std::move(path));
+    }
+    return paths;
+}
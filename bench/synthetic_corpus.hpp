@@ -0,0 +1,59 @@
+#ifndef SYNTHETIC_CORPUS_HPP
+#define SYNTHETIC_CORPUS_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "config.hpp"
+
+// Shape of a generated corpus
+struct CorpusSpec {
+    size_t documents = 10000;       // Training documents, SyntheticCorpus::minDocuments..maxDocuments
+    size_t wordsPerDocument = 120;  // Mean length; each document varies by up to +-50%
+    size_t vocabularySize = 20000;
+    uint64_t seed = 42;
+};
+
+// Deterministic generator of labelled text for benchmarks.
+// Words are drawn from a Zipf-distributed vocabulary of pronounceable pseudo-words; a
+// share of every document comes from a block of topic words owned by its genre, so a
+// model trained on the corpus classifies it well above chance. Sentences get
+// capitalization and punctuation so the tokenizer sees realistic input.
+// Every document is generated from its own seed (spec seed + index), so the same spec
+// produces byte-identical output whatever order or thread documents are generated in.
+class SyntheticCorpus {
+public:
+    static constexpr size_t minDocuments = 10;
+    static constexpr size_t maxDocuments = 1000000;
+
+    // Throws std::invalid_argument when the spec is out of range
+    explicit SyntheticCorpus(const CorpusSpec& spec, std::vector<std::string> genres = Config::predefinedGenres);
+
+    const CorpusSpec& spec() const { return corpusSpec; }
+    const std::vector<std::string>& genres() const { return genreNames; }
+
+    // Text of document `index` with about `words` words; returns its genre index
+    size_t document(size_t index, size_t words, std::string& text) const;
+
+    // The spec's training documents in the layout of extracted_book/output.csv
+    // (header, then "index,title,genre,summary" rows each closed by a "(less)" line).
+    // Streams to disk, so a million documents never sit in memory. Returns bytes written.
+    uint64_t writeTrainingCsv(const std::string& path) const;
+
+    // `count` standalone documents of about `words` words each, numbered after the
+    // training documents so none of them was seen in training. Returns their paths.
+    std::vector<std::string> writeDocuments(const std::string& directory, size_t count, size_t words) const;
+
+private:
+    size_t sampleRank(const std::vector<double>& cumulative, double uniform) const;
+
+    CorpusSpec corpusSpec;
+    std::vector<std::string> genreNames;
+    std::vector<std::string> vocabulary;
+    std::vector<double> globalWeights;  // Cumulative Zipf weights over the whole vocabulary
+    std::vector<double> topicWeights;   // Cumulative Zipf weights over one genre's topic block
+    size_t topicBlockSize = 0;
+};
+
+#endif // SYNTHETIC_CORPUS_HPP
@@ -0,0 +1,98 @@
+#ifndef BLOCKING_QUEUE_HPP
+#define BLOCKING_QUEUE_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <utility>
+#include "bounded_queue.hpp"
+
+// BoundedQueue with parking: push() waits while the queue is full and pop() while it is
+// empty, until close(). Both stay lock-free while there is room and work; the mutex is
+// only touched to park or to wake somebody who parked.
+template <typename T>
+class BlockingQueue {
+public:
+    explicit BlockingQueue(std::size_t requestedCapacity) : queue(requestedCapacity) {}
+
+    BlockingQueue(const BlockingQueue&) = delete;
+    BlockingQueue& operator=(const BlockingQueue&) = delete;
+
+    // Returns true when it had to wait for room
+    bool push(T&& value) {
+        bool waited = false;
+        // The slot is counted before the item goes in, so a consumer can never take an item
+        // that is not counted yet (count would wrap below zero and park producers for good)
+        while (count.fetch_add(1) >= queue.capacity() || !queue.tryPush(std::move(value))) {
+            released();
+            std::unique_lock<std::mutex> lock(parkMutex);
+            waitingProducers.fetch_add(1);
+            spaceAvailable.wait(lock, [this] { return count.load() < queue.capacity(); });
+            waitingProducers.fetch_sub(1);
+            waited = true;
+        }
+        if (waitingConsumers.load() > 0) {
+            std::lock_guard<std::mutex> lock(parkMutex);
+            itemAvailable.notify_one();
+        }
+        return waited;
+    }
+
+    // Returns false once the queue is closed and empty
+    bool pop(T& value) {
+        while (!queue.tryPop(value)) {
+            std::unique_lock<std::mutex> lock(parkMutex);
+            waitingConsumers.fetch_add(1);
+            // count runs ahead of the queue only by pushes in flight, which land right away
+            itemAvailable.wait(lock, [this] { return count.load() > 0 || closed.load(); });
+            waitingConsumers.fetch_sub(1);
+            if (count.load() == 0 && closed.load()) {
+                return false;
+            }
+        }
+        released();
+        return true;
+    }
+
+    // Never waits; returns false when nothing is queued right now
+    bool tryPop(T& value) {
+        if (!queue.tryPop(value)) {
+            return false;
+        }
+        released();
+        return true;
+    }
+
+    // No more pushes; consumers drain what is left and then get false
+    void close() {
+        std::lock_guard<std::mutex> lock(parkMutex);
+        closed.store(true);
+        itemAvailable.notify_all();
+    }
+
+    std::size_t sizeApprox() const { return count.load(std::memory_order_relaxed); }
+    std::size_t capacity() const { return queue.capacity(); }
+
+private:
+    // A slot was given back: an item was taken, or a push that counted one failed
+    void released() {
+        count.fetch_sub(1);
+        if (waitingProducers.load() > 0) {
+            std::lock_guard<std::mutex> lock(parkMutex);
+            spaceAvailable.notify_one();
+        }
+    }
+
+    BoundedQueue<T> queue;
+    std::atomic<std::size_t> count{0};
+    std::atomic<bool> closed{false};
+
+    std::mutex parkMutex;
+    std::condition_variable itemAvailable;
+    std::condition_variable spaceAvailable;
+    std::atomic<int> waitingConsumers{0};
+    std::atomic<int> waitingProducers{0};
+};
+
+#endif // BLOCKING_QUEUE_HPP
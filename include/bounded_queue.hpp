@@ -0,0 +1,123 @@
+#ifndef BOUNDED_QUEUE_HPP
+#define BOUNDED_QUEUE_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <utility>
+
+// Fixed-capacity lock-free multi-producer/multi-consumer ring buffer.
+// Every slot carries a sequence number that tells producers and consumers whose
+// turn it is, so push and pop are a single CAS on the hot path and never block.
+// Capacity is rounded up to the next power of two.
+template <typename T>
+class BoundedQueue {
+public:
+    explicit BoundedQueue(std::size_t requestedCapacity) {
+        std::size_t capacity = 2;
+        while (capacity < requestedCapacity) {
+            capacity <<= 1;
+        }
+        mask = capacity - 1;
+        cells = std::make_unique<Cell[]>(capacity);
+        for (std::size_t i = 0; i < capacity; ++i) {
+            cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    BoundedQueue(const BoundedQueue&) = delete;
+    BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+    // Returns false (and leaves value untouched) when the queue is full
+    bool tryPush(T&& value) {
+        return pushWith([&](T& slot) { slot = std::move(value); });
+    }
+
+    // Copy into the slot instead: its strings and vectors keep their storage from one lap
+    // of the ring to the next, so a producer that keeps its own value allocates nothing
+    bool tryPush(const T& value) {
+        return pushWith([&](T& slot) { slot = value; });
+    }
+
+    // Returns false when the queue is empty
+    bool tryPop(T& value) {
+        return consumeWith([&](T& slot) { value = std::move(slot); });
+    }
+
+    // Hand the front element to consume in place (without moving its storage out);
+    // returns false when the queue is empty
+    template <typename Consume>
+    bool tryConsume(Consume&& consume) {
+        return consumeWith(consume);
+    }
+
+    // Approximate number of queued elements (exact when the queue is quiescent)
+    std::size_t sizeApprox() const {
+        std::size_t head = dequeuePos.load(std::memory_order_relaxed);
+        std::size_t tail = enqueuePos.load(std::memory_order_relaxed);
+        return tail > head ? tail - head : 0;
+    }
+
+    std::size_t capacity() const { return mask + 1; }
+
+private:
+    template <typename Fill>
+    bool pushWith(Fill&& fill) {
+        std::size_t pos = enqueuePos.load(std::memory_order_relaxed);
+        Cell* cell;
+        while (true) {
+            cell = &cells[pos & mask];
+            std::size_t seq = cell->sequence.load(std::memory_order_acquire);
+            std::ptrdiff_t diff = static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(pos);
+            if (diff == 0) {
+                if (enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = enqueuePos.load(std::memory_order_relaxed);
+            }
+        }
+        fill(cell->data);
+        cell->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    template <typename Consume>
+    bool consumeWith(Consume&& consume) {
+        std::size_t pos = dequeuePos.load(std::memory_order_relaxed);
+        Cell* cell;
+        while (true) {
+            cell = &cells[pos & mask];
+            std::size_t seq = cell->sequence.load(std::memory_order_acquire);
+            std::ptrdiff_t diff = static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(pos + 1);
+            if (diff == 0) {
+                if (dequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = dequeuePos.load(std::memory_order_relaxed);
+            }
+        }
+        consume(cell->data);
+        cell->sequence.store(pos + mask + 1, std::memory_order_release);
+        return true;
+    }
+
+    struct Cell {
+        std::atomic<std::size_t> sequence;
+        T data;
+    };
+
+    std::unique_ptr<Cell[]> cells;
+    std::size_t mask;
+
+    // Producers and consumers hammer different counters; keep them on separate cache lines
+    alignas(64) std::atomic<std::size_t> enqueuePos{0};
+    alignas(64) std::atomic<std::size_t> dequeuePos{0};
+};
+
+#endif // BOUNDED_QUEUE_HPP
@@ -2,10 +2,36 @@
 #define CLASSIFIER_HPP
 
 #include <string>
+#include <string_view>
 #include <vector>
 #include <queue>
 #include <train_model.hpp>
 #include <genre_model.hpp>
+#include <compiled_model.hpp>
+#include <stream_scorer.hpp>
+
+// Outcome of classifying one document
+struct ClassificationResult {
+    std::string genre;           // "Unknown" when no genre could be scored
+    double logProbability = 0.0; // Log probability of the chosen genre
+    std::vector<double> scores;  // Log probability per genre, in model order
+    size_t tokens = 0;           // Tokens scored
+    size_t bytes = 0;            // Size of the document
+
+    // Stage times in nanoseconds. Reading is the read() calls (or mapping the file, whose
+    // page faults then land in tokenizing); ranges scored in parallel add up their times.
+    uint64_t readNanos = 0;
+    uint64_t tokenizeNanos = 0;
+    uint64_t scoreNanos = 0;
+
+    // Early exit: bytes never read, and tokens not scored (those already split off plus an
+    // estimate for the unread bytes at the density seen so far)
+    uint64_t skippedBytes = 0;
+    size_t skippedTokens = 0;
+
+    // Back to the defaults, keeping the strings' and scores' capacity for the next document
+    void clear();
+};
 
 class Classifier {
 public:
@@ -16,25 +42,75 @@ public:
     // Public static method to get the instance (without passing a model)
     static Classifier& getInstance();
 
-    // Method to classify text
-    std::string classifyText(const std::string& text);
+    // Method to classify text (the text is normalized in place while tokenizing)
+    std::string classifyText(std::string& text);
+
+    // Method to classify a file by streaming it in fixed-size blocks; memory stays bounded by
+    // Config::streamBlockSize and the result matches classifyText on the whole content.
+    // Files from Config::parallelScoreThreshold up are mmap'd and split on token boundaries
+    // into ranges that are scored on separate cores (same tokens, sums may differ in the last bits).
+    // Throws std::runtime_error when the file cannot be read.
+    ClassificationResult classifyFile(const std::string& filePath);
+
+    // Same, into a result the caller keeps across documents: once its storage has grown,
+    // classifying allocates nothing (per-document scratch comes from the DocumentArena)
+    void classifyFile(const std::string& filePath, ClassificationResult& result);
+
+    // Classify text held in memory (e.g. sent inline to the daemon); it is copied through
+    // the scorer's block buffer, so data is left untouched
+    ClassificationResult classifyBuffer(const char* data, size_t size);
+
+    // Stop scoring a document as soon as a single genre can still win (see
+    // StreamScorer::setEarlyExit). Same winner as full scoring; files are then always
+    // streamed, never split across cores. Set before the workers start.
+    void setEarlyExit(bool enabled);
+    bool earlyExitEnabled() const { return earlyExit; }
+
+    // Pick the most likely genre from log probabilities summed elsewhere (e.g. by the pipeline's
+    // scorer threads); the result carries the scores and token count but no stage times
+    ClassificationResult pickBestGenre(std::vector<double> scores, size_t tokens) const;
+
+    // Model the classifier scores against (genre order of ClassificationResult::scores)
+    const CompiledModel& getModel() const { return compiledModel; }
+
+    // Same model, replicated on the calling thread's NUMA node when the pool is pinned over
+    // several nodes, so scoring reads no memory across sockets
+    const CompiledModel& localModel() const;
 
     // Method to initialize the classifier with the model (only once)
     static void initialize(TrainModel& model);
 
+    // Same, from an already compiled (e.g. mmap'd) model
+    static void initialize(CompiledModel model);
+
 private:
     // Private constructor to prevent instantiation outside of the class
-    Classifier(TrainModel& model);
+    Classifier(CompiledModel model);
 
     // Static instance pointer for Singleton pattern
     static Classifier* instance;
 
-    // Shared model used by the classifier (it is set only once via initialization)
-    static TrainModel* sharedModel;
+    // Model compiled into interned term ids and a flat log-probability matrix (set only once via initialization)
+    CompiledModel compiledModel;
+    std::vector<CompiledModel> nodeModels;  // One copy per NUMA node (empty on a single node)
+
+    // Bounds for early exit, computed when it is first enabled
+    bool earlyExit = false;
+    std::vector<double> contributionBounds;
+
+    // Per-thread scorer with its reusable block buffer
+    StreamScorer& threadScorer();
+    // Same, reset for a new document
+    StreamScorer& startDocument(uint64_t documentBytes);
+
+    // Helper methods for the two ways of reading a file
+    uint64_t scoreStream(int fd, const std::string& filePath, StreamScorer& scorer,
+                         uint64_t& bytesRead);  // Returns the read time
+    void scoreRangesInParallel(const char* data, size_t size, StreamScorer& scorer);
 
-    // Helper methods for preprocessing and calculating log probabilities
-    std::vector<std::string> preprocessText(const std::string& text);
-    double calculateLogProbability(const std::vector<std::string>& words, const GenreModel& genreModel);
+    // Helper methods for picking the most likely genre from the accumulated log probabilities
+    void pickBestGenre(const StreamScorer& scorer, ClassificationResult& result) const;
+    void chooseGenre(ClassificationResult& result) const;
 };
 
 #endif // CLASSIFIER_HPP
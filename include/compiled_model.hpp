@@ -0,0 +1,134 @@
+#ifndef COMPILED_MODEL_HPP
+#define COMPILED_MODEL_HPP
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "genre_model.hpp"
+#include "model_format.hpp"
+
+class TermBag;
+
+// Scoring-ready form of the trained genre models.
+// Every word is interned once into a global term id, and the per-genre log-probabilities
+// are laid out term-major: the row of a term holds one value per genre, so scoring a
+// token is a single hash lookup followed by a contiguous add over all genres.
+//
+// A hashed-feature model has no vocabulary at all: a token's term id is its hash bucket,
+// so the matrix is a fixed 2^bits rows whatever the corpus, and lookup() does no probing
+// or string compares.
+//
+// The model is a read-only view over one contiguous image in the model.dat v5 layout
+// (see model_format.hpp). The image is either built in memory from the genre maps or
+// mmap'd straight from disk, in which case nothing is deserialized: pages are faulted
+// in on first use and shared through the page cache by every process using the file.
+// Copies share the same image.
+class CompiledModel {
+public:
+    static constexpr uint32_t unknownTerm = UINT32_MAX;
+
+    CompiledModel() = default;
+
+    // Build from the per-genre maps (genre order follows the map's iteration order).
+    // Log-probabilities are derived from the raw counts where the genres have them, and the
+    // counts are kept in the image when every genre has them. Genres with bucket counts give
+    // a hashed-feature model; throws std::runtime_error unless all or none of them are hashed
+    // with the same bucket count.
+    // With quantized cells the counts are dropped and the cells are fixed point (see
+    // model_format.hpp); throws std::runtime_error if a log-probability is not finite.
+    explicit CompiledModel(const std::unordered_map<std::string, GenreModel>& genreModels,
+                           ModelFormat::CellType cellType = ModelFormat::CellType::Double);
+
+    // Map a v2 to v5 model file read-only; throws std::runtime_error if it is not a valid one
+    static CompiledModel mapFile(const std::string& filename);
+
+    // Private copy of the image in memory the calling thread touches first (so on its NUMA
+    // node); the copy scores exactly like the original
+    CompiledModel copyInMemory() const;
+
+    // True when the file starts with the compiled-model magic
+    static bool isCompiledModelFile(const std::string& filename);
+
+    // Write the image as a v5 model file. It goes to a temporary file that then replaces
+    // filename, so readers (and running classifiers' mappings) never see a partial model.
+    void save(const std::string& filename) const;
+
+    // Expand back into per-genre maps: the raw counts (bucket counts for a hashed model) when
+    // the image has them, otherwise the probabilities (cells equal to the smoothing term are omitted)
+    std::unordered_map<std::string, GenreModel> toGenreModels() const;
+
+    // Hash of the whole image: equal for the same model whether built or mapped, and
+    // different as soon as any probability, term or genre changes
+    uint64_t fingerprint() const;
+
+    size_t genreCount() const { return header ? header->genreCount : 0; }
+    size_t termCount() const { return header ? header->termCount : 0; }  // Buckets when hashed
+    size_t imageSize() const { return header ? header->fileSize : 0; }
+    bool isMapped() const { return mapped; }
+    bool hasCounts() const { return documentCounts != nullptr; }
+    uint32_t hashBits() const { return header ? header->hashBits : 0; }
+    bool isHashed() const { return hashBits() != 0; }
+    ModelFormat::CellType cellType() const { return header ? header->cellType : ModelFormat::CellType::Double; }
+
+    std::string_view genreName(size_t genreIndex) const {
+        return std::string_view(stringPool + genres[genreIndex].nameOffset, genres[genreIndex].nameLength);
+    }
+    double priorProbability(size_t genreIndex) const { return genres[genreIndex].priorProbability; }
+    int64_t totalWords(size_t genreIndex) const { return genres[genreIndex].totalWords; }
+    // Vocabulary models only
+    std::string_view termString(uint32_t termId) const {
+        return std::string_view(stringPool + terms[termId].stringOffset, terms[termId].length);
+    }
+
+    // Term id of a word, or unknownTerm when no genre has seen it; its bucket in a hashed model
+    uint32_t lookup(std::string_view word) const;
+
+    // Add the rows of count terms (unknown ones get the smoothing row) to genreCount() scores,
+    // in order. Double cells are added one by one, so the sums do not depend on how the terms
+    // are batched (the kernel is specialized for the genre count, see score_kernel.hpp);
+    // quantized cells are summed as integers and scaled once per call.
+    void accumulate(const uint32_t* termIds, size_t count, double* scores) const;
+
+    // Look up every distinct word of the bag and add its row times the word's count: the same
+    // sum as adding the bag's tokens one by one, with one lookup and one row per distinct word.
+    // Double sums round differently from the token-by-token ones (in the last bits); quantized
+    // cells are summed as integers and scaled once per batch of words.
+    void accumulate(const TermBag& bag, double* scores) const;
+
+    // genreCount() log-probabilities for a term, decoded from the cells
+    void decodeRow(uint32_t termId, double* values) const;
+
+    // log(prior) per genre
+    const double* logPriors() const { return logPriorProbabilities; }
+
+    // Bounds for early exit, genreCount() * (genreCount() + 1) values: entry [g * genreCount() + l]
+    // is the most any single token (known or unknown) can add to genre g's score relative to
+    // genre l's, and the last genreCount() entries are the largest magnitude in each genre's
+    // column. One pass over the matrix, O(terms * genres^2).
+    std::vector<double> contributionBounds() const;
+
+private:
+    double cellValue(uint64_t rowIndex, size_t genreIndex) const;
+
+    // Validate the image and point the section accessors into it
+    void attach(std::shared_ptr<const unsigned char> data, size_t size, bool isMapping);
+
+    std::shared_ptr<const unsigned char> image;
+    bool mapped = false;
+
+    const ModelFormat::FileHeader* header = nullptr;
+    const ModelFormat::GenreEntry* genres = nullptr;
+    const double* logPriorProbabilities = nullptr;
+    const char* stringPool = nullptr;
+    const ModelFormat::TermEntry* terms = nullptr;
+    const ModelFormat::HashSlot* hashIndex = nullptr;
+    const unsigned char* matrix = nullptr;  // Cells of header->cellType
+    const ModelFormat::CellScale* cellScales = nullptr;
+    const int64_t* documentCounts = nullptr;  // Per genre, followed by the term-major word counts
+    const int64_t* wordCounts = nullptr;
+};
+
+#endif // COMPILED_MODEL_HPP
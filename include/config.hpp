@@ -2,6 +2,7 @@
 #define CONFIG_HPP
 
 #include <string>
+#include <vector>
 #include <limits>
 
 
@@ -9,6 +10,20 @@ using namespace std;
 
 namespace Config {
     const string directoryPath = "../data"; 
+    const string trainingDataPath = "../extracted_book/output.csv";  // Labelled summaries trainNaiveBayes() reads
+    const size_t workerQueueCapacity = 256;  // Per-worker task slots before the manager blocks
+    const size_t streamBlockSize = 1 << 20;  // Read buffer per worker when streaming a document
+    const size_t pipelineBlockSize = 256 << 10;  // Pooled buffer size of the pipeline mode (grows for longer tokens)
+    const size_t parallelScoreThreshold = 512 << 10;  // Documents this large are split across cores
+    const size_t parallelChunkSize = 256 << 10;  // Target bytes per range when splitting a document
+    const size_t termBagThreshold = 256 << 10;  // Documents this large are counted into a bag of words first
+    const size_t efficiencyRefreshInterval = 16;  // Files the manager assigns between worker-weight updates
+
+    // Genres the model is trained for
+    const vector<string> predefinedGenres = {
+        "horror", "fantasy", "science", "crime", "history",
+        "thriller", "romance", "psychology", "sports", "travel"
+    };
 }
 
 #endif  
\ No newline at end of file
@@ -0,0 +1,94 @@
+#ifndef CONTENT_HASH_HPP
+#define CONTENT_HASH_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// 64-bit XXH64 of a byte range: four independent multiply-rotate lanes over 32-byte
+// stripes, so it runs at several GB/s, far faster than the documents can be scored.
+// Not cryptographic; stable across platforms and runs (little-endian reads), which is
+// what keys persisted next to it (result cache, model fingerprints) rely on.
+namespace ContentHash {
+    constexpr uint64_t prime1 = 0x9E3779B185EBCA87ull;
+    constexpr uint64_t prime2 = 0xC2B2AE3D27D4EB4Full;
+    constexpr uint64_t prime3 = 0x165667B19E3779F9ull;
+    constexpr uint64_t prime4 = 0x85EBCA77C2B2AE63ull;
+    constexpr uint64_t prime5 = 0x27D4EB2F165667C5ull;
+
+    inline uint64_t rotateLeft(uint64_t value, int bits) {
+        return (value << bits) | (value >> (64 - bits));
+    }
+
+    inline uint64_t read64(const unsigned char* p) {
+        uint64_t value;
+        std::memcpy(&value, p, sizeof(value));
+        return value;
+    }
+
+    inline uint32_t read32(const unsigned char* p) {
+        uint32_t value;
+        std::memcpy(&value, p, sizeof(value));
+        return value;
+    }
+
+    inline uint64_t round(uint64_t accumulator, uint64_t input) {
+        accumulator += input * prime2;
+        return rotateLeft(accumulator, 31) * prime1;
+    }
+
+    inline uint64_t mergeRound(uint64_t hash, uint64_t lane) {
+        hash ^= round(0, lane);
+        return hash * prime1 + prime4;
+    }
+
+    inline uint64_t hash64(const void* data, size_t size, uint64_t seed = 0) {
+        const unsigned char* p = static_cast<const unsigned char*>(data);
+        const unsigned char* end = p + size;
+        uint64_t hash;
+
+        if (size >= 32) {
+            uint64_t lane1 = seed + prime1 + prime2;
+            uint64_t lane2 = seed + prime2;
+            uint64_t lane3 = seed;
+            uint64_t lane4 = seed - prime1;
+            for (const unsigned char* limit = end - 32; p <= limit; p += 32) {
+                lane1 = round(lane1, read64(p));
+                lane2 = round(lane2, read64(p + 8));
+                lane3 = round(lane3, read64(p + 16));
+                lane4 = round(lane4, read64(p + 24));
+            }
+            hash = rotateLeft(lane1, 1) + rotateLeft(lane2, 7) + rotateLeft(lane3, 12) + rotateLeft(lane4, 18);
+            hash = mergeRound(hash, lane1);
+            hash = mergeRound(hash, lane2);
+            hash = mergeRound(hash, lane3);
+            hash = mergeRound(hash, lane4);
+        } else {
+            hash = seed + prime5;
+        }
+        hash += size;
+
+        for (; p + 8 <= end; p += 8) {
+            hash ^= round(0, read64(p));
+            hash = rotateLeft(hash, 27) * prime1 + prime4;
+        }
+        if (p + 4 <= end) {
+            hash ^= read32(p) * prime1;
+            hash = rotateLeft(hash, 23) * prime2 + prime3;
+            p += 4;
+        }
+        for (; p < end; ++p) {
+            hash ^= *p * prime5;
+            hash = rotateLeft(hash, 11) * prime1;
+        }
+
+        hash ^= hash >> 33;
+        hash *= prime2;
+        hash ^= hash >> 29;
+        hash *= prime3;
+        hash ^= hash >> 32;
+        return hash;
+    }
+}
+
+#endif // CONTENT_HASH_HPP
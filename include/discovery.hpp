@@ -0,0 +1,103 @@
+#ifndef DISCOVERY_HPP
+#define DISCOVERY_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <limits>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+// What to look for and where
+struct DiscoveryOptions {
+    std::vector<std::string> roots;     // Files or directories; directories are walked recursively
+    std::vector<std::string> includes;  // Globs a file must match (any of them); empty = every file
+    std::vector<std::string> excludes;  // Globs that drop a file, or prune a whole directory
+    uint64_t minBytes = 0;
+    uint64_t maxBytes = std::numeric_limits<uint64_t>::max();
+    int threads = 0;                    // Walker threads; 0 = up to 4, depending on the hardware
+};
+
+struct DiscoveredFile {
+    std::string path;
+    uint64_t bytes = 0;
+};
+
+// Shell-style glob: '*' and '?' stay within a path component, '**' spans components,
+// "[abc]" / "[a-z]" / "[!abc]" match one character. A pattern without '/' is matched
+// against the file (or directory) name, one with '/' against the path below the root.
+bool globMatch(std::string_view pattern, std::string_view text);
+
+// Parallel recursive walk that streams what it finds.
+// Walker threads share a queue of directories still to be listed; every file that
+// passes the filters is handed out in chunks of up to chunkSize, so the consumer gets
+// the first files as soon as the first directory has been read instead of after the
+// whole tree. The output is bounded: walkers wait while maxPendingChunks are unread.
+// Directory symlinks are not followed, so cycles cannot occur.
+class FileDiscovery {
+public:
+    static constexpr size_t chunkSize = 256;
+
+    FileDiscovery(DiscoveryOptions options, size_t maxPendingChunks = 64);
+    ~FileDiscovery();
+
+    FileDiscovery(const FileDiscovery&) = delete;
+    FileDiscovery& operator=(const FileDiscovery&) = delete;
+
+    void start();
+
+    // Move the next available chunk of files into batch (replacing its contents); blocks
+    // until one is ready. Returns false once the walk has finished and everything was taken.
+    bool nextBatch(std::vector<DiscoveredFile>& batch);
+
+    // Stop walking early; nextBatch() then drains what is already queued
+    void stop();
+
+    size_t filesFound() const { return found.load(std::memory_order_relaxed); }
+    size_t directoriesScanned() const { return scanned.load(std::memory_order_relaxed); }
+    size_t filesFiltered() const { return filtered.load(std::memory_order_relaxed); }
+
+private:
+    struct Directory {
+        std::string path;
+        std::string relative;  // Path below its root, for globs containing '/'
+    };
+
+    void walkerLoop();
+    void scanDirectory(const Directory& directory);
+    void considerFile(const std::string& path, std::string_view relative, std::string_view name, uint64_t bytes,
+                      std::vector<DiscoveredFile>& chunk);
+    bool excluded(std::string_view relative, std::string_view name) const;
+    bool included(std::string_view relative, std::string_view name) const;
+    void publish(std::vector<DiscoveredFile>& chunk);
+
+    DiscoveryOptions options;
+    size_t maxPendingChunks;
+
+    // Directories waiting to be listed, and how many are being listed right now
+    std::mutex walkMutex;
+    std::condition_variable walkWake;
+    std::deque<Directory> directories;
+    int activeWalkers = 0;
+
+    // Chunks of found files waiting for the consumer
+    std::mutex outputMutex;
+    std::condition_variable chunkReady;
+    std::condition_variable chunkTaken;
+    std::deque<std::vector<DiscoveredFile>> chunks;
+    bool finished = false;
+
+    std::atomic<bool> stopping{false};
+    std::atomic<int> remainingWalkers{0};
+    std::atomic<size_t> found{0};
+    std::atomic<size_t> scanned{0};
+    std::atomic<size_t> filtered{0};
+    std::vector<std::thread> walkers;
+};
+
+#endif // DISCOVERY_HPP
@@ -0,0 +1,54 @@
+#ifndef DOCUMENT_ARENA_HPP
+#define DOCUMENT_ARENA_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <memory_resource>
+#include <optional>
+
+// Per-thread bump allocator for the scratch memory of one document (range bounds and
+// partial sums of a split document, and the like). Allocating is a pointer increment and
+// nothing is freed one by one: reset() drops everything at once before the next document.
+// A document that outgrows the buffer spills to the heap, and the next reset() replaces the
+// buffer with one large enough for it, so the steady state allocates nothing at all.
+// Not thread-safe; every thread uses its own through forThread().
+class DocumentArena {
+public:
+    explicit DocumentArena(size_t initialBytes = 16 << 10);
+
+    DocumentArena(const DocumentArena&) = delete;
+    DocumentArena& operator=(const DocumentArena&) = delete;
+
+    std::pmr::memory_resource* resource() { return &*arena; }
+
+    // Release everything allocated since the last reset
+    void reset();
+
+    size_t capacity() const { return bufferSize; }
+    // Heap allocations made because a document did not fit (each one grows the buffer once)
+    uint64_t spills() const { return upstream.allocations; }
+
+    // The calling thread's arena
+    static DocumentArena& forThread();
+
+private:
+    // Heap fallback of the arena; counts what it hands out
+    class CountingResource : public std::pmr::memory_resource {
+    public:
+        uint64_t allocations = 0;
+        size_t bytesSinceReset = 0;
+
+    private:
+        void* do_allocate(size_t bytes, size_t alignment) override;
+        void do_deallocate(void* p, size_t bytes, size_t alignment) override;
+        bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override { return this == &other; }
+    };
+
+    std::unique_ptr<std::byte[]> buffer;
+    size_t bufferSize;
+    CountingResource upstream;
+    std::optional<std::pmr::monotonic_buffer_resource> arena;
+};
+
+#endif // DOCUMENT_ARENA_HPP
@@ -1,21 +1,37 @@
 #ifndef GENRE_MODEL_HPP
 #define GENRE_MODEL_HPP
 
+#include <cstdint>
 #include <unordered_map>
 #include <string>
+#include <vector>
 
 class GenreModel {
 public:
     std::string genre;  // The genre name (e.g., "thriller")
     double priorProbability;  // Prior probability for the genre
-    int totalWordsInGenre;  // Total number of words in the genre
+    int64_t totalWordsInGenre;  // Total number of words in the genre
     std::unordered_map<std::string, double> wordProbabilities;  // Probability of each word in the genre
 
+    // Raw training counts. Models trained here keep only these and leave wordProbabilities
+    // empty; the probabilities are derived when the model is compiled for scoring.
+    int64_t documentCount;  // Training documents labelled with the genre
+    std::unordered_map<std::string, int64_t> wordCounts;  // Occurrences of each word in the genre
+
+    // Hashed-feature models count per hash bucket instead (2^bits entries, no word strings)
+    // and leave wordCounts empty
+    std::vector<int64_t> bucketCounts;
+
     // Default constructor (declaration only)
     GenreModel();
     
     // Constructor
-    GenreModel(std::string genre, double priorProb, int totalWords);
+    GenreModel(std::string genre, double priorProb, int64_t totalWords);
+
+    // True unless the genre only carries probabilities (e.g. read from a legacy or v2 model)
+    bool hasCounts() const { return wordProbabilities.empty(); }
+
+    bool isHashed() const { return !bucketCounts.empty(); }
 };
 
 #endif
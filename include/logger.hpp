@@ -0,0 +1,74 @@
+#ifndef LOGGER_HPP
+#define LOGGER_HPP
+
+#include <sstream>
+#include <string>
+
+// Compile-time floor for log statements: 0 = debug, 1 = info, 2 = error.
+// Statements below it expand to nothing (release builds use 1, see CMakeLists.txt).
+#ifndef POI_LOG_LEVEL
+#define POI_LOG_LEVEL 0
+#endif
+
+enum class LogLevel { Debug = 0, Info = 1, Error = 2, Off = 3 };
+
+// Leveled logging with per-thread buffering.
+// Each thread appends formatted lines to its own buffer; full buffers (and every error
+// line) are handed to a background sink thread, which also sweeps all buffers
+// periodically and writes them out in batches. Debug/info go to stdout, errors to stderr.
+// Lines of one thread keep their order; lines of different threads may be regrouped.
+namespace Logger {
+    // Runtime switch on top of the compile-time floor
+    void setLevel(LogLevel level);
+    LogLevel getLevel();
+    bool enabled(LogLevel level);
+
+    // "debug", "info", "error" or "off"; returns false for anything else
+    bool parseLevel(const std::string& name, LogLevel& level);
+
+    // Append one line to the calling thread's buffer
+    void write(LogLevel level, const std::string& message);
+
+    // Write out every thread's pending lines now (e.g. before exiting)
+    void flush();
+}
+
+// Collects one log line through operator<< and hands it to the logger when destroyed
+class LogMessage {
+public:
+    explicit LogMessage(LogLevel level);
+    ~LogMessage();
+
+    LogMessage(const LogMessage&) = delete;
+    LogMessage& operator=(const LogMessage&) = delete;
+
+    std::ostream& stream() { return out; }
+
+private:
+    LogLevel level;
+    std::ostringstream out;
+};
+
+#define POI_LOG(level, message) \
+    do { \
+        if (Logger::enabled(level)) { \
+            LogMessage logMessage(level); \
+            logMessage.stream() << message; \
+        } \
+    } while (0)
+
+#if POI_LOG_LEVEL <= 0
+#define LOG_DEBUG(message) POI_LOG(LogLevel::Debug, message)
+#else
+#define LOG_DEBUG(message) do {} while (0)
+#endif
+
+#if POI_LOG_LEVEL <= 1
+#define LOG_INFO(message) POI_LOG(LogLevel::Info, message)
+#else
+#define LOG_INFO(message) do {} while (0)
+#endif
+
+#define LOG_ERROR(message) POI_LOG(LogLevel::Error, message)
+
+#endif // LOGGER_HPP
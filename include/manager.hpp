@@ -1,25 +1,46 @@
 #ifndef MANAGER_HPP
 #define MANAGER_HPP
 
-#include <queue>
+#include <cstdint>
 #include <string>
+#include <utility>
 #include <vector>
+#include "task_scheduler.hpp"
+#include "metrics.hpp"
+#include "discovery.hpp"
 
 class Manager {
 private:
     int numWorkers;
-    std::vector<std::queue<std::string>>& workerQueues;  // Reference to the workers' task queues
-    std::vector<int>& workerEfficiencies;  // Efficiency values of the workers
+    TaskScheduler& scheduler;  // Per-worker task queues shared with the workers
+    std::vector<double>& workerEfficiencies;  // Relative cost per byte, from measured throughput
+    const RuntimeMetrics& metrics;  // Source of the measured throughput
+
+    // Min-heap of (estimated outstanding work, worker): outstanding bytes times the worker's cost per byte
+    std::vector<std::pair<double, int>> loadHeap;
+    size_t assignedTasks = 0;
+
+    // Re-read every worker's outstanding bytes and cost, dropping estimates that drifted
+    void rebuildLoadHeap();
+
+    // Sort tasks largest first and submit them one by one
+    void submitLargestFirst(std::vector<FileTask>& tasks);
 
 public:
-    // Constructor that initializes the manager with workers' queues and efficiencies
-    Manager(int numWorkers, std::vector<std::queue<std::string>>& queues, std::vector<int>& efficiencies);
+    // Constructor that initializes the manager with the workers' scheduler and efficiencies
+    Manager(int numWorkers, TaskScheduler& scheduler, std::vector<double>& efficiencies, const RuntimeMetrics& metrics);
+
+    // Pick the worker expected to be free first and charge it with a task of the given size (O(log workers))
+    int assignWorker(uint64_t bytes);
 
-    // Function to find the least loaded worker based on queue size and worker efficiency
-    int getLeastLoadedWorker();
+    // Function to distribute tasks among workers, largest files first (LPT), each to the
+    // worker with the least outstanding estimated work.
+    // Blocks while the workers' queues are full and signals shutdown when done.
+    void distributeTasks(std::vector<std::string> files);
 
-    // Function to distribute tasks among workers dynamically based on their load
-    void distributeTasks(const std::vector<std::string>& files);
+    // Same, fed by a running discovery: each chunk is submitted as soon as it is found,
+    // so largest-first only holds within a chunk
+    void distributeTasks(FileDiscovery& discovery);
 };
 
 #endif // MANAGER_HPP
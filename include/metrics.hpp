@@ -0,0 +1,159 @@
+#ifndef METRICS_HPP
+#define METRICS_HPP
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Stages a document goes through, in pipeline order
+enum class Stage { QueueWait, Read, Tokenize, Score, Report };
+constexpr size_t stageCount = 5;
+const char* stageName(Stage stage);
+
+enum class StatsFormat { Prometheus, Json };
+
+// Point-in-time copy of a LatencyHistogram (or the sum of several)
+struct HistogramSnapshot {
+    std::vector<uint64_t> buckets;
+    uint64_t count = 0;
+    uint64_t sumNanos = 0;
+    uint64_t maxNanos = 0;
+
+    void merge(const HistogramSnapshot& other);
+    // Highest value equivalent to the q-quantile sample (q in [0, 1])
+    uint64_t percentile(double q) const;
+};
+
+// Log-linear latency histogram in the style of HdrHistogram: every power of two is split
+// into 16 linear sub-buckets, so any recorded value is known to within 1/16 (~6%) from
+// 1 ns up to days, in a fixed 6 KB of counters. One thread records, any thread may read.
+class LatencyHistogram {
+public:
+    void record(uint64_t nanos);
+    void record(std::chrono::steady_clock::duration elapsed);
+    HistogramSnapshot snapshot() const;
+
+    static constexpr int subBucketBits = 4;
+    static constexpr int maxExponent = 47;  // Values are clamped to 2^48 ns (~3 days)
+    static constexpr size_t bucketCount = (maxExponent - subBucketBits + 2) << subBucketBits;
+
+    static size_t bucketIndex(uint64_t nanos);
+    static uint64_t bucketUpperBound(size_t index);
+
+private:
+    std::array<std::atomic<uint64_t>, bucketCount> buckets{};
+    std::atomic<uint64_t> sumNanos{0};
+    std::atomic<uint64_t> maxNanos{0};
+};
+
+// Counters and stage latencies of one worker; written only by that worker
+struct alignas(64) WorkerMetrics {
+    std::atomic<uint64_t> files{0};
+    std::atomic<uint64_t> bytes{0};
+    std::atomic<uint64_t> tokens{0};
+    std::atomic<uint64_t> errors{0};
+    std::atomic<uint64_t> skippedTokens{0};  // Left unscored by early exit (partly estimated)
+    std::atomic<uint64_t> skippedBytes{0};   // Never read thanks to early exit
+    std::atomic<uint64_t> timeouts{0};       // Daemon requests past their deadline
+    std::atomic<uint64_t> cacheHits{0};      // Answered from the result cache, nothing scored
+    std::atomic<uint64_t> cacheMisses{0};    // Classified and added to the result cache
+    std::atomic<uint64_t> busyNanos{0};  // Reading, tokenizing, scoring and reporting
+    std::array<LatencyHistogram, stageCount> stages;
+
+    LatencyHistogram& stage(Stage s) { return stages[static_cast<size_t>(s)]; }
+};
+
+// How busy one stage of the pipeline mode is (see pipeline.hpp); shared by its threads.
+// busy + starved + blocked adds up to the stage's threads times the time they ran.
+struct alignas(64) StageOccupancy {
+    std::atomic<uint64_t> threads{0};
+    std::atomic<uint64_t> items{0};         // Blocks (documents for the read stage) handled
+    std::atomic<uint64_t> busyNanos{0};     // Working on an item
+    std::atomic<uint64_t> starvedNanos{0};  // Waiting for input
+    std::atomic<uint64_t> blockedNanos{0};  // Waiting for a free buffer or room downstream
+    std::atomic<uint64_t> queued{0};        // Items waiting in the stage's input queue
+    std::atomic<uint64_t> queueCapacity{0};
+};
+
+// Runtime instrumentation shared by the manager, the workers and the report sink
+class RuntimeMetrics {
+public:
+    explicit RuntimeMetrics(int numWorkers);
+
+    RuntimeMetrics(const RuntimeMetrics&) = delete;
+    RuntimeMetrics& operator=(const RuntimeMetrics&) = delete;
+
+    int getNumWorkers() const { return static_cast<int>(workers.size()); }
+    WorkerMetrics& worker(int workerId) { return *workers[workerId]; }
+    const WorkerMetrics& worker(int workerId) const { return *workers[workerId]; }
+
+    // Time the report sink spends writing one batch
+    LatencyHistogram& reportFlush() { return flushLatency; }
+
+    // Read, Tokenize or Score stage of the pipeline mode; only reported once it has threads
+    StageOccupancy& occupancy(Stage s) { return pipelineStages[static_cast<size_t>(s)]; }
+    const StageOccupancy& occupancy(Stage s) const { return pipelineStages[static_cast<size_t>(s)]; }
+
+    // Bytes classified per busy second, 0 until the worker finished a document
+    double throughput(int workerId) const;
+
+    // Relative cost of queueing a file on each worker: the mean measured throughput over
+    // the worker's own, clamped to [0.25, 4]. Workers without measurements get 1.
+    void updateEfficiencies(std::vector<double>& efficiencies) const;
+
+    std::string format(StatsFormat statsFormat) const;
+
+    // Replace filename with a fresh dump (written to a temporary file and renamed, so a
+    // scraper never sees a half-written one). Returns false on I/O errors.
+    bool dump(const std::string& filename, StatsFormat statsFormat) const;
+
+    // "prometheus" or "json"; returns false for anything else
+    static bool parseFormat(const std::string& name, StatsFormat& statsFormat);
+
+private:
+    std::string formatPrometheus() const;
+    std::string formatJson() const;
+    // Share of the stage threads' time spent busy since the run started
+    double utilization(Stage s) const;
+
+    std::vector<std::unique_ptr<WorkerMetrics>> workers;
+    LatencyHistogram flushLatency;
+    std::array<StageOccupancy, stageCount> pipelineStages;
+    std::chrono::steady_clock::time_point started;
+};
+
+// Rewrites the stats file every interval on a background thread, and once more on stop()
+class StatsDumper {
+public:
+    StatsDumper(const RuntimeMetrics& metrics, std::string filename, StatsFormat statsFormat,
+                std::chrono::milliseconds interval);
+    ~StatsDumper();
+
+    StatsDumper(const StatsDumper&) = delete;
+    StatsDumper& operator=(const StatsDumper&) = delete;
+
+    void stop();
+
+private:
+    void run();
+
+    const RuntimeMetrics& metrics;
+    std::string filename;
+    StatsFormat statsFormat;
+    std::chrono::milliseconds interval;
+
+    std::mutex stopMutex;
+    std::condition_variable wake;
+    bool stopping = false;
+    std::thread dumper;
+};
+
+#endif // METRICS_HPP
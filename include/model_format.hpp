@@ -0,0 +1,138 @@
+#ifndef MODEL_FORMAT_HPP
+#define MODEL_FORMAT_HPP
+
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+
+// On-disk layout of a compiled model (model.dat v5).
+//
+//   FileHeader
+//   GenreEntry[genreCount]                      genre table
+//   double[genreCount]                          log prior per genre
+//   char[stringPoolSize]                        genre names and terms, not NUL-terminated
+//   TermEntry[termCount]                        term id -> string pool slice
+//   HashSlot[hashBucketCount]                   open-addressing index, FNV-1a, linear probing
+//   CellScale[genreCount]                       only for quantized cells (scaleOffset not 0)
+//   cell[(termCount + 1) * rowStride]           log-probability matrix, term-major;
+//                                               the extra last row is the per-genre smoothing term
+//   int64[genreCount]                           training documents per genre     } only when countOffset
+//   int64[termCount * genreCount]               term-major raw word counts       } is not 0
+//
+// Hashed-feature models (hashBits != 0) store no vocabulary: every token is hashed into
+// one of termCount = 2^hashBits buckets and its bucket index is the row. The string pool
+// then holds only the genre names, and the term table and hash index are empty
+// (hashBucketCount 0), so the file size depends on the bucket and genre counts alone.
+//
+// Cells are doubles, or in a compacted model 16- or 8-bit fixed point: genre g's value is
+// offset[g] + q * scale[g], so a sum over n tokens is n * offset[g] + scale[g] * sum(q) and
+// the q can be added up as integers. Compacted models carry no counts.
+//
+// Version 4 is the same with double cells only, version 3 also without hashing and version
+// 2 also without the count sections. Their headers are shorter, but the genre table always
+// starts at offset 128 and the gap is zero-filled, so reading them as v5 headers yields
+// double cells, hashBits 0 (and countOffset 0 for v2).
+//
+// Every section starts on a 64-byte boundary and all values are native little-endian,
+// so a page-aligned mmap of the file can be scored from directly.
+namespace ModelFormat {
+    constexpr char magic[8] = {'P', 'O', 'I', 'M', 'O', 'D', 'E', 'L'};
+    constexpr uint32_t version = 5;
+    constexpr uint32_t oldestReadableVersion = 2;
+    constexpr uint32_t byteOrderMark = 0x01020304;
+    constexpr uint32_t emptySlot = UINT32_MAX;
+    constexpr uint64_t sectionAlignment = 64;
+    constexpr uint32_t minHashBits = 8;
+    constexpr uint32_t maxHashBits = 24;
+
+    enum class CellType : uint32_t {
+        Double = 0,
+        Int16 = 1,
+        Int8 = 2
+    };
+
+    inline size_t cellSize(CellType cellType) {
+        switch (cellType) {
+            case CellType::Int16: return sizeof(int16_t);
+            case CellType::Int8: return sizeof(int8_t);
+            default: return sizeof(double);
+        }
+    }
+
+    // Largest magnitude of a quantized cell
+    inline int32_t cellLimit(CellType cellType) {
+        return cellType == CellType::Int16 ? INT16_MAX : INT8_MAX;
+    }
+
+    struct FileHeader {
+        char magic[8];
+        uint32_t version;
+        uint32_t byteOrderMark;
+        uint32_t genreCount;
+        uint32_t termCount;
+        uint32_t hashBucketCount;  // Power of two
+        uint32_t rowStride;        // Doubles per matrix row
+        uint64_t genreTableOffset;
+        uint64_t logPriorOffset;
+        uint64_t stringPoolOffset;
+        uint64_t stringPoolSize;
+        uint64_t termTableOffset;
+        uint64_t hashIndexOffset;
+        uint64_t logProbOffset;
+        uint64_t fileSize;
+        uint64_t countOffset;      // Raw counts the probabilities were derived from; 0 when absent
+        uint32_t hashBits;         // log2 of the bucket count of a hashed-feature model; 0 otherwise
+        CellType cellType;
+        uint64_t scaleOffset;      // Per-genre CellScale of quantized cells; 0 for doubles
+    };
+
+    // Older headers are shorter but their genre table starts at the same offset
+    static_assert(sizeof(FileHeader) <= 128);
+
+    struct CellScale {
+        double scale;
+        double offset;
+    };
+
+    struct GenreEntry {
+        uint32_t nameOffset;
+        uint32_t nameLength;
+        int64_t totalWords;
+        double priorProbability;
+    };
+
+    struct TermEntry {
+        uint32_t stringOffset;
+        uint32_t length;
+    };
+
+    struct HashSlot {
+        uint32_t termId;   // emptySlot when unused
+        uint32_t hashTag;  // High half of the hash, checked before comparing strings
+    };
+
+    // Stable across platforms and runs, unlike std::hash
+    inline uint64_t hashTerm(std::string_view term) {
+        uint64_t hash = 14695981039346656037ull;
+        for (unsigned char c : term) {
+            hash ^= c;
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
+
+    // Row of a token in a hashed-feature model
+    inline uint32_t hashBucket(std::string_view term, uint32_t hashBits) {
+        return static_cast<uint32_t>(hashTerm(term) & ((uint64_t(1) << hashBits) - 1));
+    }
+
+    inline uint64_t alignSection(uint64_t offset) {
+        return (offset + sectionAlignment - 1) & ~(sectionAlignment - 1);
+    }
+
+    inline bool hasMagic(const void* data, size_t size) {
+        return size >= sizeof(magic) && std::memcmp(data, magic, sizeof(magic)) == 0;
+    }
+}
+
+#endif // MODEL_FORMAT_HPP
@@ -0,0 +1,40 @@
+#ifndef OPTIONS_HPP
+#define OPTIONS_HPP
+
+#include <string>
+#include <vector>
+#include "report_writer.hpp"
+#include "metrics.hpp"
+#include "discovery.hpp"
+#include "pipeline.hpp"
+#include "server.hpp"
+
+// Command-line settings of the classifier run
+struct Options {
+    int numWorkers = 0;          // 0: one per usable CPU (see ThreadPool)
+    bool pinThreads = false;     // Bind the pool threads to CPUs
+    std::string reportFilename = "classification_report.txt";
+    ReportFormat reportFormat = ReportFormat::Text;
+    int reportFlushMs = 200;
+    std::string statsFilename;  // Defaults to runtime_stats.prom / runtime_stats.json by format
+    StatsFormat statsFormat = StatsFormat::Prometheus;
+    int statsIntervalMs = 1000;  // 0: write the stats only at the end of the run
+    DiscoveryOptions discovery;  // Roots default to Config::directoryPath
+    PipelineOptions pipeline;    // Replaces the workers when enabled
+    bool earlyExit = false;      // Stop scoring a document once its genre is settled
+    bool dedup = false;          // Classify identical documents once (see result_cache.hpp)
+    std::string cacheFilename;   // Keep the results across runs; implies dedup
+    int hashBits = 0;            // Train a missing model with 2^hashBits hashed features (0: vocabulary)
+    ServerOptions server;        // Daemon mode when a socket is set; its workers follow numWorkers
+};
+
+// Parses "[threads] [PATH...] [--include=GLOB]... [--exclude=GLOB]... [--min-size=N[K|M|G]]
+// [--max-size=N[K|M|G]] [--discovery-threads=N] [--readers=N] [--tokenizers=N] [--scorers=N]
+// [--pipeline-depth=N] [--pin] [--early-exit] [--dedup] [--cache=FILE] [--hash-bits=N] [--serve=SOCKET|-] [--serve-batch=N] [--report=FILE] [--report-format=text|csv|jsonl] [--report-flush-ms=N]
+// [--log-level=debug|info|error|off] [--stats=FILE] [--stats-format=prometheus|json]
+// [--stats-interval-ms=N]". Any of the four pipeline flags switches to the pipeline mode,
+// where the thread count argument is ignored. The log level takes effect as soon as it is parsed.
+// Invalid values are reported and leave the default in place.
+void parseOptions(int argc, char* argv[], Options& options);
+
+#endif // OPTIONS_HPP
@@ -0,0 +1,93 @@
+#ifndef PIPELINE_HPP
+#define PIPELINE_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <future>
+#include <vector>
+#include "blocking_queue.hpp"
+#include "task_scheduler.hpp"
+#include "report_writer.hpp"
+#include "metrics.hpp"
+
+// Thread counts of the pipeline mode; off unless a stage was given on the command line
+struct PipelineOptions {
+    bool enabled = false;
+    int readers = 2;
+    int tokenizers = 2;
+    int scorers = 2;
+    int queueDepth = 16;  // Blocks each stage queue holds before its producers wait
+
+    int threadCount() const { return readers + tokenizers + scorers; }
+};
+
+// Overlapped read -> tokenize -> score pipeline, the alternative to workerFunction's
+// one-document-at-a-time loop.
+//
+// Readers take files from the scheduler (one scheduler queue per reader) and read them
+// into pooled blocks, cut right after the last separator so no token straddles two
+// blocks. Tokenizer threads turn a block into term ids, scorer threads add up its
+// per-genre log probabilities, and the thread that finishes a document's last block
+// picks the genre and hands the result to the report writer. The stages are joined by
+// bounded queues and the pool is the only source of buffers, so memory stays fixed while
+// a slow stage pushes back on the ones before it.
+//
+// Metric slots: readers first, then tokenizers, then scorers; occupancy per stage is in
+// RuntimeMetrics::occupancy. Each block is summed on its own and the block sums are added
+// to the priors in document order, so scores can differ from classifyFile in the last bits.
+// The scheduler must have one queue per reader.
+class Pipeline {
+public:
+    Pipeline(const PipelineOptions& options, TaskScheduler& scheduler, ReportWriter& reportWriter,
+             RuntimeMetrics& metrics);
+    ~Pipeline();
+
+    Pipeline(const Pipeline&) = delete;
+    Pipeline& operator=(const Pipeline&) = delete;
+
+    void start();
+
+    // Wait until the scheduler is shut down and every document went through
+    void join();
+
+private:
+    struct Document;
+    struct Block {
+        std::vector<char> text;
+        size_t size = 0;
+        std::vector<uint32_t> terms;
+        std::shared_ptr<Document> document;
+        uint32_t sequence = 0;  // Position of the block in its document
+    };
+
+    void readerLoop(int readerId);
+    void tokenizerLoop(int slot);
+    void scorerLoop(int slot);
+
+    void readDocument(int readerId, FileTask&& task);
+    Block* acquireBlock(uint64_t& blockedNanos);
+    void releaseBlock(Block* block);
+    // Queue a block of the document for tokenizing; returns the time spent waiting
+    uint64_t ship(Block* block, const std::shared_ptr<Document>& document, uint32_t sequence);
+    void finishDocument(Document& document, int slot);
+
+    PipelineOptions options;
+    TaskScheduler& scheduler;
+    ReportWriter& reportWriter;
+    RuntimeMetrics& metrics;
+
+    std::vector<std::unique_ptr<Block>> blocks;
+    BlockingQueue<Block*> freeBlocks;
+    BlockingQueue<Block*> tokenizeQueue;
+    BlockingQueue<Block*> scoreQueue;
+
+    // The last thread of a stage closes the queue after it
+    std::atomic<int> activeReaders{0};
+    std::atomic<int> activeTokenizers{0};
+
+    std::vector<std::future<void>> stageJobs;  // Stage loops on pool threads
+};
+
+#endif // PIPELINE_HPP
@@ -0,0 +1,83 @@
+#ifndef REPORT_WRITER_HPP
+#define REPORT_WRITER_HPP
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "bounded_queue.hpp"
+#include "metrics.hpp"
+
+enum class ReportFormat { Text, Csv, Jsonl };
+
+// One classified document, as handed from a worker to the report sink
+struct ReportRecord {
+    std::string filePath;
+    std::string genre;
+    double logProbability = 0.0;
+    std::vector<double> scores;  // Per genre, in the order given to the writer
+    size_t tokens = 0;
+    int workerId = -1;
+    double elapsedMs = 0.0;      // Time spent reading and scoring the document
+};
+
+// Single writer for the classification report.
+// Workers push records into a lock-free ring; one sink thread drains it into a memory
+// buffer and writes that out in large batches, either every flush interval or when the
+// buffer grows past a threshold, and once more on close(). The file is opened once for
+// the whole run, so lines never interleave and there is no open/close per document.
+class ReportWriter {
+public:
+    ReportWriter(const std::string& filename, ReportFormat format, std::vector<std::string> genreNames,
+                 std::chrono::milliseconds flushInterval, size_t ringCapacity = 4096);
+    ~ReportWriter();
+
+    ReportWriter(const ReportWriter&) = delete;
+    ReportWriter& operator=(const ReportWriter&) = delete;
+
+    // Never takes a lock; spins briefly only when the ring is full
+    void submit(ReportRecord&& record);
+    // Copies into the ring slot, reusing its storage: a worker that keeps one record
+    // across documents hands results over without allocating
+    void submit(const ReportRecord& record);
+
+    // Write everything still queued and stop the sink thread
+    void close();
+
+    size_t recordsWritten() const { return written.load(std::memory_order_relaxed); }
+
+    // Record how long every batch write takes (nullptr to stop)
+    void setFlushHistogram(LatencyHistogram* histogram) { flushLatency.store(histogram, std::memory_order_release); }
+
+    // "text", "csv" or "jsonl"; returns false for anything else
+    static bool parseFormat(const std::string& name, ReportFormat& format);
+
+private:
+    void wakeIfBacklogged();
+    void sinkLoop();
+    size_t drain();
+    void flush();
+    void appendRecord(const ReportRecord& record);
+    void appendHeader();
+
+    std::FILE* file = nullptr;
+    ReportFormat format;
+    std::vector<std::string> genreNames;
+    std::chrono::milliseconds flushInterval;
+
+    BoundedQueue<ReportRecord> ring;
+    std::string batch;
+    std::atomic<size_t> written{0};
+    std::atomic<LatencyHistogram*> flushLatency{nullptr};
+
+    std::atomic<bool> closing{false};
+    std::mutex wakeMutex;
+    std::condition_variable wake;
+    std::thread sink;
+};
+
+#endif // REPORT_WRITER_HPP
@@ -0,0 +1,94 @@
+#ifndef RESULT_CACHE_HPP
+#define RESULT_CACHE_HPP
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include "classifier.hpp"
+#include "compiled_model.hpp"
+
+// Classification results remembered by document content, in front of the classifier.
+//
+// Documents are keyed by a 64-bit hash of their bytes (ContentHash::hash64), so identical
+// files are scored once per run: the first worker to reach a content classifies it, and
+// any other worker holding the same content waits for that result instead of scoring it
+// again. With a cache file the results also carry over between runs. The file belongs to
+// one model fingerprint and is ignored when the model changed. A file whose path, size and
+// mtime match the last run is answered without even being hashed.
+class ResultCache {
+public:
+    // What find() resolved for one file; hand it back to store() or abandon()
+    struct Ticket {
+        std::string path;
+        uint64_t size = 0;
+        int64_t mtimeNanos = 0;
+        uint64_t contentHash = 0;
+        bool owner = false;  // The caller has to classify the content
+    };
+
+    struct Stats {
+        uint64_t pathHits = 0;       // Unchanged path, size and mtime; not hashed
+        uint64_t contentHits = 0;    // Content classified in an earlier run
+        uint64_t duplicateHits = 0;  // Content already classified (or being classified) in this run
+        uint64_t misses = 0;
+    };
+
+    // Without a filename only this run's duplicates are found. A cache file written for
+    // another fingerprint, or one that cannot be parsed, is reported and started over.
+    ResultCache(std::string filename, uint64_t modelFingerprint);
+
+    ResultCache(const ResultCache&) = delete;
+    ResultCache& operator=(const ResultCache&) = delete;
+
+    // True with genre, scores and token count when the content is known, blocking while
+    // another worker classifies the same content. Otherwise the ticket owns the content and
+    // must be passed to store() or abandon(). Throws std::runtime_error if the file cannot be read.
+    bool find(const std::string& path, ClassificationResult& result, Ticket& ticket);
+
+    // Publish the owner's result; one without a genre is not kept
+    void store(const Ticket& ticket, const ClassificationResult& result);
+
+    // The owner failed; the next worker with this content classifies it itself
+    void abandon(const Ticket& ticket);
+
+    // Replace the cache file (temporary file and rename); returns false on I/O errors.
+    // Does nothing without a filename.
+    bool save();
+
+    Stats stats() const;
+
+    // Model image hash, changed by early exit too since it leaves the scores partial
+    static uint64_t fingerprint(const CompiledModel& model, bool earlyExit);
+
+private:
+    struct Entry {
+        bool ready = false;      // false while the owner is still classifying
+        bool fromThisRun = false;
+        std::string genre;
+        double logProbability = 0.0;
+        std::vector<double> scores;
+        size_t tokens = 0;
+    };
+    struct FileKey {
+        uint64_t size = 0;
+        int64_t mtimeNanos = 0;
+        uint64_t contentHash = 0;
+    };
+
+    void load();
+    // Blocks while the entry is pending; false if it was abandoned or is missing
+    bool awaitReady(std::unique_lock<std::mutex>& lock, uint64_t contentHash, ClassificationResult& result);
+
+    std::string filename;
+    uint64_t modelFingerprint;
+
+    mutable std::mutex entriesMutex;
+    std::condition_variable published;
+    std::unordered_map<uint64_t, Entry> results;
+    std::unordered_map<std::string, FileKey> files;
+    Stats counts;
+};
+
+#endif // RESULT_CACHE_HPP
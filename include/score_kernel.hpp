@@ -0,0 +1,48 @@
+#ifndef SCORE_KERNEL_HPP
+#define SCORE_KERNEL_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+// Inner loop of scoring: add the matrix rows of a run of term ids into the per-genre sums.
+//
+// The genre count of a model is small and fixed once it is loaded, so the loop is
+// instantiated for every count up to maxSpecializedGenres. With the count known at compile
+// time the sums live in registers for the whole run and a row goes in with a few
+// full-width vector adds (4 doubles per AVX2 register, 8 per AVX-512 one) instead of a
+// loop over the genres. Other counts use a generic loop.
+//
+// Each genre's sum still takes the rows one by one in term order, so every kernel gives
+// bit-identical results. The weighted variant (a bag of distinct terms and their counts)
+// multiplies and then adds; the file is built without floating-point contraction so that
+// AVX-512 does not fuse the two into an FMA and round differently from the others.
+namespace ScoreKernel {
+    enum class Isa { Generic, AVX2, AVX512 };
+
+    constexpr size_t maxSpecializedGenres = 16;
+
+    // Instruction set picked from the CPU features at startup
+    Isa bestIsa();
+    Isa activeIsa();
+    // Force one (e.g. Generic to cross-check the others); clamps to what the CPU supports
+    void setIsa(Isa isa);
+    const char* isaName(Isa isa);
+
+    // scores[g] += values[row * stride + g] for g < numGenres and every term's row; unknown
+    // terms (CompiledModel::unknownTerm) take unknownRow
+    using AddRows = void (*)(const double* values, uint64_t stride, uint64_t unknownRow, const uint32_t* termIds,
+                             size_t count, size_t numGenres, double* scores);
+
+    // Kernel for the genre count on the active instruction set
+    AddRows addRows(size_t numGenres);
+
+    // scores[g] += counts[i] * values[row * stride + g], i.e. the rows of count distinct terms,
+    // each added as often as its count says
+    using AddWeightedRows = void (*)(const double* values, uint64_t stride, uint64_t unknownRow,
+                                     const uint32_t* termIds, const uint64_t* counts, size_t count,
+                                     size_t numGenres, double* scores);
+
+    AddWeightedRows addWeightedRows(size_t numGenres);
+}
+
+#endif // SCORE_KERNEL_HPP
@@ -0,0 +1,98 @@
+#ifndef SERVER_HPP
+#define SERVER_HPP
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <future>
+#include <thread>
+#include <vector>
+#include "blocking_queue.hpp"
+#include "metrics.hpp"
+
+// Settings of the daemon mode; off unless a socket (or "-" for stdin) was given
+struct ServerOptions {
+    std::string socketPath;   // Unix domain socket to listen on; "-" serves stdin/stdout
+    int workers = 4;
+    size_t maxBatch = 32;     // Requests a worker takes per wake-up
+    size_t queueDepth = 1024; // Requests waiting before the connections stop being read
+};
+
+// Resident classifier: the model stays loaded and the workers stay warm between requests.
+//
+// Requests are single lines of tab-separated fields:
+//
+//     <id> TAB <deadline ms> TAB file TAB <path>
+//     <id> TAB <deadline ms> TAB text TAB <text up to the end of the line>
+//
+// The deadline counts from when the line was read; 0 means none. Each request gets one
+// line back, on the same connection but not necessarily in order:
+//
+//     <id> TAB ok TAB <genre> TAB <log probability> TAB <tokens> TAB <ms> TAB <genre>=<score> ...
+//     <id> TAB timeout TAB <ms>
+//     <id> TAB error TAB <message>
+//
+// Every connection has a reader thread that parses lines into one shared queue. A worker
+// takes up to maxBatch queued requests at a time, runs them earliest deadline first
+// (answering those already past it without scoring), and writes each connection's answers
+// with a single write. Metric slots are the workers.
+class ClassificationServer {
+public:
+    ClassificationServer(const ServerOptions& options, RuntimeMetrics& metrics);
+    ~ClassificationServer();
+
+    ClassificationServer(const ClassificationServer&) = delete;
+    ClassificationServer& operator=(const ClassificationServer&) = delete;
+
+    // Serve until stop() (or, on stdin, end of input) and every accepted request is answered.
+    // Returns false when the socket cannot be set up.
+    bool run();
+
+    // Stop accepting; safe to call from a signal handler
+    void stop();
+
+private:
+    struct Connection;
+    struct Request {
+        std::shared_ptr<Connection> connection;
+        std::string id;
+        bool inlineText = false;
+        std::string payload;
+        std::chrono::steady_clock::time_point received;
+        std::chrono::steady_clock::time_point deadline;  // max() when there is none
+    };
+
+    bool listenOnSocket();
+    void acceptLoop();
+    void readLoop(std::shared_ptr<Connection> connection);
+    void workerLoop(int workerId);
+    void handleBatch(std::vector<Request>& batch, int workerId);
+    // Append the answer to one request to out
+    void answer(Request& request, int workerId, std::string& out);
+
+    // Parses one request line; on failure the id (if any) and a message are set instead
+    static bool parseRequest(const std::string& line, Request& request, std::string& error);
+    static void sendAll(Connection& connection, const std::string& data);
+
+    ServerOptions options;
+    RuntimeMetrics& metrics;
+
+    BlockingQueue<Request> requests;
+    int listenFd = -1;
+    int wakePipe[2] = {-1, -1};  // stop() writes here to wake the accept and read loops
+    std::atomic<bool> stopping{false};
+
+    // Reader threads are detached (a daemon sees many short connections); shutting down
+    // waits for the count to drop to zero
+    std::mutex readersMutex;
+    std::condition_variable readersDone;
+    int activeReaders = 0;
+
+    std::vector<std::future<void>> workers;  // Worker loops on pool threads
+};
+
+#endif // SERVER_HPP
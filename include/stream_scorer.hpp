@@ -0,0 +1,111 @@
+#ifndef STREAM_SCORER_HPP
+#define STREAM_SCORER_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+#include "compiled_model.hpp"
+#include "term_bag.hpp"
+
+// Incremental per-genre scoring of a document that arrives in blocks.
+// Bytes are tokenized block by block in a reusable buffer; a token cut by a block
+// boundary is carried to the front of the buffer and completed by the next block.
+// Short documents are scored token by token: one lookup and one row add per token, in
+// document order. From Config::termBagThreshold bytes on, where the same words keep
+// coming back, the tokens are only counted into a bag of words (see term_bag.hpp) while
+// the document streams in, and finish() looks up each distinct word and adds its row
+// once, times its count. Either way the result does not depend on the block size, and
+// memory stays bounded by the block size (plus the document's vocabulary). Early exit
+// reads the running sums after every batch, so it always goes token by token.
+class StreamScorer {
+public:
+    StreamScorer(const CompiledModel& model, size_t blockSize);
+
+    // Start a new document (scores back to the log priors, or to zero when scoring
+    // one slice of a document whose partial sums are added up elsewhere)
+    void reset(bool startFromPriors = true);
+
+    // Free space after the carried partial token; fill it and then commit()
+    char* prepare(size_t& capacity);
+    void commit(size_t bytes);
+
+    // Copy a block in (e.g. a slice of an mmap'd file)
+    void feed(const char* data, size_t size);
+
+    // End of document: score the carried token, if any, and the counted words
+    void finish();
+
+    // Add a batch of already-tokenized words in order (scored by finish()). With early exit on,
+    // tokensAfter is an upper bound on the tokens still to come after this batch.
+    void addTokens(const std::vector<std::string_view>& words, uint64_t tokensAfter = 0);
+
+    // Early exit: bounds from CompiledModel::contributionBounds() (kept by the caller), or
+    // nullptr to score everything. Every checkInterval tokens a genre is dropped once even
+    // gaining the most it could on each remaining token would leave it below the leader;
+    // once a single genre is left the argmax is settled and the rest is skipped. The
+    // winner always matches full scoring; the scores are the partial sums at that point.
+    void setEarlyExit(const double* bounds) { contributionBounds = bounds; }
+
+    // Document size in bytes, which bounds the tokens still to come while streaming
+    // (without it, or when the document turns out longer, nothing is pruned) and picks
+    // between token-by-token and bag-of-words scoring. A scorer for one slice of a document
+    // (reset(false)) takes the whole document's size
+    void setDocumentSize(uint64_t bytes) { documentBytes = bytes; }
+
+    // Only one genre can still win; the rest of the document does not need to be read
+    bool decided() const { return settled; }
+    size_t decidedGenre() const { return winner; }
+    // Tokens split off but left unscored once decided
+    size_t skippedTokenCount() const { return tokensSkipped; }
+
+    // Replace the accumulated state with sums reduced from several partial scorers
+    void setTotals(const double* totals, size_t count, size_t tokens) {
+        logProbabilities.assign(totals, totals + count);
+        tokensScored = tokens;
+    }
+
+    const std::vector<double>& scores() const { return logProbabilities; }
+    size_t tokenCount() const { return tokensScored; }
+
+    // Time spent tokenizing and scoring blocks since reset()
+    uint64_t tokenizeNanos() const { return tokenizeTime; }
+    uint64_t scoreNanos() const { return scoreTime; }
+    void setStageTimes(uint64_t tokenize, uint64_t score) {
+        tokenizeTime = tokenize;
+        scoreTime = score;
+    }
+
+private:
+    void scanBuffer(size_t filled, bool finalBlock);
+    void addRange(const std::string_view* words, size_t count);
+    // Long document without early exit: count words now, score them in finish()
+    bool countingWords() const;
+    void scoreBag();
+    // Drop genres that can no longer win; returns true once only one is left
+    bool prune(uint64_t tokensAfter);
+
+    static constexpr size_t checkInterval = 1024;
+
+    const CompiledModel& model;
+    std::vector<char> buffer;
+    size_t carried = 0;  // Bytes of the partial token at the front of buffer
+    std::vector<std::string_view> tokens;
+    std::vector<uint32_t> termIds;
+    TermBag bag;
+    std::vector<double> logProbabilities;
+    size_t tokensScored = 0;
+    uint64_t tokenizeTime = 0;
+    uint64_t scoreTime = 0;
+
+    const double* contributionBounds = nullptr;
+    uint64_t documentBytes = 0;
+    uint64_t bytesCommitted = 0;
+    bool fromPriors = true;
+    std::vector<char> contending;  // Per genre: still able to win
+    bool settled = false;
+    size_t winner = 0;
+    size_t tokensSkipped = 0;
+};
+
+#endif // STREAM_SCORER_HPP
@@ -0,0 +1,76 @@
+#ifndef TASK_SCHEDULER_HPP
+#define TASK_SCHEDULER_HPP
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "bounded_queue.hpp"
+
+// A unit of work handed from the manager to a worker
+struct FileTask {
+    std::string filePath;
+    uint64_t bytes = 0;       // File size, the basis of the cost estimate
+    int assignedWorker = -1;  // Queue the task was placed in (set by submit())
+    std::chrono::steady_clock::time_point enqueuedAt{};  // Set by submit(), for queue-wait metrics
+};
+
+// Bounded per-worker task queues with work stealing.
+// The manager submits into the queue of the worker it picked; a worker drains its own
+// queue first and steals from the others when it runs dry, so nobody idles while work
+// is left anywhere. Idle workers park on a condition variable instead of polling, and
+// submit() blocks while every queue is full, which keeps memory bounded no matter how
+// many paths the manager streams in.
+// Every worker also carries the bytes of its queued and running tasks ("outstanding
+// work"); the manager balances on it and thieves go to the most loaded queue first.
+class TaskScheduler {
+public:
+    TaskScheduler(int numWorkers, std::size_t queueCapacity);
+
+    TaskScheduler(const TaskScheduler&) = delete;
+    TaskScheduler& operator=(const TaskScheduler&) = delete;
+
+    // Queue a task for the given worker; spills to other queues or waits when it is full
+    void submit(int workerId, FileTask&& task);
+
+    // Fetch the next task for a worker (own queue, then stealing, then parking).
+    // Returns false once shutdown() was called and no work is left.
+    bool next(int workerId, FileTask& task);
+
+    // A task fetched with next() is finished (successfully or not); releases its bytes
+    void taskDone(const FileTask& task);
+
+    // No more tasks will be submitted; wake everyone so they can drain and exit
+    void shutdown();
+
+    int getNumWorkers() const { return static_cast<int>(queues.size()); }
+    std::size_t queueSize(int workerId) const { return queues[workerId]->sizeApprox(); }
+    uint64_t outstandingBytes(int workerId) const { return outstanding[workerId].load(std::memory_order_relaxed); }
+    std::size_t stolenTasks() const { return stealCount.load(std::memory_order_relaxed); }
+
+private:
+    bool tryTake(int workerId, FileTask& task);
+    void wakeProducer();
+
+    std::vector<std::unique_ptr<BoundedQueue<FileTask>>> queues;
+    std::unique_ptr<std::atomic<uint64_t>[]> outstanding;  // Bytes queued or running, per assigned worker
+    std::size_t totalCapacity;
+
+    std::atomic<std::size_t> pendingTasks{0};
+    std::atomic<std::size_t> stealCount{0};
+    std::atomic<bool> stopping{false};
+
+    // Parking lot for idle workers and a blocked producer
+    std::mutex parkMutex;
+    std::condition_variable workAvailable;
+    std::condition_variable spaceAvailable;
+    std::atomic<int> sleepingWorkers{0};
+    std::atomic<int> waitingProducers{0};
+};
+
+#endif // TASK_SCHEDULER_HPP
@@ -0,0 +1,67 @@
+#ifndef TERM_BAG_HPP
+#define TERM_BAG_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+// A document reduced to its distinct words and how often each occurs: the bag of words
+// naive Bayes actually scores. A book repeats a few thousand words hundreds of thousands
+// of times, so counting first and then looking each distinct word up and adding its row
+// once, times its count (CompiledModel::accumulate(const TermBag&, ...)), makes scoring
+// cost scale with the vocabulary of the document rather than its length.
+//
+// Counting is an open-addressing table (linear probing, at most half full) keyed by a
+// cheap word-at-a-time hash; the words are copied once into the bag, so they may come
+// from a buffer that is reused for the next block. Entries stay in first-seen order,
+// so the result does not depend on the table size. The bag holds words rather than term
+// ids, so one bag scores against any model; clear() keeps the storage, and once it has
+// grown the next document allocates nothing. Not thread-safe.
+class TermBag {
+public:
+    TermBag();
+
+    // Drop every entry; keeps the storage
+    void clear();
+
+    void add(std::string_view word, uint64_t count = 1);
+    void add(const std::string_view* words, size_t count);
+
+    size_t size() const { return entries.size(); }
+    bool empty() const { return entries.empty(); }
+    // Sum of the counts
+    uint64_t tokenCount() const { return tokens; }
+
+    // Distinct word i (in the order first added) and its count
+    std::string_view word(size_t i) const {
+        return std::string_view(characters.data() + entries[i].offset, entries[i].length);
+    }
+    // size() counts, one per word
+    const uint64_t* wordCounts() const { return counts.data(); }
+
+private:
+    struct Slot {
+        uint32_t tag;    // High half of the word's hash
+        uint32_t entry;  // emptySlot when free
+    };
+    struct Entry {
+        uint32_t offset;  // Into characters
+        uint32_t length;
+    };
+    static constexpr uint32_t emptySlot = UINT32_MAX;
+
+    static uint64_t hashWord(std::string_view word);
+    void grow();
+
+    std::vector<Slot> slots;
+    size_t slotMask = 0;
+
+    std::vector<Entry> entries;
+    std::vector<uint64_t> counts;
+    std::vector<uint32_t> entrySlots;
+    std::vector<char> characters;  // Every distinct word, back to back
+    uint64_t tokens = 0;
+};
+
+#endif // TERM_BAG_HPP
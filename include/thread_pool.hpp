@@ -0,0 +1,119 @@
+#ifndef THREAD_POOL_HPP
+#define THREAD_POOL_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// CPUs this process may run on, as Linux reports them: the affinity mask, the cgroup CPU
+// quota (v2 cpu.max or v1 cfs quota) and the NUMA node of every CPU.
+struct CpuTopology {
+    std::vector<int> cpus;      // Allowed CPUs, grouped by node
+    std::vector<int> cpuNodes;  // Node of each entry of cpus, numbered 0..nodeCount - 1
+    int nodeCount = 1;
+    double quotaCpus = 0.0;     // 0: no quota
+
+    // Threads worth running at once: the allowed CPUs, capped by the quota rounded up
+    int usableThreads() const;
+
+    static CpuTopology detect();
+};
+
+// The process-wide thread pool. Its size follows the hardware (usableThreads()), and with
+// pinning every pool thread is bound to one CPU, filling a NUMA node before the next.
+//
+// Two kinds of work go through it:
+// - start() runs a long job (a worker loop, a pipeline stage) on a pool thread of its own;
+//   the pool grows when none is idle, so such jobs never wait for each other.
+// - parallelFor() splits a loop between the calling thread and as many helpers as there are
+//   free cores right now: the pool size less the jobs running or queued, where a job parked
+//   waiting for work (see Parked) leaves its core free. A loop inside a worker (a large file
+//   scored in ranges) therefore uses the cores of idle workers without piling threads on top
+//   of busy ones, and cannot deadlock when every core is taken: the caller then simply runs
+//   every index. Helpers run on idle pool threads, and the pool grows when there are too few.
+class ThreadPool {
+public:
+    // Pool size (0: CpuTopology::usableThreads()) and pinning; only takes effect before the
+    // first instance() call
+    static void configure(int threads, bool pin);
+    static ThreadPool& instance();
+
+    // Join every pool thread once the jobs queued so far are done (no-op if the pool was never
+    // created); nothing may be started afterwards. Has to run before main() returns: left to
+    // static destruction, the threads would exit after statics they still use, like the log sink.
+    static void shutdown();
+
+    // Calls shutdown() when it goes out of scope; one at the top of main() covers every return
+    struct ShutdownGuard {
+        ~ShutdownGuard() { shutdown(); }
+    };
+
+    // While in scope, the calling pool job is blocked waiting for work (a worker with an empty
+    // queue), so its core counts as free for parallelFor() helpers. No-op outside a pool job.
+    class Parked {
+    public:
+        Parked();
+        ~Parked();
+        Parked(const Parked&) = delete;
+        Parked& operator=(const Parked&) = delete;
+
+    private:
+        bool counted = false;
+    };
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+    ~ThreadPool();
+
+    size_t size() const { return baseThreads; }
+    bool pinned() const { return pin; }
+    const CpuTopology& topology() const { return cpuTopology; }
+
+    // Most participants a parallelFor over count indices can have
+    size_t parallelism(size_t count) const { return count < baseThreads ? count : baseThreads; }
+
+    // NUMA node the calling thread runs on (its CPU's node for pinned pool threads)
+    int currentNode() const;
+
+    // Run job on a pool thread of its own; the future rethrows what the job threw
+    std::future<void> start(std::function<void()> job);
+
+    // Call body(index, participant) for every index in [0, count), each exactly once.
+    // participant is below parallelism(count) and no two threads share one during the call,
+    // so it can index per-participant scratch. Returns when every index is done; the first
+    // exception a body threw is rethrown.
+    void parallelFor(size_t count, const std::function<void(size_t, size_t)>& body);
+
+    // Run job on a temporary thread bound to the node's CPUs, so memory it touches first
+    // lands on that node (job runs on the calling thread when nothing is pinned)
+    void runOnNode(int node, const std::function<void()>& job);
+
+private:
+    ThreadPool(int threads, bool pinThreads);
+
+    void stop();
+    void spawnThread();  // With jobsMutex held
+    void threadLoop(size_t index);
+    void bindToCpus(const std::vector<int>& cpus) const;
+
+    CpuTopology cpuTopology;
+    size_t baseThreads;
+    bool pin;
+
+    std::mutex jobsMutex;
+    std::condition_variable jobAvailable;
+    std::deque<std::function<void()>> jobs;
+    size_t waitingThreads = 0;
+    size_t runningJobs = 0;
+    std::atomic<size_t> parkedJobs{0};  // Running jobs inside a Parked scope
+    bool stopping = false;
+    std::vector<std::thread> threads;
+};
+
+#endif // THREAD_POOL_HPP
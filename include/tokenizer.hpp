@@ -0,0 +1,51 @@
+#ifndef TOKENIZER_HPP
+#define TOKENIZER_HPP
+
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Single tokenizer shared by training and classification.
+//
+// A token is a maximal run of bytes between ASCII whitespace. Inside a token ASCII
+// letters are folded to lowercase, ASCII digits and every byte >= 0x80 (UTF-8
+// sequences) are kept as-is, and all other ASCII bytes (punctuation, control
+// characters) are dropped. Tokens that end up empty are skipped.
+//
+// Normalization happens in place in the caller's buffer and tokens are emitted as
+// views into it, so tokenizing allocates nothing once the output vector has grown.
+namespace Tokenizer {
+    enum class Kernel { Scalar, SSE2, AVX2 };
+
+    // Kernel picked from the CPU features at startup
+    Kernel bestKernel();
+    Kernel activeKernel();
+    // Force a kernel (e.g. Scalar to cross-check the SIMD paths); clamps to what the CPU supports
+    void setKernel(Kernel kernel);
+    const char* kernelName(Kernel kernel);
+
+    // Token separator; splitting a buffer right after one never changes its tokens
+    inline bool isSpace(char c) {
+        return c == ' ' || (c >= '\t' && c <= '\r');
+    }
+
+    // Normalize data[0, size) in place and append a view of every complete token to tokens.
+    // When finalBlock is false the buffer is one block of a longer stream: the trailing token
+    // may continue in the next block, so it is not emitted but returned (already normalized,
+    // possibly empty) for the caller to carry over in front of the next block.
+    std::string_view tokenize(char* data, size_t size, std::vector<std::string_view>& tokens, bool finalBlock = true);
+}
+
+// Transparent hash so maps keyed by std::string can be probed with token views
+struct TokenHash {
+    using is_transparent = void;
+    size_t operator()(std::string_view token) const { return std::hash<std::string_view>{}(token); }
+};
+
+template <typename Value>
+using TokenMap = std::unordered_map<std::string, Value, TokenHash, std::equal_to<>>;
+
+#endif // TOKENIZER_HPP
@@ -1,28 +1,82 @@
 #ifndef TRAIN_MODEL_HPP
 #define TRAIN_MODEL_HPP
 
+#include <cstdint>
 #include <string>
+#include <string_view>
 #include <unordered_map>
 #include <vector>
 #include "genre_model.hpp"
 
+struct GenreCounts;
+
+// Naive-Bayes model kept as raw per-genre word and document counts.
+// Counts only ever add up, so new labelled documents are folded in with update() and
+// models trained on separate shards are combined with merge(); both give exactly the
+// model a single training run over all the data would. Probabilities are derived from
+// the counts when the model is compiled for scoring (see CompiledModel).
+//
+// With hashed features the words are counted into 2^bits buckets per genre instead, so
+// the model has a fixed size and keeps no word strings; colliding words share a count.
 class TrainModel {
 public:
     TrainModel();
     void trainOrLoadModel(const std::string& modelFilename);
-    void trainNaiveBayes();
+    void trainNaiveBayes();  // From Config::trainingDataPath
+    void trainNaiveBayes(const std::string& csvPath);  // Starts over from an empty model
+
+    // Add labelled (genre, text) documents to the counts; genres outside
+    // Config::predefinedGenres are skipped. Returns false (and changes nothing) when the
+    // model only has probabilities, e.g. after loading a legacy or v2 file.
+    bool update(const std::vector<std::pair<std::string, std::string>>& documents);
+    // Streams the file through a TrainingCsv; also false when it cannot be read
+    bool update(const std::string& csvPath);
+
+    // Sum of two count models; throws std::runtime_error if either has no counts or they
+    // are not hashed the same way
+    static TrainModel merge(const TrainModel& modelA, const TrainModel& modelB);
+
+    // Writes ./models/<filename>, atomically replacing an earlier version
     void saveModel(const std::string& filename);
     void displayModel() const;
     void loadModel(const std::string& filename);
     std::unordered_map<std::string, GenreModel> genreModels;  
     void addGenreModel(const std::string& genre, GenreModel& genreModel);
 
+    bool hasCounts() const;
+    int64_t getTotalDocuments() const { return totalDocuments; }
+
+    // Switch to hashed features with 2^bits buckets: word counts already in the model are
+    // folded into their buckets and later updates count straight into them. Returns false
+    // (and changes nothing) for probability-only models, bits outside
+    // ModelFormat::minHashBits..maxHashBits, or a model already hashed with other bits.
+    bool hashFeatures(uint32_t bits);
+
+    // Compaction: drop words counted fewer than minCount times over all genres, or keep only
+    // the keepWords words with the highest mutual information between word and genre. The
+    // genre totals keep the dropped occurrences, so the remaining words' probabilities do not
+    // change and dropped words score like unseen ones. Vocabulary count models only; returns
+    // the number of words dropped.
+    size_t pruneRareWords(int64_t minCount);
+    size_t pruneByInformation(size_t keepWords);
+    uint32_t getHashBits() const { return hashBits; }
+
+    // Every (genre, summary) row of the file in memory; training streams the file instead
+    static std::vector<std::pair<std::string, std::string>> readCSV(const std::string& fileName);
+
 private:
-    std::vector<std::string> preprocessText(const std::string& text);
-    std::vector<std::pair<std::string, std::string>> readCSV(const std::string& fileName);
+    // Fold counted documents into the genres and refresh the priors
+    void addCounts(GenreCounts& counts);
+    // Priors follow the document counts
+    void refreshPriors();
+    // Count of every word over all genres; false (and logged) for models pruning cannot handle
+    bool wordTotals(std::unordered_map<std::string_view, int64_t>& totals) const;
+    // Remove the words from every genre; returns how many were removed
+    size_t dropWords(const std::vector<std::string>& words);
 
 private:
-    int totalDocuments;
+    int64_t totalDocuments;
+    uint32_t hashBits;  // 0: the genres count words
 };
 
 #endif // TRAIN_MODEL_HPP
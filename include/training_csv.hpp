@@ -0,0 +1,72 @@
+#ifndef TRAINING_CSV_HPP
+#define TRAINING_CSV_HPP
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Labelled training documents ("index,title,genre,summary" rows) read straight out of a
+// read-only mapping of the CSV file, so memory does not grow with the file.
+//
+// Bytes are taken as UTF-8 as they are; nothing is decoded. A field may be double-quoted
+// (RFC 4180: commas, line breaks and "" inside), and the summary runs to the end of the
+// record, commas included. In the scraped layout every summary is followed by a line
+// containing "(less)", and the summary's unquoted line breaks do not end the record; that
+// layout is assumed when such a line shows up in the first megabyte, otherwise every
+// unquoted line break ends a record.
+//
+// The file is cut into chunks that start on record boundaries, so they can be parsed on
+// separate threads. Each chunk start is guessed from the nearest line break (or "(less)"
+// line) in parallel, and then checked against where the previous chunk's last record
+// really ends. A guess that landed inside a quoted field is corrected by scanning again
+// from that record end.
+class TrainingCsv {
+public:
+    // Throws std::runtime_error when the file cannot be opened or mapped
+    explicit TrainingCsv(const std::string& fileName);
+    ~TrainingCsv();
+
+    TrainingCsv(const TrainingCsv&) = delete;
+    TrainingCsv& operator=(const TrainingCsv&) = delete;
+
+    size_t size() const { return fileSize; }
+    bool hasLessMarkers() const { return lessMarkers; }
+    size_t chunkCount() const { return chunkStarts.size() - 1; }
+
+    // Calls visit(genre, summary) for every record of the chunk, in file order. The views
+    // point into the mapping. The summary is the raw span of the record, so it can still
+    // hold the quotes and line breaks, which the tokenizer drops. A line without a genre
+    // field is passed with an empty genre.
+    template <typename Visit>
+    void forEachRecord(size_t chunk, Visit&& visit) const {
+        const char* pos = data + chunkStarts[chunk];
+        const char* end = data + chunkStarts[chunk + 1];
+        std::string_view genre, summary;
+        while (pos < end) {
+            pos = nextRecord(pos, genre, summary);
+            visit(genre, summary);
+        }
+    }
+
+private:
+    // Parse the record starting at pos; returns where the next one starts
+    const char* nextRecord(const char* pos, std::string_view& genre, std::string_view& summary) const;
+    // Record start at or after pos, assuming pos is not inside a quoted field
+    const char* guessRecordStart(const char* pos) const;
+    // Start of the first record that begins at or after limit, scanning records from pos
+    const char* skipRecords(const char* pos, const char* limit) const;
+    // Past the line break that ends the line holding pos (or the end of the file)
+    const char* nextLine(const char* pos) const;
+    // Start of the next line containing "(less)", from pos on (end of the file if none)
+    const char* findLessLine(const char* pos) const;
+    void splitIntoChunks();
+
+    const char* data = nullptr;
+    const char* dataEnd = nullptr;
+    size_t fileSize = 0;
+    bool lessMarkers = false;
+    std::vector<size_t> chunkStarts;  // Offsets; the last one is the file size
+};
+
+#endif // TRAINING_CSV_HPP
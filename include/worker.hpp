@@ -1,9 +1,14 @@
 #ifndef WORKER_HPP
 #define WORKER_HPP
 
-#include <string>
-#include <queue>
+#include "task_scheduler.hpp"
+#include "report_writer.hpp"
+#include "metrics.hpp"
+#include "result_cache.hpp"
 
-void workerFunction(int workerId, std::queue<std::string>& workerQueue);
+// Classify the files the scheduler hands this worker; with a result cache, documents whose
+// content was classified before are answered from it (nullptr: no cache)
+void workerFunction(int workerId, TaskScheduler& scheduler, ReportWriter& reportWriter, RuntimeMetrics& metrics,
+                    ResultCache* resultCache);
 
 #endif // WORKER_HPP
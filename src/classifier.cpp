@@ -1,25 +1,75 @@
 #include "classifier.hpp"
-#include <iostream>
-#include <sstream>
+#include "document_arena.hpp"
+#include "tokenizer.hpp"
+#include "config.hpp"
+#include "logger.hpp"
+#include "thread_pool.hpp"
 #include <limits>
-#include <cmath>
+#include <stdexcept>
+#include <cerrno>
 #include <algorithm>
+#include <chrono>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+uint64_t elapsedNanos(std::chrono::steady_clock::time_point started) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - started).count();
+}
+
+} // namespace
+
+void ClassificationResult::clear() {
+    genre.clear();
+    logProbability = 0.0;
+    scores.clear();
+    tokens = 0;
+    bytes = 0;
+    readNanos = tokenizeNanos = scoreNanos = 0;
+    skippedBytes = 0;
+    skippedTokens = 0;
+}
 
 // Static instance pointer
 Classifier* Classifier::instance = nullptr;
-TrainModel* Classifier::sharedModel = nullptr;
 
 // Private constructor to use the shared model
-Classifier::Classifier(TrainModel& model) {
-    sharedModel = &model; // Correctly initialize the static sharedModel
-    std::cout << "[DEBUG] Classifier initialized with shared model." << std::endl;
-    std::cout << "[DEBUG] Total genre models in shared model: " << sharedModel->genreModels.size() << std::endl;
+Classifier::Classifier(CompiledModel model) : compiledModel(std::move(model)) {
+    LOG_DEBUG("Classifier initialized with " << (compiledModel.isMapped() ? "memory-mapped" : "in-memory")
+              << " model.");
+    LOG_DEBUG("Total genre models in shared model: " << compiledModel.genreCount());
+    if (compiledModel.isHashed()) {
+        LOG_DEBUG("Hashed features: " << compiledModel.termCount() << " buckets.");
+    } else {
+        LOG_DEBUG("Compiled vocabulary: " << compiledModel.termCount() << " terms.");
+    }
+
+    // Pinned threads stay on their node, so each node gets a copy its own threads fault in
+    ThreadPool& pool = ThreadPool::instance();
+    int nodes = pool.topology().nodeCount;
+    if (pool.pinned() && nodes > 1) {
+        nodeModels.resize(nodes);
+        for (int node = 0; node < nodes; ++node) {
+            pool.runOnNode(node, [&] { nodeModels[node] = compiledModel.copyInMemory(); });
+        }
+        LOG_DEBUG("Model replicated on " << nodes << " NUMA nodes (" << compiledModel.imageSize() << " bytes each).");
+    }
+}
+
+const CompiledModel& Classifier::localModel() const {
+    if (nodeModels.empty()) {
+        return compiledModel;
+    }
+    return nodeModels[ThreadPool::instance().currentNode()];
 }
 
 // Public static method to get the singleton instance
 Classifier& Classifier::getInstance() {
     if (instance == nullptr) {
-        std::cerr << "[ERROR] Classifier not initialized yet. Please call initialize() first." << std::endl;
+        LOG_ERROR("Classifier not initialized yet. Please call initialize() first.");
         throw std::runtime_error("Classifier not initialized.");
     }
     return *instance;
@@ -28,90 +78,264 @@ Classifier& Classifier::getInstance() {
 // Method to initialize the classifier with the model (only once)
 void Classifier::initialize(TrainModel& model) {
     if (instance == nullptr) {
-        instance = new Classifier(model);
+        instance = new Classifier(CompiledModel(model.genreModels));
+    } else {
+        LOG_ERROR("Classifier has already been initialized.");
+    }
+}
+
+void Classifier::initialize(CompiledModel model) {
+    if (instance == nullptr) {
+        instance = new Classifier(std::move(model));
     } else {
-        std::cerr << "[ERROR] Classifier has already been initialized." << std::endl;
+        LOG_ERROR("Classifier has already been initialized.");
     }
 }
 
-// Preprocess the text (convert to lowercase and remove punctuation)
-std::vector<std::string> Classifier::preprocessText(const std::string& text) {
-    std::vector<std::string> words;
-    std::istringstream iss(text);
-    std::string word;
+StreamScorer& Classifier::threadScorer() {
+    thread_local StreamScorer scorer(localModel(), Config::streamBlockSize);
+    return scorer;
+}
+
+StreamScorer& Classifier::startDocument(uint64_t documentBytes) {
+    // Scratch of the thread's previous document is no longer referenced
+    DocumentArena::forThread().reset();
+    StreamScorer& scorer = threadScorer();
+    scorer.reset();
+    scorer.setEarlyExit(earlyExit ? contributionBounds.data() : nullptr);
+    scorer.setDocumentSize(documentBytes);
+    return scorer;
+}
 
-    std::cout << "[DEBUG] Preprocessing text..." << std::endl;
-    while (iss >> word) {
-        std::transform(word.begin(), word.end(), word.begin(), ::tolower);
-        word.erase(std::remove_if(word.begin(), word.end(), ::ispunct), word.end());
-        words.push_back(word);
+void Classifier::setEarlyExit(bool enabled) {
+    if (enabled && contributionBounds.empty()) {
+        contributionBounds = compiledModel.contributionBounds();
     }
+    earlyExit = enabled;
+}
 
-    std::cout << "[DEBUG] Preprocessed text contains " << words.size() << " words." << std::endl;
-    return words;
+void Classifier::pickBestGenre(const StreamScorer& scorer, ClassificationResult& result) const {
+    result.clear();
+    result.scores.assign(scorer.scores().begin(), scorer.scores().end());
+    result.tokens = scorer.tokenCount();
+    chooseGenre(result);
+    result.tokenizeNanos = scorer.tokenizeNanos();
+    result.scoreNanos = scorer.scoreNanos();
+    result.skippedTokens = scorer.skippedTokenCount();
+
+    // Settled early: the partial sums need not be ordered like the final ones, the bounds are
+    if (scorer.decided() && result.genre != compiledModel.genreName(scorer.decidedGenre())) {
+        result.genre = compiledModel.genreName(scorer.decidedGenre());
+        result.logProbability = result.scores[scorer.decidedGenre()];
+        LOG_DEBUG("Early exit settled on " << result.genre << " ahead of the partial sums.");
+    }
+}
+
+ClassificationResult Classifier::pickBestGenre(std::vector<double> scores, size_t tokens) const {
+    ClassificationResult result;
+    result.scores = std::move(scores);
+    result.tokens = tokens;
+    chooseGenre(result);
+    return result;
 }
 
-// Calculate log probability for the text given the genre model
-double Classifier::calculateLogProbability(const std::vector<std::string>& words, const GenreModel& genreModel) {
-    //std::cout << "[DEBUG] Calculating log probability for genre: " << genreModel.genre << std::endl;
-   // std::cout << "[DEBUG] Genre Model Prior Probability: " << genreModel.priorProbability << std::endl;
+void Classifier::chooseGenre(ClassificationResult& result) const {
+    result.logProbability = -std::numeric_limits<double>::infinity();
 
-    double logProbability = std::log(genreModel.priorProbability);
-    //std::cout << "[DEBUG] Initial log probability (prior): " << logProbability << std::endl;
+    LOG_DEBUG("Evaluating " << compiledModel.genreCount() << " genre models.");
 
-    // Iterate over words and update log probability based on word occurrences in the model
-    for (const auto& word : words) {
-        auto it = genreModel.wordProbabilities.find(word);
-        if (it != genreModel.wordProbabilities.end()) {
-            logProbability += std::log(it->second); // Log of word probability
-            //std::cout << "[DEBUG] Word '" << word << "' found in model. Updated log probability: " << logProbability << std::endl;
-        } else {
-            // Smoothing applied when word is not found
-            logProbability += std::log(1.0 / (genreModel.totalWordsInGenre + 1));  
-            //std::cout << "[DEBUG] Word '" << word << "' NOT found. Applied smoothing. Updated log probability: " << logProbability << std::endl;
+    for (size_t g = 0; g < compiledModel.genreCount(); ++g) {
+        std::string_view genre = compiledModel.genreName(g);
+        LOG_DEBUG("Final log probability for genre '" << genre << "': " << result.scores[g]);
+
+        // Update the best genre based on log probability comparison
+        if (result.scores[g] > result.logProbability) {
+            result.logProbability = result.scores[g];
+            result.genre = genre;
         }
     }
 
-    std::cout << "[DEBUG] Final log probability for genre '" << genreModel.genre << "': " << logProbability << std::endl;
-    return logProbability;
+    if (result.genre.empty()) {
+        LOG_ERROR("Classification failed: No valid genre found.");
+        result.genre = "Unknown";
+        return;
+    }
+
+    LOG_INFO("Text classified as: " << result.genre << " with log probability: " << result.logProbability);
 }
 
 // Classify the text directly (without needing a file)
-std::string Classifier::classifyText(const std::string& text) {
-    std::cout << "[DEBUG] Starting text classification..." << std::endl;
+std::string Classifier::classifyText(std::string& text) {
+    LOG_DEBUG("Starting text classification...");
+
+    // Tokenize in place; the views point into text and the vector keeps its capacity per thread
+    thread_local std::vector<std::string_view> words;
+    words.clear();
+    Tokenizer::tokenize(text.data(), text.size(), words);
+    LOG_DEBUG("Preprocessed text contains " << words.size() << " words.");
 
-    // Preprocess the input text
-    std::vector<std::string> words = preprocessText(text);
+    StreamScorer& scorer = startDocument(text.size());
+    scorer.addTokens(words);
+    scorer.finish();
+
+    ClassificationResult result;
+    pickBestGenre(scorer, result);
+    return result.genre;
+}
 
-    std::string bestGenre;
-    double bestLogProbability = -std::numeric_limits<double>::infinity();
+ClassificationResult Classifier::classifyBuffer(const char* data, size_t size) {
+    StreamScorer& scorer = startDocument(size);
+    scorer.feed(data, size);
+    scorer.finish();
 
-    std::cout << "[DEBUG] Evaluating " << sharedModel->genreModels.size() << " genre models." << std::endl;
+    ClassificationResult result;
+    pickBestGenre(scorer, result);
+    result.bytes = size;
+    return result;
+}
 
-    // Iterate through the genre models and calculate log probability for each genre
-    for (const auto& genreEntry : sharedModel->genreModels) {
-        const std::string& genre = genreEntry.first;
-        const GenreModel& genreModel = genreEntry.second;
+ClassificationResult Classifier::classifyFile(const std::string& filePath) {
+    ClassificationResult result;
+    classifyFile(filePath, result);
+    return result;
+}
 
-        std::cout << "[DEBUG] Checking genre: " << genre << std::endl;
-        std::cout << "[DEBUG] Genre model details: " << std::endl;
-        std::cout << "[DEBUG] Genre: " << genreModel.genre << ", Prior Probability: " << genreModel.priorProbability
-                  << ", Total Words in Genre: " << genreModel.totalWordsInGenre << std::endl;
+// Classify a file block by block without ever holding the whole content
+void Classifier::classifyFile(const std::string& filePath, ClassificationResult& result) {
+    LOG_DEBUG("Starting streaming classification of " << filePath);
 
-        double logProbability = calculateLogProbability(words, genreModel);
+    int fd = open(filePath.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("Unable to open file: " + filePath);
+    }
 
-        // Update the best genre based on log probability comparison
-        if (logProbability > bestLogProbability) {
-            bestLogProbability = logProbability;
-            bestGenre = genre;
+    struct stat fileStat;
+    size_t fileSize = fstat(fd, &fileStat) == 0 ? static_cast<size_t>(fileStat.st_size) : 0;
+
+    StreamScorer& scorer = startDocument(fileSize);
+
+    // Large documents: map once and let several cores score token-aligned ranges of it
+    // (not with early exit, which needs the tokens in document order)
+    if (!earlyExit && fileSize >= Config::parallelScoreThreshold && ThreadPool::instance().size() > 1) {
+        auto mapStarted = std::chrono::steady_clock::now();
+        void* mapping = mmap(nullptr, fileSize, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapping != MAP_FAILED) {
+            close(fd);
+            madvise(mapping, fileSize, MADV_SEQUENTIAL);
+            uint64_t mapNanos = elapsedNanos(mapStarted);
+            scoreRangesInParallel(static_cast<const char*>(mapping), fileSize, scorer);
+            munmap(mapping, fileSize);
+
+            pickBestGenre(scorer, result);
+            result.bytes = fileSize;
+            result.readNanos = mapNanos;
+            return;
         }
     }
 
-    if (bestGenre.empty()) {
-        std::cerr << "[ERROR] Classification failed: No valid genre found." << std::endl;
-        return "Unknown";
+    uint64_t readNanos;
+    uint64_t bytesRead = 0;
+    try {
+        readNanos = scoreStream(fd, filePath, scorer, bytesRead);
+    } catch (...) {
+        close(fd);
+        throw;
+    }
+    close(fd);
+
+    LOG_DEBUG("Streamed " << scorer.tokenCount() << " words from " << filePath);
+    pickBestGenre(scorer, result);
+    result.bytes = fileSize;
+    result.readNanos = readNanos;
+    if (scorer.decided() && bytesRead < fileSize) {
+        result.skippedBytes = fileSize - bytesRead;
+        size_t seen = result.tokens + result.skippedTokens;
+        result.skippedTokens += static_cast<size_t>(static_cast<double>(result.skippedBytes) * seen / bytesRead);
+        LOG_DEBUG("Early exit on " << filePath << " after " << result.tokens << " tokens; skipped "
+                  << result.skippedBytes << " bytes.");
+    }
+}
+
+uint64_t Classifier::scoreStream(int fd, const std::string& filePath, StreamScorer& scorer, uint64_t& bytesRead) {
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    uint64_t readNanos = 0;
+    while (!scorer.decided()) {
+        size_t capacity;
+        char* block = scorer.prepare(capacity);
+        auto readStarted = std::chrono::steady_clock::now();
+        ssize_t count = read(fd, block, capacity);
+        readNanos += elapsedNanos(readStarted);
+        if (count < 0) {
+            if (errno == EINTR) continue;
+            throw std::runtime_error("Error reading file: " + filePath);
+        }
+        if (count == 0) break;
+        bytesRead += static_cast<uint64_t>(count);
+        scorer.commit(static_cast<size_t>(count));
+    }
+    scorer.finish();  // Once decided, the carried token only counts as skipped
+    return readNanos;
+}
+
+void Classifier::scoreRangesInParallel(const char* data, size_t size, StreamScorer& scorer) {
+    ThreadPool& pool = ThreadPool::instance();
+    size_t numRanges = pool.parallelism((size + Config::parallelChunkSize - 1) / Config::parallelChunkSize);
+
+    // Per-document scratch comes from the thread's arena (reset by startDocument)
+    std::pmr::memory_resource* arena = DocumentArena::forThread().resource();
+
+    // Cut right after a separator so every token lies entirely inside one range
+    std::pmr::vector<size_t> bounds(numRanges + 1, size, arena);
+    bounds[0] = 0;
+    for (size_t r = 1; r < numRanges; ++r) {
+        size_t cut = std::max(bounds[r - 1], size / numRanges * r);
+        while (cut < size && !Tokenizer::isSpace(data[cut])) {
+            ++cut;
+        }
+        bounds[r] = std::min(cut + 1, size);
+    }
+
+    // The calling thread scores a range too, reusing its own scorer, so keep the priors aside.
+    // Every range writes its own slice of the flat partial arrays; nothing is allocated in
+    // the parallel region (the arena is not thread-safe anyway).
+    size_t numGenres = scorer.scores().size();
+    std::pmr::vector<double> totals(scorer.scores().begin(), scorer.scores().end(), arena);
+    std::pmr::vector<double> partialScores(numRanges * numGenres, 0.0, arena);
+    std::pmr::vector<size_t> partialTokens(numRanges, 0, arena);
+    std::pmr::vector<uint64_t> partialTokenizeNanos(numRanges, 0, arena);
+    std::pmr::vector<uint64_t> partialScoreNanos(numRanges, 0, arena);
+
+    // Free cores help, those of workers parked for lack of files included; with every core
+    // busy (all workers scoring) the calling thread scores the ranges itself
+    pool.parallelFor(numRanges, [&](size_t r, size_t) {
+        // Each thread has its own scorer, so the slices are copied through a bounded buffer
+        StreamScorer& rangeScorer = threadScorer();
+        rangeScorer.reset(false);
+        // The whole document's size, so every range counts words when the document would;
+        // without priors nothing is pruned, so the slice needs no size of its own
+        rangeScorer.setDocumentSize(size);
+        rangeScorer.feed(data + bounds[r], bounds[r + 1] - bounds[r]);
+        rangeScorer.finish();
+        std::copy(rangeScorer.scores().begin(), rangeScorer.scores().end(), partialScores.begin() + r * numGenres);
+        partialTokens[r] = rangeScorer.tokenCount();
+        partialTokenizeNanos[r] = rangeScorer.tokenizeNanos();
+        partialScoreNanos[r] = rangeScorer.scoreNanos();
+    });
+
+    // Reduce in range order so the result does not depend on thread timing
+    size_t tokens = 0;
+    uint64_t tokenizeNanos = 0, scoreNanos = 0;
+    for (size_t r = 0; r < numRanges; ++r) {
+        for (size_t g = 0; g < numGenres; ++g) {
+            totals[g] += partialScores[r * numGenres + g];
+        }
+        tokens += partialTokens[r];
+        tokenizeNanos += partialTokenizeNanos[r];
+        scoreNanos += partialScoreNanos[r];
     }
+    scorer.setTotals(totals.data(), totals.size(), tokens);
+    scorer.setStageTimes(tokenizeNanos, scoreNanos);
 
-    std::cout << "[INFO] Text classified as: " << bestGenre << " with log probability: " << bestLogProbability << std::endl;
-    return bestGenre;
+    LOG_DEBUG("Scored " << tokens << " words in " << numRanges << " parallel ranges.");
 }
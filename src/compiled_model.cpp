@@ -0,0 +1,612 @@
+#include "compiled_model.hpp"
+#include "content_hash.hpp"
+#include "score_kernel.hpp"
+#include "term_bag.hpp"
+#include "tokenizer.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <new>
+#include <stdexcept>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+using namespace ModelFormat;
+
+namespace {
+
+// Zeroed image memory, aligned for the sections
+shared_ptr<unsigned char> allocateImage(size_t size) {
+    unsigned char* buffer = static_cast<unsigned char*>(::operator new(size, align_val_t(sectionAlignment)));
+    memset(buffer, 0, size);
+    return shared_ptr<unsigned char>(buffer, [](unsigned char* p) {
+        ::operator delete(p, align_val_t(sectionAlignment));
+    });
+}
+
+// Calls visit(word, probability) for every word the genre knows, from its counts when it has them
+template <typename Visit>
+void forEachWord(const GenreModel& genreModel, Visit visit) {
+    if (!genreModel.hasCounts()) {
+        for (const auto& wordEntry : genreModel.wordProbabilities) {
+            visit(wordEntry.first, wordEntry.second);
+        }
+        return;
+    }
+    for (const auto& wordEntry : genreModel.wordCounts) {
+        if (wordEntry.second > 0) {
+            visit(wordEntry.first, static_cast<double>(wordEntry.second) / genreModel.totalWordsInGenre);
+        }
+    }
+}
+
+// Bits of the hashed-feature genres, or 0 when they count words; throws on a mix
+uint32_t hashBitsOf(const unordered_map<string, GenreModel>& genreModels) {
+    uint32_t hashBits = 0;
+    bool first = true;
+    for (const auto& genreEntry : genreModels) {
+        size_t buckets = genreEntry.second.bucketCounts.size();
+        uint32_t bits = 0;
+        while ((size_t(1) << bits) < buckets) {
+            ++bits;
+        }
+        if (buckets != 0 && (buckets != (size_t(1) << bits) || bits < minHashBits || bits > maxHashBits)) {
+            throw runtime_error("Genre " + genreEntry.first + " has an invalid bucket count");
+        }
+        if (buckets != 0 && !(genreEntry.second.wordCounts.empty() && genreEntry.second.wordProbabilities.empty())) {
+            throw runtime_error("Genre " + genreEntry.first + " has both bucket and word counts");
+        }
+        if (!first && bits != hashBits) {
+            throw runtime_error("Genres differ in hashing; all must use the same number of buckets or none");
+        }
+        hashBits = bits;
+        first = false;
+    }
+    return hashBits;
+}
+
+// Per genre, the offset is the middle of the column's range and the scale maps its ends to +-limit
+template <typename Cell>
+void quantizeMatrix(const double* values, uint64_t rows, uint32_t numGenres, int32_t limit, CellScale* scales,
+                    Cell* cells) {
+    for (uint32_t g = 0; g < numGenres; ++g) {
+        double lowest = HUGE_VAL;
+        double highest = -HUGE_VAL;
+        for (uint64_t r = 0; r < rows; ++r) {
+            double value = values[r * numGenres + g];
+            if (!isfinite(value)) {
+                throw runtime_error("Cannot quantize a model with infinite log-probabilities");
+            }
+            lowest = min(lowest, value);
+            highest = max(highest, value);
+        }
+        double scale = (highest - lowest) / (2.0 * limit);
+        scales[g].scale = scale > 0.0 ? scale : 1.0;
+        scales[g].offset = (highest + lowest) / 2.0;
+        for (uint64_t r = 0; r < rows; ++r) {
+            double level = nearbyint((values[r * numGenres + g] - scales[g].offset) / scales[g].scale);
+            cells[r * numGenres + g] = static_cast<Cell>(clamp(level, -double(limit), double(limit)));
+        }
+    }
+}
+
+// Sum the quantized rows as integers and scale the sums once. With counts, row i is taken
+// counts[i] times (exactly, as an integer product).
+template <typename Cell>
+void addQuantized(const Cell* cells, uint64_t stride, uint64_t unknownRow, const CellScale* scales,
+                  const uint32_t* termIds, const uint64_t* counts, size_t count, size_t numGenres, double* scores) {
+    constexpr size_t stackGenres = 32;
+    int64_t stackSums[stackGenres] = {};
+    vector<int64_t> heapSums(numGenres > stackGenres ? numGenres : 0);
+    int64_t* sums = numGenres > stackGenres ? heapSums.data() : stackSums;
+
+    uint64_t tokens = 0;
+    for (size_t i = 0; i < count; ++i) {
+        uint64_t rowIndex = termIds[i] == CompiledModel::unknownTerm ? unknownRow : termIds[i];
+        const Cell* row = cells + rowIndex * stride;
+        int64_t weight = counts ? static_cast<int64_t>(counts[i]) : 1;
+        for (size_t g = 0; g < numGenres; ++g) {
+            sums[g] += weight * row[g];
+        }
+        tokens += static_cast<uint64_t>(weight);
+    }
+    for (size_t g = 0; g < numGenres; ++g) {
+        scores[g] += static_cast<double>(tokens) * scales[g].offset + scales[g].scale * static_cast<double>(sums[g]);
+    }
+}
+
+} // namespace
+
+CompiledModel::CompiledModel(const unordered_map<string, GenreModel>& genreModels, CellType cellType) {
+    // Hashed genres have one row per bucket and no terms to intern
+    uint32_t hashBits = hashBitsOf(genreModels);
+
+    // Intern the union of all vocabularies (views point into the genre maps' keys)
+    TokenMap<uint32_t> termIds;
+    vector<string_view> termList;
+    bool keepCounts = !genreModels.empty();
+    for (const auto& genreEntry : genreModels) {
+        forEachWord(genreEntry.second, [&](const string& word, double) {
+            if (termIds.emplace(word, static_cast<uint32_t>(termList.size())).second) {
+                termList.push_back(word);
+            }
+        });
+        keepCounts = keepCounts && genreEntry.second.hasCounts();
+    }
+    bool quantized = cellType != CellType::Double;
+    keepCounts = keepCounts && !quantized;
+
+    uint32_t numGenres = static_cast<uint32_t>(genreModels.size());
+    uint32_t numTerms = hashBits != 0 ? uint32_t(1) << hashBits : static_cast<uint32_t>(termList.size());
+    uint32_t bucketCount = 0;
+    if (hashBits == 0) {
+        bucketCount = 16;
+        while (bucketCount < 2ull * numTerms) {
+            bucketCount <<= 1;
+        }
+    }
+
+    uint64_t stringPoolSize = 0;
+    for (const auto& genreEntry : genreModels) stringPoolSize += genreEntry.first.size();
+    for (string_view term : termList) stringPoolSize += term.size();
+
+    FileHeader fileHeader{};
+    memcpy(fileHeader.magic, ModelFormat::magic, sizeof(fileHeader.magic));
+    fileHeader.version = ModelFormat::version;
+    fileHeader.byteOrderMark = byteOrderMark;
+    fileHeader.genreCount = numGenres;
+    fileHeader.termCount = numTerms;
+    fileHeader.hashBucketCount = bucketCount;
+    fileHeader.rowStride = numGenres;
+    fileHeader.genreTableOffset = alignSection(sizeof(FileHeader));
+    fileHeader.logPriorOffset = alignSection(fileHeader.genreTableOffset + numGenres * sizeof(GenreEntry));
+    fileHeader.stringPoolOffset = alignSection(fileHeader.logPriorOffset + numGenres * sizeof(double));
+    fileHeader.stringPoolSize = stringPoolSize;
+    fileHeader.termTableOffset = alignSection(fileHeader.stringPoolOffset + stringPoolSize);
+    fileHeader.hashIndexOffset = alignSection(fileHeader.termTableOffset + termList.size() * sizeof(TermEntry));
+    fileHeader.logProbOffset = alignSection(fileHeader.hashIndexOffset + uint64_t(bucketCount) * sizeof(HashSlot));
+    if (quantized) {
+        fileHeader.scaleOffset = fileHeader.logProbOffset;
+        fileHeader.logProbOffset = alignSection(fileHeader.scaleOffset + numGenres * sizeof(CellScale));
+    }
+    fileHeader.fileSize = fileHeader.logProbOffset + (uint64_t(numTerms) + 1) * numGenres * cellSize(cellType);
+    if (keepCounts) {
+        fileHeader.countOffset = alignSection(fileHeader.fileSize);
+        fileHeader.fileSize = fileHeader.countOffset + (uint64_t(numTerms) + 1) * numGenres * sizeof(int64_t);
+    }
+    fileHeader.hashBits = hashBits;
+    fileHeader.cellType = cellType;
+
+    size_t size = fileHeader.fileSize;
+    shared_ptr<unsigned char> owned = allocateImage(size);
+    unsigned char* buffer = owned.get();
+    memcpy(buffer, &fileHeader, sizeof(fileHeader));
+
+    auto* genreTable = reinterpret_cast<GenreEntry*>(buffer + fileHeader.genreTableOffset);
+    auto* priorTable = reinterpret_cast<double*>(buffer + fileHeader.logPriorOffset);
+    char* pool = reinterpret_cast<char*>(buffer + fileHeader.stringPoolOffset);
+    auto* termTable = reinterpret_cast<TermEntry*>(buffer + fileHeader.termTableOffset);
+    auto* slots = reinterpret_cast<HashSlot*>(buffer + fileHeader.hashIndexOffset);
+    // Quantized cells are encoded from a full-precision matrix once it is complete
+    vector<double> fullPrecision(quantized ? (uint64_t(numTerms) + 1) * numGenres : 0);
+    double* matrix = quantized ? fullPrecision.data() : reinterpret_cast<double*>(buffer + fileHeader.logProbOffset);
+
+    uint32_t poolOffset = 0;
+    auto appendString = [&](string_view text) {
+        memcpy(pool + poolOffset, text.data(), text.size());
+        uint32_t start = poolOffset;
+        poolOffset += static_cast<uint32_t>(text.size());
+        return start;
+    };
+
+    // Genre table, priors and the smoothing row (the classifier's 1 / (totalWords + 1))
+    double* unseenRow = matrix + uint64_t(numTerms) * numGenres;
+    size_t genreIndex = 0;
+    for (const auto& genreEntry : genreModels) {
+        const GenreModel& genreModel = genreEntry.second;
+        genreTable[genreIndex].nameOffset = appendString(genreEntry.first);
+        genreTable[genreIndex].nameLength = static_cast<uint32_t>(genreEntry.first.size());
+        genreTable[genreIndex].totalWords = genreModel.totalWordsInGenre;
+        genreTable[genreIndex].priorProbability = genreModel.priorProbability;
+        priorTable[genreIndex] = log(genreModel.priorProbability);
+        unseenRow[genreIndex] = log(1.0 / (genreModel.totalWordsInGenre + 1));
+        ++genreIndex;
+    }
+
+    // Term strings and hash index (both empty for a hashed model)
+    for (uint32_t slot = 0; slot < bucketCount; ++slot) {
+        slots[slot].termId = emptySlot;
+    }
+    for (uint32_t term = 0; term < termList.size(); ++term) {
+        termTable[term].stringOffset = appendString(termList[term]);
+        termTable[term].length = static_cast<uint32_t>(termList[term].size());
+
+        uint64_t hash = hashTerm(termList[term]);
+        size_t slot = hash & (bucketCount - 1);
+        while (slots[slot].termId != emptySlot) {
+            slot = (slot + 1) & (bucketCount - 1);
+        }
+        slots[slot].termId = term;
+        slots[slot].hashTag = static_cast<uint32_t>(hash >> 32);
+    }
+
+    // Every cell starts as that genre's smoothing value and is overwritten where the genre knows the word
+    for (uint32_t term = 0; term < numTerms; ++term) {
+        memcpy(matrix + uint64_t(term) * numGenres, unseenRow, numGenres * sizeof(double));
+    }
+    genreIndex = 0;
+    for (const auto& genreEntry : genreModels) {
+        const GenreModel& genreModel = genreEntry.second;
+        for (uint32_t bucket = 0; bucket < genreModel.bucketCounts.size(); ++bucket) {
+            if (genreModel.bucketCounts[bucket] > 0) {
+                double probability = static_cast<double>(genreModel.bucketCounts[bucket]) / genreModel.totalWordsInGenre;
+                matrix[uint64_t(bucket) * numGenres + genreIndex] = log(probability);
+            }
+        }
+        forEachWord(genreModel, [&](const string& word, double probability) {
+            uint32_t term = termIds.find(word)->second;
+            matrix[uint64_t(term) * numGenres + genreIndex] = log(probability);
+        });
+        ++genreIndex;
+    }
+
+    if (quantized) {
+        auto* scales = reinterpret_cast<CellScale*>(buffer + fileHeader.scaleOffset);
+        unsigned char* cells = buffer + fileHeader.logProbOffset;
+        uint64_t rows = uint64_t(numTerms) + 1;
+        if (cellType == CellType::Int16) {
+            quantizeMatrix(matrix, rows, numGenres, cellLimit(cellType), scales, reinterpret_cast<int16_t*>(cells));
+        } else {
+            quantizeMatrix(matrix, rows, numGenres, cellLimit(cellType), scales, reinterpret_cast<int8_t*>(cells));
+        }
+    }
+
+    // Raw counts, so the model can still be updated or merged after a save and load
+    if (keepCounts) {
+        auto* documentTable = reinterpret_cast<int64_t*>(buffer + fileHeader.countOffset);
+        int64_t* countMatrix = documentTable + numGenres;
+        genreIndex = 0;
+        for (const auto& genreEntry : genreModels) {
+            documentTable[genreIndex] = genreEntry.second.documentCount;
+            const vector<int64_t>& bucketCounts = genreEntry.second.bucketCounts;
+            for (uint32_t bucket = 0; bucket < bucketCounts.size(); ++bucket) {
+                countMatrix[uint64_t(bucket) * numGenres + genreIndex] = bucketCounts[bucket];
+            }
+            for (const auto& wordEntry : genreEntry.second.wordCounts) {
+                if (wordEntry.second > 0) {
+                    uint32_t term = termIds.find(wordEntry.first)->second;
+                    countMatrix[uint64_t(term) * numGenres + genreIndex] = wordEntry.second;
+                }
+            }
+            ++genreIndex;
+        }
+    }
+
+    attach(std::move(owned), size, false);
+}
+
+CompiledModel CompiledModel::mapFile(const string& filename) {
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw runtime_error("Unable to open model file: " + filename);
+    }
+
+    struct stat fileStat;
+    if (fstat(fd, &fileStat) != 0 || fileStat.st_size < static_cast<off_t>(sizeof(FileHeader))) {
+        close(fd);
+        throw runtime_error("Model file is too small: " + filename);
+    }
+
+    size_t size = static_cast<size_t>(fileStat.st_size);
+    void* mapping = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);  // The mapping keeps the file alive
+    if (mapping == MAP_FAILED) {
+        throw runtime_error("Unable to mmap model file: " + filename);
+    }
+
+    shared_ptr<const unsigned char> region(static_cast<const unsigned char*>(mapping), [size](const unsigned char* p) {
+        munmap(const_cast<unsigned char*>(p), size);
+    });
+
+    CompiledModel model;
+    model.attach(std::move(region), size, true);
+    return model;
+}
+
+CompiledModel CompiledModel::copyInMemory() const {
+    size_t size = imageSize();
+    shared_ptr<unsigned char> owned = allocateImage(size);
+    memcpy(owned.get(), image.get(), size);
+
+    CompiledModel copy;
+    copy.attach(std::move(owned), size, false);
+    return copy;
+}
+
+bool CompiledModel::isCompiledModelFile(const string& filename) {
+    ifstream file(filename, ios::binary);
+    char fileMagic[sizeof(ModelFormat::magic)];
+    return file.read(fileMagic, sizeof(fileMagic)) && hasMagic(fileMagic, sizeof(fileMagic));
+}
+
+void CompiledModel::attach(shared_ptr<const unsigned char> data, size_t size, bool isMapping) {
+    const auto* fileHeader = reinterpret_cast<const FileHeader*>(data.get());
+    if (size < sizeof(FileHeader) || !hasMagic(fileHeader->magic, sizeof(fileHeader->magic))) {
+        throw runtime_error("Not a compiled model (bad magic)");
+    }
+    if (fileHeader->version < ModelFormat::oldestReadableVersion || fileHeader->version > ModelFormat::version) {
+        throw runtime_error("Unsupported model version " + to_string(fileHeader->version));
+    }
+    if (fileHeader->byteOrderMark != byteOrderMark) {
+        throw runtime_error("Model was written with a different byte order");
+    }
+
+    uint64_t numGenres = fileHeader->genreCount;
+    uint64_t numTerms = fileHeader->termCount;
+    uint64_t buckets = fileHeader->hashBucketCount;
+    uint32_t hashBits = fileHeader->hashBits;
+    // A hashed model has a row per bucket and no vocabulary; otherwise the index is at most half full
+    bool indexOk = hashBits != 0
+        ? hashBits >= minHashBits && hashBits <= maxHashBits && numTerms == (uint64_t(1) << hashBits) && buckets == 0
+        : buckets > numTerms && (buckets & (buckets - 1)) == 0;
+    // count elements of elemSize bytes from offset lie in the file; written so that crafted
+    // header values cannot overflow
+    auto fits = [size](uint64_t offset, uint64_t count, uint64_t elemSize) {
+        return offset <= size && (elemSize == 0 || count <= (size - offset) / elemSize);
+    };
+    CellType cells = fileHeader->cellType;
+    bool cellsOk = cells == CellType::Double
+        ? fileHeader->scaleOffset == 0
+        : (cells == CellType::Int16 || cells == CellType::Int8) && fileHeader->scaleOffset != 0
+          && fits(fileHeader->scaleOffset, numGenres, sizeof(CellScale));
+    uint64_t termEntries = hashBits != 0 ? 0 : numTerms;
+    bool layoutOk = fileHeader->fileSize == size && indexOk && cellsOk
+        && fileHeader->rowStride >= numGenres
+        && fits(fileHeader->genreTableOffset, numGenres, sizeof(GenreEntry))
+        && fits(fileHeader->logPriorOffset, numGenres, sizeof(double))
+        && fits(fileHeader->stringPoolOffset, fileHeader->stringPoolSize, 1)
+        && fits(fileHeader->termTableOffset, termEntries, sizeof(TermEntry))
+        && fits(fileHeader->hashIndexOffset, buckets, sizeof(HashSlot))
+        && fits(fileHeader->logProbOffset, numTerms + 1, uint64_t(fileHeader->rowStride) * cellSize(cells))
+        && (fileHeader->countOffset == 0 || fits(fileHeader->countOffset, numTerms + 1, numGenres * sizeof(int64_t)));
+    if (!layoutOk) {
+        throw runtime_error("Corrupt model: section table does not match the file size");
+    }
+
+    const unsigned char* base = data.get();
+    header = fileHeader;
+    genres = reinterpret_cast<const GenreEntry*>(base + fileHeader->genreTableOffset);
+    logPriorProbabilities = reinterpret_cast<const double*>(base + fileHeader->logPriorOffset);
+    stringPool = reinterpret_cast<const char*>(base + fileHeader->stringPoolOffset);
+    terms = reinterpret_cast<const TermEntry*>(base + fileHeader->termTableOffset);
+    hashIndex = reinterpret_cast<const HashSlot*>(base + fileHeader->hashIndexOffset);
+    matrix = base + fileHeader->logProbOffset;
+    if (fileHeader->scaleOffset != 0) {
+        cellScales = reinterpret_cast<const CellScale*>(base + fileHeader->scaleOffset);
+    }
+    if (fileHeader->countOffset != 0) {
+        documentCounts = reinterpret_cast<const int64_t*>(base + fileHeader->countOffset);
+        wordCounts = documentCounts + numGenres;
+    }
+
+    for (uint64_t g = 0; g < numGenres; ++g) {
+        if (uint64_t(genres[g].nameOffset) + genres[g].nameLength > fileHeader->stringPoolSize) {
+            throw runtime_error("Corrupt model: genre name outside the string pool");
+        }
+    }
+
+    // lookup() trusts the vocabulary: every term inside the pool, every slot naming a term,
+    // and an empty slot for probing to stop at
+    for (uint64_t t = 0; t < termEntries; ++t) {
+        if (uint64_t(terms[t].stringOffset) + terms[t].length > fileHeader->stringPoolSize) {
+            throw runtime_error("Corrupt model: term outside the string pool");
+        }
+    }
+    bool emptySlotFound = false;
+    for (uint64_t slot = 0; slot < buckets; ++slot) {
+        uint32_t termId = hashIndex[slot].termId;
+        if (termId == emptySlot) {
+            emptySlotFound = true;
+        } else if (termId >= numTerms) {
+            throw runtime_error("Corrupt model: hash index names a term that does not exist");
+        }
+    }
+    if (buckets != 0 && !emptySlotFound) {
+        throw runtime_error("Corrupt model: hash index has no empty slot");
+    }
+
+    image = std::move(data);
+    mapped = isMapping;
+}
+
+uint32_t CompiledModel::lookup(string_view word) const {
+    if (header->hashBits != 0) {
+        return hashBucket(word, header->hashBits);
+    }
+
+    uint64_t hash = hashTerm(word);
+    uint32_t tag = static_cast<uint32_t>(hash >> 32);
+    size_t mask = header->hashBucketCount - 1;
+
+    // attach() made sure the index has an empty slot, so probing always ends
+    for (size_t slot = hash & mask;; slot = (slot + 1) & mask) {
+        const HashSlot& entry = hashIndex[slot];
+        if (entry.termId == emptySlot) {
+            return unknownTerm;
+        }
+        if (entry.hashTag == tag && termString(entry.termId) == word) {
+            return entry.termId;
+        }
+    }
+}
+
+void CompiledModel::save(const string& filename) const {
+    string temporary = filename + ".tmp";
+    {
+        ofstream outFile(temporary, ios::binary | ios::trunc);
+        if (!outFile.is_open()) {
+            throw runtime_error("Could not open file " + temporary + " for writing.");
+        }
+        outFile.write(reinterpret_cast<const char*>(image.get()), static_cast<streamsize>(imageSize()));
+        outFile.close();
+        if (!outFile) {
+            remove(temporary.c_str());
+            throw runtime_error("Failed writing model to " + temporary);
+        }
+    }
+    // rename() swaps the directory entry; an existing mapping keeps the old file's pages
+    if (rename(temporary.c_str(), filename.c_str()) != 0) {
+        remove(temporary.c_str());
+        throw runtime_error("Could not replace " + filename + ": " + strerror(errno));
+    }
+}
+
+uint64_t CompiledModel::fingerprint() const {
+    return image ? ContentHash::hash64(image.get(), imageSize()) : 0;
+}
+
+double CompiledModel::cellValue(uint64_t rowIndex, size_t genreIndex) const {
+    uint64_t cell = rowIndex * header->rowStride + genreIndex;
+    switch (header->cellType) {
+        case CellType::Int16:
+            return cellScales[genreIndex].offset + cellScales[genreIndex].scale * reinterpret_cast<const int16_t*>(matrix)[cell];
+        case CellType::Int8:
+            return cellScales[genreIndex].offset + cellScales[genreIndex].scale * reinterpret_cast<const int8_t*>(matrix)[cell];
+        default:
+            return reinterpret_cast<const double*>(matrix)[cell];
+    }
+}
+
+void CompiledModel::decodeRow(uint32_t termId, double* values) const {
+    uint64_t rowIndex = termId == unknownTerm ? header->termCount : termId;
+    for (size_t g = 0; g < genreCount(); ++g) {
+        values[g] = cellValue(rowIndex, g);
+    }
+}
+
+void CompiledModel::accumulate(const uint32_t* termIds, size_t count, double* scores) const {
+    size_t numGenres = genreCount();
+    uint64_t stride = header->rowStride;
+    uint64_t unknownRow = header->termCount;
+
+    switch (header->cellType) {
+        case CellType::Int16:
+            addQuantized(reinterpret_cast<const int16_t*>(matrix), stride, unknownRow, cellScales, termIds, nullptr,
+                         count, numGenres, scores);
+            return;
+        case CellType::Int8:
+            addQuantized(reinterpret_cast<const int8_t*>(matrix), stride, unknownRow, cellScales, termIds, nullptr,
+                         count, numGenres, scores);
+            return;
+        default:
+            break;
+    }
+
+    // Each row already holds the log of the word probability (or the genre's smoothing term) for every genre
+    ScoreKernel::addRows(numGenres)(reinterpret_cast<const double*>(matrix), stride, unknownRow, termIds, count,
+                                    numGenres, scores);
+}
+
+void CompiledModel::accumulate(const TermBag& bag, double* scores) const {
+    size_t numGenres = genreCount();
+    uint64_t stride = header->rowStride;
+    uint64_t unknownRow = header->termCount;
+    auto addWeightedRows = ScoreKernel::addWeightedRows(numGenres);
+
+    // One lookup per distinct word, a batch at a time, then a dot product of the counts with
+    // each genre's column
+    constexpr size_t batchSize = 256;
+    uint32_t termIds[batchSize];
+    for (size_t start = 0; start < bag.size(); start += batchSize) {
+        size_t count = min(batchSize, bag.size() - start);
+        for (size_t i = 0; i < count; ++i) {
+            termIds[i] = lookup(bag.word(start + i));
+        }
+        const uint64_t* counts = bag.wordCounts() + start;
+
+        switch (header->cellType) {
+            case CellType::Int16:
+                addQuantized(reinterpret_cast<const int16_t*>(matrix), stride, unknownRow, cellScales, termIds, counts,
+                             count, numGenres, scores);
+                break;
+            case CellType::Int8:
+                addQuantized(reinterpret_cast<const int8_t*>(matrix), stride, unknownRow, cellScales, termIds, counts,
+                             count, numGenres, scores);
+                break;
+            default:
+                addWeightedRows(reinterpret_cast<const double*>(matrix), stride, unknownRow, termIds, counts, count,
+                                numGenres, scores);
+                break;
+        }
+    }
+}
+
+vector<double> CompiledModel::contributionBounds() const {
+    size_t numGenres = genreCount();
+    vector<double> bounds(numGenres * (numGenres + 1), -HUGE_VAL);
+    double* maxMagnitude = bounds.data() + numGenres * numGenres;
+    fill(maxMagnitude, maxMagnitude + numGenres, 0.0);
+
+    // The unknown row is the last one, so <= termCount() covers it
+    vector<double> values(numGenres);
+    for (uint64_t rowIndex = 0; rowIndex <= termCount(); ++rowIndex) {
+        for (size_t g = 0; g < numGenres; ++g) {
+            values[g] = cellValue(rowIndex, g);
+        }
+        for (size_t g = 0; g < numGenres; ++g) {
+            maxMagnitude[g] = max(maxMagnitude[g], fabs(values[g]));
+            for (size_t l = 0; l < numGenres; ++l) {
+                bounds[g * numGenres + l] = max(bounds[g * numGenres + l], values[g] - values[l]);
+            }
+        }
+    }
+    return bounds;
+}
+
+unordered_map<string, GenreModel> CompiledModel::toGenreModels() const {
+    unordered_map<string, GenreModel> genreModels;
+    if (isHashed() && !hasCounts()) {
+        throw runtime_error("A compacted hashed model has neither counts nor words to expand");
+    }
+
+    for (size_t g = 0; g < genreCount(); ++g) {
+        string name(genreName(g));
+        GenreModel genreModel(name, priorProbability(g), totalWords(g));
+        if (hasCounts() && isHashed()) {
+            genreModel.documentCount = documentCounts[g];
+            genreModel.bucketCounts.resize(termCount());
+            for (uint32_t bucket = 0; bucket < termCount(); ++bucket) {
+                genreModel.bucketCounts[bucket] = wordCounts[uint64_t(bucket) * genreCount() + g];
+            }
+            genreModels[name] = std::move(genreModel);
+            continue;
+        }
+        if (hasCounts()) {
+            genreModel.documentCount = documentCounts[g];
+            for (uint32_t term = 0; term < termCount(); ++term) {
+                int64_t count = wordCounts[uint64_t(term) * genreCount() + g];
+                if (count > 0) {
+                    genreModel.wordCounts.emplace(termString(term), count);
+                }
+            }
+            genreModels[name] = std::move(genreModel);
+            continue;
+        }
+        double unseen = cellValue(termCount(), g);
+        for (uint32_t term = 0; term < termCount(); ++term) {
+            double logProbability = cellValue(term, g);
+            if (logProbability != unseen) {
+                genreModel.wordProbabilities.emplace(termString(term), exp(logProbability));
+            }
+        }
+        genreModels[name] = std::move(genreModel);
+    }
+    return genreModels;
+}
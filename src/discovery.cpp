@@ -0,0 +1,300 @@
+#include "discovery.hpp"
+#include "logger.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+using namespace std;
+
+namespace {
+
+// Matches "[...]" at the start of pattern against c. Returns false in `valid` when the
+// class is not closed, in which case the '[' is an ordinary character.
+bool matchClass(string_view pattern, char c, size_t& length, bool& valid) {
+    size_t i = 1;
+    bool negate = i < pattern.size() && (pattern[i] == '!' || pattern[i] == '^');
+    if (negate) ++i;
+
+    bool matched = false;
+    bool first = true;
+    for (; i < pattern.size() && (pattern[i] != ']' || first); ++i, first = false) {
+        if (i + 2 < pattern.size() && pattern[i + 1] == '-' && pattern[i + 2] != ']') {
+            matched = matched || (c >= pattern[i] && c <= pattern[i + 2]);
+            i += 2;
+        } else {
+            matched = matched || c == pattern[i];
+        }
+    }
+    valid = i < pattern.size();
+    length = i + 1;
+    return matched != negate;
+}
+
+bool matchFrom(string_view pattern, string_view text) {
+    while (!pattern.empty()) {
+        if (pattern.substr(0, 2) == "**") {
+            pattern.remove_prefix(2);
+            if (!pattern.empty() && pattern[0] == '/') {
+                // "**/" stands for zero or more whole directories
+                string_view rest = pattern.substr(1);
+                if (matchFrom(rest, text)) return true;
+                for (size_t i = 0; i < text.size(); ++i) {
+                    if (text[i] == '/' && matchFrom(rest, text.substr(i + 1))) return true;
+                }
+                return false;
+            }
+            for (size_t i = 0; i <= text.size(); ++i) {
+                if (matchFrom(pattern, text.substr(i))) return true;
+            }
+            return false;
+        }
+
+        char c = pattern[0];
+        if (c == '*') {
+            pattern.remove_prefix(1);
+            for (size_t i = 0;; ++i) {
+                if (matchFrom(pattern, text.substr(i))) return true;
+                if (i == text.size() || text[i] == '/') return false;
+            }
+        }
+
+        if (text.empty()) {
+            return false;
+        }
+        size_t consumed = 1;
+        if (c == '?') {
+            if (text[0] == '/') return false;
+        } else if (c == '[') {
+            bool valid;
+            bool matched = matchClass(pattern, text[0], consumed, valid);
+            if (!valid) {
+                consumed = 1;
+                if (text[0] != '[') return false;
+            } else if (!matched || text[0] == '/') {
+                return false;
+            }
+        } else if (c == '\\' && pattern.size() > 1) {
+            consumed = 2;
+            if (pattern[1] != text[0]) return false;
+        } else if (c != text[0]) {
+            return false;
+        }
+        pattern.remove_prefix(consumed);
+        text.remove_prefix(1);
+    }
+    return text.empty();
+}
+
+bool matchesAny(const vector<string>& patterns, string_view relative, string_view name) {
+    for (const string& pattern : patterns) {
+        bool byPath = pattern.find('/') != string::npos;
+        if (globMatch(pattern, byPath ? relative : name)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+string joinPath(const string& directory, string_view name) {
+    string path = directory;
+    if (!path.empty() && path.back() != '/') {
+        path += '/';
+    }
+    path += name;
+    return path;
+}
+
+} // namespace
+
+bool globMatch(string_view pattern, string_view text) {
+    return matchFrom(pattern, text);
+}
+
+FileDiscovery::FileDiscovery(DiscoveryOptions options, size_t maxPendingChunks)
+    : options(std::move(options)), maxPendingChunks(max<size_t>(1, maxPendingChunks)) {}
+
+FileDiscovery::~FileDiscovery() {
+    stop();
+    for (auto& walker : walkers) {
+        walker.join();
+    }
+}
+
+void FileDiscovery::start() {
+    // Files given directly are published right away; directories go to the walkers
+    vector<DiscoveredFile> chunk;
+    for (const string& root : options.roots) {
+        struct stat rootStat;
+        if (stat(root.c_str(), &rootStat) != 0) {
+            LOG_ERROR("Cannot access " << root << ": " << strerror(errno));
+            continue;
+        }
+        if (S_ISDIR(rootStat.st_mode)) {
+            directories.push_back({root, ""});
+        } else if (S_ISREG(rootStat.st_mode)) {
+            string_view name = root;
+            name = name.substr(name.find_last_of('/') + 1);
+            considerFile(root, name, name, static_cast<uint64_t>(rootStat.st_size), chunk);
+            if (chunk.size() >= chunkSize) {
+                publish(chunk);
+            }
+        }
+    }
+    if (!chunk.empty()) {
+        publish(chunk);
+    }
+
+    int numWalkers = options.threads > 0 ? options.threads : static_cast<int>(clamp(thread::hardware_concurrency(), 1u, 4u));
+    remainingWalkers = numWalkers;
+    for (int i = 0; i < numWalkers; ++i) {
+        walkers.emplace_back(&FileDiscovery::walkerLoop, this);
+    }
+}
+
+void FileDiscovery::walkerLoop() {
+    while (true) {
+        Directory directory;
+        {
+            unique_lock<mutex> lock(walkMutex);
+            walkWake.wait(lock, [this] { return !directories.empty() || activeWalkers == 0 || stopping.load(); });
+            // An empty queue with nobody listing means nothing new can show up
+            if (stopping.load() || directories.empty()) {
+                break;
+            }
+            directory = std::move(directories.front());
+            directories.pop_front();
+            ++activeWalkers;
+        }
+
+        scanDirectory(directory);
+
+        lock_guard<mutex> lock(walkMutex);
+        if (--activeWalkers == 0 && directories.empty()) {
+            walkWake.notify_all();
+        }
+    }
+    walkWake.notify_all();
+
+    // The last walker out closes the output
+    if (remainingWalkers.fetch_sub(1) == 1) {
+        lock_guard<mutex> lock(outputMutex);
+        finished = true;
+        chunkReady.notify_all();
+    }
+}
+
+void FileDiscovery::scanDirectory(const Directory& directory) {
+    DIR* handle = opendir(directory.path.c_str());
+    if (handle == nullptr) {
+        LOG_ERROR("Cannot open directory " << directory.path << ": " << strerror(errno));
+        return;
+    }
+    scanned.fetch_add(1, memory_order_relaxed);
+
+    int fd = dirfd(handle);
+    vector<DiscoveredFile> chunk;
+    vector<Directory> subdirectories;
+    string relative;
+
+    while (dirent* entry = readdir(handle)) {
+        if (stopping.load(memory_order_relaxed)) {
+            break;
+        }
+        string_view name = entry->d_name;
+        if (name == "." || name == "..") {
+            continue;
+        }
+        relative = directory.relative.empty() ? string(name) : directory.relative + "/" + string(name);
+
+        // d_type saves a stat for directories; files need one anyway for their size
+        struct stat entryStat;
+        bool isDirectory = entry->d_type == DT_DIR;
+        bool isFile = false;
+        bool needStat = entry->d_type == DT_REG || entry->d_type == DT_LNK;
+        if (entry->d_type == DT_UNKNOWN) {
+            if (fstatat(fd, entry->d_name, &entryStat, AT_SYMLINK_NOFOLLOW) != 0) continue;
+            isDirectory = S_ISDIR(entryStat.st_mode);
+            isFile = S_ISREG(entryStat.st_mode);
+            needStat = S_ISLNK(entryStat.st_mode);
+        }
+        if (needStat) {
+            // Symlinks are followed to files only
+            if (fstatat(fd, entry->d_name, &entryStat, 0) != 0 || !S_ISREG(entryStat.st_mode)) continue;
+            isFile = true;
+        }
+
+        if (isDirectory) {
+            if (!excluded(relative, name)) {
+                subdirectories.push_back({joinPath(directory.path, name), relative});
+            }
+        } else if (isFile) {
+            considerFile(joinPath(directory.path, name), relative, name, static_cast<uint64_t>(entryStat.st_size), chunk);
+            if (chunk.size() >= chunkSize) {
+                publish(chunk);
+            }
+        }
+    }
+    closedir(handle);
+
+    if (!chunk.empty()) {
+        publish(chunk);
+    }
+    if (!subdirectories.empty()) {
+        lock_guard<mutex> lock(walkMutex);
+        for (auto& subdirectory : subdirectories) {
+            directories.push_back(std::move(subdirectory));
+        }
+        walkWake.notify_all();
+    }
+}
+
+void FileDiscovery::considerFile(const string& path, string_view relative, string_view name, uint64_t bytes,
+                                 vector<DiscoveredFile>& chunk) {
+    if (excluded(relative, name) || !included(relative, name) || bytes < options.minBytes || bytes > options.maxBytes) {
+        filtered.fetch_add(1, memory_order_relaxed);
+        return;
+    }
+    chunk.push_back({path, bytes});
+    found.fetch_add(1, memory_order_relaxed);
+}
+
+bool FileDiscovery::excluded(string_view relative, string_view name) const {
+    return matchesAny(options.excludes, relative, name);
+}
+
+bool FileDiscovery::included(string_view relative, string_view name) const {
+    return options.includes.empty() || matchesAny(options.includes, relative, name);
+}
+
+void FileDiscovery::publish(vector<DiscoveredFile>& chunk) {
+    unique_lock<mutex> lock(outputMutex);
+    chunkTaken.wait(lock, [this] { return chunks.size() < maxPendingChunks || stopping.load(); });
+    chunks.push_back(std::move(chunk));
+    chunk.clear();
+    chunkReady.notify_one();
+}
+
+bool FileDiscovery::nextBatch(vector<DiscoveredFile>& batch) {
+    unique_lock<mutex> lock(outputMutex);
+    chunkReady.wait(lock, [this] { return !chunks.empty() || finished; });
+    if (chunks.empty()) {
+        return false;
+    }
+    batch = std::move(chunks.front());
+    chunks.pop_front();
+    chunkTaken.notify_one();
+    return true;
+}
+
+void FileDiscovery::stop() {
+    stopping.store(true);
+    {
+        lock_guard<mutex> lock(walkMutex);
+        walkWake.notify_all();
+    }
+    lock_guard<mutex> lock(outputMutex);
+    chunkTaken.notify_all();
+}
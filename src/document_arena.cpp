@@ -0,0 +1,37 @@
+#include "document_arena.hpp"
+
+using namespace std;
+
+void* DocumentArena::CountingResource::do_allocate(size_t bytes, size_t alignment) {
+    ++allocations;
+    bytesSinceReset += bytes;
+    return pmr::new_delete_resource()->allocate(bytes, alignment);
+}
+
+void DocumentArena::CountingResource::do_deallocate(void* p, size_t bytes, size_t alignment) {
+    pmr::new_delete_resource()->deallocate(p, bytes, alignment);
+}
+
+DocumentArena::DocumentArena(size_t initialBytes)
+    : buffer(make_unique<byte[]>(initialBytes)), bufferSize(initialBytes) {
+    arena.emplace(buffer.get(), bufferSize, &upstream);
+}
+
+void DocumentArena::reset() {
+    arena->release();
+    if (upstream.bytesSinceReset == 0) {
+        return;
+    }
+    // The last document spilled: size the buffer for it (with room for alignment padding)
+    size_t needed = bufferSize + upstream.bytesSinceReset;
+    upstream.bytesSinceReset = 0;
+    arena.reset();
+    bufferSize = needed + needed / 4;
+    buffer = make_unique<byte[]>(bufferSize);
+    arena.emplace(buffer.get(), bufferSize, &upstream);
+}
+
+DocumentArena& DocumentArena::forThread() {
+    thread_local DocumentArena threadArena;
+    return threadArena;
+}
@@ -1,8 +1,8 @@
 #include "genre_model.hpp"
 
 // Default constructor definition
-GenreModel::GenreModel() : priorProbability(0.0), totalWordsInGenre(0) {}
+GenreModel::GenreModel() : priorProbability(0.0), totalWordsInGenre(0), documentCount(0) {}
 
 // Constructor definition
-GenreModel::GenreModel(std::string genre, double priorProb, int totalWords)
-    : genre(genre), priorProbability(priorProb), totalWordsInGenre(totalWords) {}
+GenreModel::GenreModel(std::string genre, double priorProb, int64_t totalWords)
+    : genre(genre), priorProbability(priorProb), totalWordsInGenre(totalWords), documentCount(0) {}
@@ -0,0 +1,204 @@
+#include "logger.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+namespace {
+
+const size_t threadBufferLimit = 64 << 10;
+const chrono::milliseconds sweepInterval(100);
+
+struct ThreadBuffer;
+
+// Background writer; owns the registry of live thread buffers
+class LogSink {
+public:
+    LogSink() : worker(&LogSink::run, this) {}
+
+    ~LogSink() {
+        {
+            lock_guard<mutex> lock(queueMutex);
+            stopping = true;
+        }
+        wake.notify_one();
+        worker.join();
+    }
+
+    void registerBuffer(ThreadBuffer* buffer) {
+        lock_guard<mutex> lock(queueMutex);
+        buffers.push_back(buffer);
+    }
+
+    void unregisterBuffer(ThreadBuffer* buffer);
+
+    void submit(string&& out, string&& err) {
+        {
+            lock_guard<mutex> lock(queueMutex);
+            pending.emplace_back(std::move(out), std::move(err));
+        }
+        wake.notify_one();
+    }
+
+    // Sweep every buffer and write synchronously
+    void flushAll() {
+        writeBatch(collect());
+    }
+
+private:
+    vector<pair<string, string>> collect();
+
+    void writeBatch(const vector<pair<string, string>>& batch) {
+        lock_guard<mutex> lock(writeMutex);
+        for (const auto& entry : batch) {
+            if (!entry.first.empty()) fwrite(entry.first.data(), 1, entry.first.size(), stdout);
+            if (!entry.second.empty()) fwrite(entry.second.data(), 1, entry.second.size(), stderr);
+        }
+        fflush(stdout);
+        fflush(stderr);
+    }
+
+    void run() {
+        while (true) {
+            bool finished;
+            {
+                unique_lock<mutex> lock(queueMutex);
+                wake.wait_for(lock, sweepInterval, [this] { return stopping || !pending.empty(); });
+                finished = stopping;
+            }
+            writeBatch(collect());
+            if (finished) {
+                return;
+            }
+        }
+    }
+
+    mutex queueMutex;
+    condition_variable wake;
+    vector<pair<string, string>> pending;
+    vector<ThreadBuffer*> buffers;
+    bool stopping = false;
+
+    mutex writeMutex;
+    thread worker;
+};
+
+LogSink& sink() {
+    static LogSink instance;
+    return instance;
+}
+
+struct ThreadBuffer {
+    mutex bufferMutex;  // Only contended while the sink sweeps this buffer
+    string out;
+    string err;
+
+    ThreadBuffer() { sink().registerBuffer(this); }
+    ~ThreadBuffer() { sink().unregisterBuffer(this); }
+};
+
+void LogSink::unregisterBuffer(ThreadBuffer* buffer) {
+    string out, err;
+    {
+        lock_guard<mutex> bufferLock(buffer->bufferMutex);
+        out.swap(buffer->out);
+        err.swap(buffer->err);
+    }
+    {
+        lock_guard<mutex> lock(queueMutex);
+        buffers.erase(remove(buffers.begin(), buffers.end(), buffer), buffers.end());
+        if (!out.empty() || !err.empty()) {
+            pending.emplace_back(std::move(out), std::move(err));
+        }
+    }
+    wake.notify_one();
+}
+
+vector<pair<string, string>> LogSink::collect() {
+    vector<pair<string, string>> batch;
+    lock_guard<mutex> lock(queueMutex);
+    batch.swap(pending);
+    for (ThreadBuffer* buffer : buffers) {
+        lock_guard<mutex> bufferLock(buffer->bufferMutex);
+        if (!buffer->out.empty() || !buffer->err.empty()) {
+            batch.emplace_back(std::move(buffer->out), std::move(buffer->err));
+            buffer->out.clear();
+            buffer->err.clear();
+        }
+    }
+    return batch;
+}
+
+ThreadBuffer& threadBuffer() {
+    thread_local ThreadBuffer buffer;
+    return buffer;
+}
+
+atomic<int> runtimeLevel{POI_LOG_LEVEL};
+
+const char* prefix(LogLevel level) {
+    switch (level) {
+    case LogLevel::Debug: return "[DEBUG] ";
+    case LogLevel::Info: return "[INFO] ";
+    default: return "[ERROR] ";
+    }
+}
+
+} // namespace
+
+void Logger::setLevel(LogLevel level) {
+    runtimeLevel.store(max(static_cast<int>(level), POI_LOG_LEVEL), memory_order_relaxed);
+}
+
+LogLevel Logger::getLevel() {
+    return static_cast<LogLevel>(runtimeLevel.load(memory_order_relaxed));
+}
+
+bool Logger::enabled(LogLevel level) {
+    return static_cast<int>(level) >= runtimeLevel.load(memory_order_relaxed);
+}
+
+bool Logger::parseLevel(const string& name, LogLevel& level) {
+    if (name == "debug") level = LogLevel::Debug;
+    else if (name == "info") level = LogLevel::Info;
+    else if (name == "error") level = LogLevel::Error;
+    else if (name == "off") level = LogLevel::Off;
+    else return false;
+    return true;
+}
+
+void Logger::write(LogLevel level, const string& message) {
+    ThreadBuffer& buffer = threadBuffer();
+    string out, err;
+    {
+        lock_guard<mutex> lock(buffer.bufferMutex);
+        string& target = level == LogLevel::Error ? buffer.err : buffer.out;
+        target += prefix(level);
+        target += message;
+        target += '\n';
+
+        // Errors should show up promptly; everything else waits for a full buffer or the next sweep
+        if (level != LogLevel::Error && buffer.out.size() + buffer.err.size() < threadBufferLimit) {
+            return;
+        }
+        out.swap(buffer.out);
+        err.swap(buffer.err);
+    }
+    sink().submit(std::move(out), std::move(err));
+}
+
+void Logger::flush() {
+    sink().flushAll();
+}
+
+LogMessage::LogMessage(LogLevel level) : level(level) {}
+
+LogMessage::~LogMessage() {
+    Logger::write(level, out.str());
+}
@@ -1,105 +1,263 @@
-#include <iostream>
 #include <vector>
-#include <queue>
 #include <string>
-#include <thread>
-#include <filesystem>
 #include <future>
+#include <filesystem>
+#include <chrono>
+#include <memory>
+#include <atomic>
+#include <csignal>
 #include "train_model.hpp"
 #include "classifier.hpp"
+#include "compiled_model.hpp"
 #include "manager.hpp"
 #include "worker.hpp"
-#include "utils.hpp"
+#include "config.hpp"
+#include "task_scheduler.hpp"
+#include "report_writer.hpp"
+#include "options.hpp"
+#include "metrics.hpp"
+#include "discovery.hpp"
+#include "pipeline.hpp"
+#include "server.hpp"
+#include "result_cache.hpp"
+#include "thread_pool.hpp"
+#include "logger.hpp"
 
 using namespace std;
 namespace fs = filesystem;
 
-int NUM_WORKERS = 10;
-vector<queue<string>> workerQueues(NUM_WORKERS);
-vector<int> workerEfficiencies(NUM_WORKERS, 1); // Initialize worker efficiencies (default value 1)
-
-// Function to load or train the model
-unique_ptr<TrainModel> loadOrTrainModel(const string& modelFilename) {
+// Function to load or train the model (hashed into 2^hashBits buckets when hashBits is set)
+unique_ptr<TrainModel> loadOrTrainModel(const string& modelFilename, int hashBits) {
     auto trainModel = make_unique<TrainModel>();
 
     try {
         if (fs::exists(modelFilename)) {
             trainModel->loadModel(modelFilename);
-            cout << "[DEBUG] Model loaded from file: " << modelFilename << endl;
+            LOG_DEBUG("Model loaded from file: " << modelFilename);
         } else {
-            cout << "[DEBUG] Model not found. Training..." << endl;
+            LOG_DEBUG("Model not found. Training...");
+            if (hashBits != 0 && !trainModel->hashFeatures(hashBits)) {
+                return nullptr;
+            }
             trainModel->trainNaiveBayes();
             trainModel->saveModel(modelFilename);
-            cout << "[DEBUG] Model trained and saved." << endl;
+            LOG_DEBUG("Model trained and saved.");
         }
     } catch (const exception& e) {
-        cerr << "[ERROR] Model loading/training failed: " << e.what() << endl;
+        LOG_ERROR("Model loading/training failed: " << e.what());
         return nullptr;
     }
 
     return trainModel;
 }
 
-// Function to handle worker thread initialization
-void startWorkerThreads(int numWorkers, vector<thread>& workerThreads, vector<queue<string>>& workerQueues) {
+// Function to set up the classifier: a compiled (v2 to v5) model is mmap'd and scored in place,
+// anything else goes through TrainModel (legacy load or training) and is compiled in memory
+bool initializeClassifier(const string& modelFilename, int hashBits) {
+    if (hashBits != 0 && fs::exists(modelFilename)) {
+        LOG_INFO("--hash-bits only applies when training; using the existing " << modelFilename << ".");
+    }
+    if (CompiledModel::isCompiledModelFile(modelFilename)) {
+        try {
+            Classifier::initialize(CompiledModel::mapFile(modelFilename));
+            LOG_DEBUG("Model mapped from file: " << modelFilename);
+            return true;
+        } catch (const exception& e) {
+            LOG_ERROR("Model mapping failed: " << e.what());
+            return false;
+        }
+    }
+
+    auto trainModel = loadOrTrainModel(modelFilename, hashBits);
+    if (!trainModel) return false;
+
+    Classifier::initialize(*trainModel);
+    return true;
+}
+
+// Function to handle worker thread initialization: every worker loop gets a pool thread of its own
+void startWorkerThreads(int numWorkers, vector<future<void>>& workerJobs, TaskScheduler& scheduler, ReportWriter& reportWriter,
+                        RuntimeMetrics& metrics, ResultCache* resultCache) {
     for (int i = 0; i < numWorkers; ++i) {
-        // Start worker thread and pass queue by reference
-        workerThreads.emplace_back(workerFunction, i, ref(workerQueues[i]));
-        cout << "[DEBUG] Started worker thread " << i << endl;
+        // Start worker thread and pass the shared scheduler, report sink, metrics and cache by reference
+        workerJobs.push_back(ThreadPool::instance().start([i, &scheduler, &reportWriter, &metrics, resultCache] {
+            workerFunction(i, scheduler, reportWriter, metrics, resultCache);
+        }));
+        LOG_DEBUG("Started worker thread " << i);
+    }
+}
+
+// Server the signal handlers stop; set only while serve() runs
+atomic<ClassificationServer*> activeServer{nullptr};
+
+void stopServer(int) {
+    if (ClassificationServer* server = activeServer.load()) {
+        server->stop();
     }
 }
 
+// Daemon mode: load the model once, then answer requests until SIGINT/SIGTERM (or the end of stdin)
+int serve(const Options& options, const string& modelFilename) {
+    if (!initializeClassifier(modelFilename, options.hashBits)) return 1;
+    if (options.earlyExit) {
+        Classifier::getInstance().setEarlyExit(true);
+    }
+
+    RuntimeMetrics metrics(options.server.workers);
+    StatsDumper statsDumper(metrics, options.statsFilename, options.statsFormat,
+                            chrono::milliseconds(options.statsIntervalMs));
+
+    ClassificationServer server(options.server, metrics);
+    activeServer.store(&server);
+    struct sigaction action{};
+    action.sa_handler = stopServer;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, nullptr);
+    sigaction(SIGTERM, &action, nullptr);
+
+    bool served = server.run();
+    activeServer.store(nullptr);
+
+    statsDumper.stop();
+    Logger::flush();
+    return served ? 0 : 1;
+}
+
 int main(int argc, char* argv[]) {
-    if (argc > 1) {
-        try {
-            NUM_WORKERS = stoi(argv[1]);
-            cout << "[DEBUG] Using " << NUM_WORKERS << " threads." << endl;
-        } catch (...) {
-            cerr << "[ERROR] Invalid thread count argument. Using default: 10." << endl;
-        }
-    } else {
-        cout << "[DEBUG] No thread count provided. Using default: 10." << endl;
+    ThreadPool::ShutdownGuard poolShutdown;  // Pool threads exit before the statics they log through
+    Options options;
+    parseOptions(argc, argv, options);
+
+    // One pool for the whole process, sized from the CPUs the process may actually use
+    ThreadPool::configure(0, options.pinThreads);
+    if (options.numWorkers == 0) {
+        options.numWorkers = static_cast<int>(ThreadPool::instance().size());
+        options.server.workers = options.numWorkers;
+        LOG_DEBUG("Using " << options.numWorkers << " workers.");
     }
 
-    cout << "[DEBUG] Reading files from the directory..." << endl;
+    string modelFilename = "model.dat";
+    if (!options.server.socketPath.empty()) {
+        return serve(options, modelFilename);
+    }
 
-    // Read files asynchronously
-    auto filesFuture = async(launch::async, readFilesInDirectory);
-    auto files = filesFuture.get();
+    // In the pipeline mode the readers are the ones taking files from the scheduler
+    int numWorkers = options.pipeline.enabled ? options.pipeline.readers : options.numWorkers;
 
-    if (files.empty()) {
-        cerr << "[ERROR] No files found!" << endl;
-        return 1;
+    // Start walking the roots right away; the chunks it finds wait until the workers are up
+    FileDiscovery discovery(options.discovery);
+    discovery.start();
+    LOG_DEBUG("Discovering files under " << options.discovery.roots.size() << " root(s)...");
+
+    // Load or train the model and initialize the classifier singleton with it (only once)
+    if (!initializeClassifier(modelFilename, options.hashBits)) return 1;
+    LOG_DEBUG("Classifier initialized with trained model.");
+
+    if (options.earlyExit) {
+        if (options.pipeline.enabled) {
+            LOG_ERROR("Early exit needs the worker mode (the pipeline scores blocks out of order). Scoring everything.");
+        } else {
+            Classifier::getInstance().setEarlyExit(true);
+        }
+    }
+
+    // Results keyed by content, shared by the workers (and persisted with --cache)
+    unique_ptr<ResultCache> resultCache;
+    if (options.dedup) {
+        if (options.pipeline.enabled) {
+            LOG_ERROR("The result cache needs the worker mode (the pipeline never sees whole files). Classifying everything.");
+        } else {
+            const CompiledModel& model = Classifier::getInstance().getModel();
+            resultCache = make_unique<ResultCache>(
+                options.cacheFilename, ResultCache::fingerprint(model, Classifier::getInstance().earlyExitEnabled()));
+        }
     }
 
-    cout << "[DEBUG] Files successfully loaded. Total files: " << files.size() << endl;
+    // Single sink thread that batches every worker's results into the report file
+    vector<string> genreNames;
+    const CompiledModel& model = Classifier::getInstance().getModel();
+    for (size_t g = 0; g < model.genreCount(); ++g) {
+        genreNames.emplace_back(model.genreName(g));
+    }
+    unique_ptr<ReportWriter> reportWriter;
+    try {
+        reportWriter = make_unique<ReportWriter>(options.reportFilename, options.reportFormat, std::move(genreNames),
+                                                 chrono::milliseconds(options.reportFlushMs));
+    } catch (const exception& e) {
+        LOG_ERROR(e.what());
+        return 1;
+    }
 
-    // Load or train the model asynchronously
-    string modelFilename = "model.dat";
-    auto trainModel = loadOrTrainModel(modelFilename);
-    if (!trainModel) return 1;
+    // Per-worker task queues, sized now that the worker count is known
+    TaskScheduler scheduler(numWorkers, Config::workerQueueCapacity);
 
-    // Initialize the classifier using the singleton pattern
-    Classifier::initialize(*trainModel); // Only need to initialize once
-    Classifier& classifier = Classifier::getInstance(); // Access the initialized singleton
-    cout << "[DEBUG] Classifier initialized with trained model." << endl;
+    // Counters and stage latencies, dumped periodically and once more at the end
+    RuntimeMetrics metrics(options.pipeline.enabled ? options.pipeline.threadCount() : numWorkers);
+    reportWriter->setFlushHistogram(&metrics.reportFlush());
+    StatsDumper statsDumper(metrics, options.statsFilename, options.statsFormat,
+                            chrono::milliseconds(options.statsIntervalMs));
 
-    // Initialize Manager (pass workerEfficiencies as the second argument)
-    Manager manager(NUM_WORKERS, workerQueues, workerEfficiencies);
+    // Initialize Manager (its worker weights follow the measured throughput)
+    // Relative cost per queued byte of each worker: the mean measured throughput over its own
+    vector<double> workerEfficiencies(numWorkers, 1.0);
+    Manager manager(numWorkers, scheduler, workerEfficiencies, metrics);
 
-    // Start worker threads (but they will wait for tasks from the Manager)
-    vector<thread> workerThreads;
-    startWorkerThreads(NUM_WORKERS, workerThreads, workerQueues);
+    // Start worker threads, or the pipeline stages (both wait for tasks from the Manager)
+    vector<future<void>> workerJobs;
+    unique_ptr<Pipeline> pipeline;
+    if (options.pipeline.enabled) {
+        pipeline = make_unique<Pipeline>(options.pipeline, scheduler, *reportWriter, metrics);
+        pipeline->start();
+    } else {
+        startWorkerThreads(numWorkers, workerJobs, scheduler, *reportWriter, metrics, resultCache.get());
+    }
 
-    // Distribute tasks to workers using Manager
-    manager.distributeTasks(files);
+    // Distribute tasks to workers using Manager as discovery finds them
+    manager.distributeTasks(discovery);
 
     // Wait for all worker threads to finish (if they finish before main thread ends)
-    for (auto& thread : workerThreads) {
-        thread.join();
+    for (auto& job : workerJobs) {
+        job.get();
+    }
+    if (pipeline) {
+        pipeline->join();
+    }
+
+    LOG_DEBUG("All workers finished processing. Tasks stolen: " << scheduler.stolenTasks());
+    LOG_DEBUG("Discovery scanned " << discovery.directoriesScanned() << " directories, found "
+              << discovery.filesFound() << " files and filtered out " << discovery.filesFiltered());
+
+    if (Classifier::getInstance().earlyExitEnabled()) {
+        uint64_t skippedTokens = 0, skippedBytes = 0;
+        for (int i = 0; i < metrics.getNumWorkers(); ++i) {
+            skippedTokens += metrics.worker(i).skippedTokens.load();
+            skippedBytes += metrics.worker(i).skippedBytes.load();
+        }
+        LOG_INFO("Early exit skipped about " << skippedTokens << " tokens (" << skippedBytes << " bytes not read).");
     }
 
-    cout << "[DEBUG] All workers finished processing." << endl;
+    if (resultCache) {
+        ResultCache::Stats cacheStats = resultCache->stats();
+        LOG_INFO("Result cache: " << cacheStats.pathHits << " unchanged files, " << cacheStats.contentHits
+                 << " known contents, " << cacheStats.duplicateHits << " duplicates, " << cacheStats.misses << " misses.");
+        if (resultCache->save() && !options.cacheFilename.empty()) {
+            LOG_DEBUG("Result cache written to " << options.cacheFilename);
+        }
+    }
+
+    // Flush whatever the sink still holds
+    reportWriter->close();
+    LOG_DEBUG("Wrote " << reportWriter->recordsWritten() << " results to " << options.reportFilename);
+
+    statsDumper.stop();
+    LOG_DEBUG("Runtime stats written to " << options.statsFilename);
+
+    if (discovery.filesFound() == 0) {
+        LOG_ERROR("No files found!");
+        Logger::flush();
+        return 1;
+    }
 
+    Logger::flush();
     return 0;
 }
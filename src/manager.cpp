@@ -1,65 +1,96 @@
 #include "manager.hpp"
-#include <iostream>
-#include <omp.h>
-#include <queue>
+#include "logger.hpp"
+#include "config.hpp"
+#include <algorithm>
+#include <filesystem>
+#include <functional>
+#include <system_error>
 #include <vector>
-#include <limits>
 
 using namespace std;
+namespace fs = filesystem;
 
-Manager::Manager(int numWorkers, std::vector<std::queue<std::string>>& queues, std::vector<int>& efficiencies)
-    : numWorkers(numWorkers), workerQueues(queues), workerEfficiencies(efficiencies) {
-    // No need for atomic variables here, we will rely on the efficiency of dynamic scheduling.
+Manager::Manager(int numWorkers, TaskScheduler& scheduler, std::vector<double>& efficiencies,
+                 const RuntimeMetrics& metrics)
+    : numWorkers(numWorkers), scheduler(scheduler), workerEfficiencies(efficiencies), metrics(metrics) {
+    // Workers steal from each other, so the pick only has to be a good first guess.
+    metrics.updateEfficiencies(workerEfficiencies);
+    rebuildLoadHeap();
 }
 
-int Manager::getLeastLoadedWorker() {
-    int leastLoadedWorker = 0;
-    size_t minQueueSize = std::numeric_limits<size_t>::max();
-
-    // Check for the least loaded worker
+void Manager::rebuildLoadHeap() {
+    loadHeap.clear();
     for (int i = 0; i < numWorkers; ++i) {
-        // Calculate weighted load for the worker (could be based on queue size and efficiency)
-        size_t weightedLoad = workerQueues[i].size() * workerEfficiencies[i]; // Just example logic
-        if (weightedLoad < minQueueSize) {
-            minQueueSize = weightedLoad;
-            leastLoadedWorker = i;
-        }
+        loadHeap.emplace_back(scheduler.outstandingBytes(i) * workerEfficiencies[i], i);
     }
+    make_heap(loadHeap.begin(), loadHeap.end(), greater<>());
+}
 
-    return leastLoadedWorker;
+int Manager::assignWorker(uint64_t bytes) {
+    pop_heap(loadHeap.begin(), loadHeap.end(), greater<>());
+    auto& [load, workerId] = loadHeap.back();
+    load += bytes * workerEfficiencies[workerId];
+    int chosen = workerId;
+    push_heap(loadHeap.begin(), loadHeap.end(), greater<>());
+    return chosen;
 }
 
-void Manager::distributeTasks(const vector<string>& files) {
-    cout << "[DEBUG] Starting task distribution. Total files: " << files.size() << endl;
+void Manager::distributeTasks(vector<string> files) {
+    LOG_DEBUG("Starting task distribution. Total files: " << files.size());
 
-    // Distribute files to workers
-    #pragma omp parallel
-    {
-        #pragma omp for schedule(dynamic)
-        for (size_t i = 0; i < files.size(); ++i) {
-            int workerId = getLeastLoadedWorker();  // Select the least loaded worker dynamically
+    // The file size is the cost estimate; unreadable files cost nothing and fail in the worker
+    vector<FileTask> tasks;
+    tasks.reserve(files.size());
+    for (auto& file : files) {
+        error_code error;
+        uint64_t bytes = fs::file_size(file, error);
+        tasks.push_back(FileTask{std::move(file), error ? 0 : bytes});
+    }
+    submitLargestFirst(tasks);
+
+    // Nothing else is coming: workers drain what is left (stealing as needed) and exit
+    scheduler.shutdown();
+    LOG_DEBUG("Sent shutdown signal to all workers.");
+
+    LOG_DEBUG("Task distribution completed.");
+}
 
-            // Push the file into the selected queue
-            workerQueues[workerId].push(files[i]);
+void Manager::distributeTasks(FileDiscovery& discovery) {
+    LOG_DEBUG("Starting task distribution while discovery runs.");
 
-            // Log the assignment — ensure thread-safe output
-            #pragma omp critical
-            {
-                cout << "[DEBUG] Assigned file \"" << files[i] << "\" to worker " << workerId << endl;
-            }
+    // Discovery already knows the sizes, so no extra stat per file
+    vector<DiscoveredFile> batch;
+    vector<FileTask> tasks;
+    while (discovery.nextBatch(batch)) {
+        tasks.clear();
+        for (auto& file : batch) {
+            tasks.push_back(FileTask{std::move(file.path), file.bytes});
         }
+        submitLargestFirst(tasks);
     }
 
-    // After task distribution, add exit signals to each queue
-    for (size_t i = 0; i < workerQueues.size(); ++i) {
-        workerQueues[i].push("__EXIT__");  // Send exit signal to each worker
-        cout << "[DEBUG] Sent exit signal to worker " << i << endl;
-    }
+    scheduler.shutdown();
+    LOG_DEBUG("Sent shutdown signal to all workers.");
 
-    // After parallel region — log queue sizes
-    for (size_t i = 0; i < workerQueues.size(); ++i) {
-        cout << "[DEBUG] Queue " << i << " size after distribution: " << workerQueues[i].size() << endl;
-    }
+    LOG_DEBUG("Task distribution completed. Total files: " << assignedTasks);
+}
+
+void Manager::submitLargestFirst(vector<FileTask>& tasks) {
+    // Longest processing time first: the big files are spread out while every worker is
+    // still free, and the small ones fill the gaps at the end
+    stable_sort(tasks.begin(), tasks.end(), [](const FileTask& a, const FileTask& b) { return a.bytes > b.bytes; });
 
-    cout << "[DEBUG] Task distribution completed." << endl;
+    // Hand the tasks over one by one; submit() applies backpressure when all queues are full
+    for (auto& task : tasks) {
+        // Follow how fast each worker has actually been going and how much it has finished
+        if (assignedTasks > 0 && assignedTasks % Config::efficiencyRefreshInterval == 0) {
+            metrics.updateEfficiencies(workerEfficiencies);
+            rebuildLoadHeap();
+        }
+        ++assignedTasks;
+
+        int workerId = assignWorker(task.bytes);
+        LOG_DEBUG("Assigned file \"" << task.filePath << "\" (" << task.bytes << " bytes) to worker " << workerId);
+        scheduler.submit(workerId, std::move(task));
+    }
 }
@@ -0,0 +1,389 @@
+#include "metrics.hpp"
+#include "logger.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <sstream>
+
+using namespace std;
+
+namespace {
+
+const double reportedQuantiles[] = {0.5, 0.9, 0.99, 0.999};
+
+double toSeconds(uint64_t nanos) {
+    return static_cast<double>(nanos) * 1e-9;
+}
+
+// Single-writer increment: cheaper than fetch_add and still safe to read concurrently
+void bump(atomic<uint64_t>& counter, uint64_t amount) {
+    counter.store(counter.load(memory_order_relaxed) + amount, memory_order_relaxed);
+}
+
+void appendJsonHistogram(ostringstream& out, const HistogramSnapshot& snapshot) {
+    out << "{\"count\": " << snapshot.count
+        << ", \"meanSeconds\": " << (snapshot.count ? toSeconds(snapshot.sumNanos) / snapshot.count : 0.0)
+        << ", \"p50Seconds\": " << toSeconds(snapshot.percentile(0.5))
+        << ", \"p90Seconds\": " << toSeconds(snapshot.percentile(0.9))
+        << ", \"p99Seconds\": " << toSeconds(snapshot.percentile(0.99))
+        << ", \"p999Seconds\": " << toSeconds(snapshot.percentile(0.999))
+        << ", \"maxSeconds\": " << toSeconds(snapshot.maxNanos) << "}";
+}
+
+// Stages that have their own threads in the pipeline mode
+const Stage pipelineStageList[] = {Stage::Read, Stage::Tokenize, Stage::Score};
+
+void appendPrometheusSummary(ostringstream& out, const string& name, const string& labels,
+                             const HistogramSnapshot& snapshot) {
+    string separator = labels.empty() ? "" : ",";
+    for (double q : reportedQuantiles) {
+        out << name << "{" << labels << separator << "quantile=\"" << q << "\"} "
+            << toSeconds(snapshot.percentile(q)) << "\n";
+    }
+    string braces = labels.empty() ? "" : "{" + labels + "}";
+    out << name << "_sum" << braces << " " << toSeconds(snapshot.sumNanos) << "\n";
+    out << name << "_count" << braces << " " << snapshot.count << "\n";
+}
+
+} // namespace
+
+const char* stageName(Stage stage) {
+    switch (stage) {
+    case Stage::QueueWait: return "queue_wait";
+    case Stage::Read: return "read";
+    case Stage::Tokenize: return "tokenize";
+    case Stage::Score: return "score";
+    default: return "report";
+    }
+}
+
+void HistogramSnapshot::merge(const HistogramSnapshot& other) {
+    if (buckets.size() < other.buckets.size()) {
+        buckets.resize(other.buckets.size(), 0);
+    }
+    for (size_t i = 0; i < other.buckets.size(); ++i) {
+        buckets[i] += other.buckets[i];
+    }
+    count += other.count;
+    sumNanos += other.sumNanos;
+    maxNanos = max(maxNanos, other.maxNanos);
+}
+
+uint64_t HistogramSnapshot::percentile(double q) const {
+    if (count == 0) {
+        return 0;
+    }
+    // Rank of the sample we want, 1-based
+    uint64_t rank = max<uint64_t>(1, static_cast<uint64_t>(q * count + 0.5));
+    uint64_t seen = 0;
+    for (size_t i = 0; i < buckets.size(); ++i) {
+        seen += buckets[i];
+        if (seen >= rank) {
+            return min(LatencyHistogram::bucketUpperBound(i), maxNanos);
+        }
+    }
+    return maxNanos;
+}
+
+size_t LatencyHistogram::bucketIndex(uint64_t nanos) {
+    const uint64_t subBuckets = 1u << subBucketBits;
+    nanos = min<uint64_t>(nanos, (uint64_t(1) << (maxExponent + 1)) - 1);
+    if (nanos < subBuckets) {
+        return static_cast<size_t>(nanos);
+    }
+    int exponent = 63 - __builtin_clzll(nanos);
+    uint64_t subBucket = (nanos >> (exponent - subBucketBits)) & (subBuckets - 1);
+    return static_cast<size_t>((exponent - subBucketBits + 1) * subBuckets + subBucket);
+}
+
+uint64_t LatencyHistogram::bucketUpperBound(size_t index) {
+    const size_t subBuckets = size_t(1) << subBucketBits;
+    if (index < subBuckets) {
+        return index;
+    }
+    int exponent = static_cast<int>(index / subBuckets) + subBucketBits - 1;
+    uint64_t subBucket = index % subBuckets;
+    uint64_t width = uint64_t(1) << (exponent - subBucketBits);
+    return ((subBuckets + subBucket) << (exponent - subBucketBits)) + width - 1;
+}
+
+void LatencyHistogram::record(uint64_t nanos) {
+    bump(buckets[bucketIndex(nanos)], 1);
+    bump(sumNanos, nanos);
+    if (nanos > maxNanos.load(memory_order_relaxed)) {
+        maxNanos.store(nanos, memory_order_relaxed);
+    }
+}
+
+void LatencyHistogram::record(chrono::steady_clock::duration elapsed) {
+    record(static_cast<uint64_t>(max<int64_t>(0, chrono::duration_cast<chrono::nanoseconds>(elapsed).count())));
+}
+
+HistogramSnapshot LatencyHistogram::snapshot() const {
+    HistogramSnapshot snapshot;
+    snapshot.buckets.resize(bucketCount);
+    for (size_t i = 0; i < bucketCount; ++i) {
+        snapshot.buckets[i] = buckets[i].load(memory_order_relaxed);
+        snapshot.count += snapshot.buckets[i];
+    }
+    snapshot.sumNanos = sumNanos.load(memory_order_relaxed);
+    snapshot.maxNanos = maxNanos.load(memory_order_relaxed);
+    return snapshot;
+}
+
+RuntimeMetrics::RuntimeMetrics(int numWorkers) : started(chrono::steady_clock::now()) {
+    for (int i = 0; i < numWorkers; ++i) {
+        workers.push_back(make_unique<WorkerMetrics>());
+    }
+}
+
+double RuntimeMetrics::throughput(int workerId) const {
+    const WorkerMetrics& stats = worker(workerId);
+    uint64_t busy = stats.busyNanos.load(memory_order_relaxed);
+    return busy > 0 ? stats.bytes.load(memory_order_relaxed) / toSeconds(busy) : 0.0;
+}
+
+void RuntimeMetrics::updateEfficiencies(vector<double>& efficiencies) const {
+    int numWorkers = getNumWorkers();
+    vector<double> rates(numWorkers);
+    double total = 0.0;
+    int measured = 0;
+    for (int i = 0; i < numWorkers; ++i) {
+        rates[i] = throughput(i);
+        if (rates[i] > 0.0) {
+            total += rates[i];
+            ++measured;
+        }
+    }
+
+    efficiencies.assign(numWorkers, 1.0);
+    if (measured == 0) {
+        return;
+    }
+    double mean = total / measured;
+    for (int i = 0; i < numWorkers; ++i) {
+        if (rates[i] > 0.0) {
+            efficiencies[i] = clamp(mean / rates[i], 0.25, 4.0);
+        }
+    }
+}
+
+double RuntimeMetrics::utilization(Stage s) const {
+    const StageOccupancy& stage = occupancy(s);
+    double capacity = stage.threads.load(memory_order_relaxed) *
+                      chrono::duration<double>(chrono::steady_clock::now() - started).count();
+    return capacity > 0.0 ? min(1.0, toSeconds(stage.busyNanos.load(memory_order_relaxed)) / capacity) : 0.0;
+}
+
+string RuntimeMetrics::format(StatsFormat statsFormat) const {
+    return statsFormat == StatsFormat::Json ? formatJson() : formatPrometheus();
+}
+
+string RuntimeMetrics::formatPrometheus() const {
+    ostringstream out;
+    int numWorkers = getNumWorkers();
+
+    struct Counter { const char* name; const char* help; atomic<uint64_t> WorkerMetrics::*field; };
+    const Counter counters[] = {
+        {"poi_worker_files_total", "Documents classified by the worker.", &WorkerMetrics::files},
+        {"poi_worker_bytes_total", "Bytes of the documents classified by the worker.", &WorkerMetrics::bytes},
+        {"poi_worker_tokens_total", "Tokens scored by the worker.", &WorkerMetrics::tokens},
+        {"poi_worker_errors_total", "Documents the worker failed to classify.", &WorkerMetrics::errors},
+        {"poi_worker_skipped_tokens_total", "Tokens early exit left unscored (unread ones estimated).", &WorkerMetrics::skippedTokens},
+        {"poi_worker_skipped_bytes_total", "Bytes early exit did not read.", &WorkerMetrics::skippedBytes},
+        {"poi_worker_timeouts_total", "Daemon requests answered with a timeout.", &WorkerMetrics::timeouts},
+        {"poi_worker_cache_hits_total", "Documents answered from the result cache.", &WorkerMetrics::cacheHits},
+        {"poi_worker_cache_misses_total", "Documents classified into the result cache.", &WorkerMetrics::cacheMisses},
+    };
+    for (const Counter& counter : counters) {
+        out << "# HELP " << counter.name << " " << counter.help << "\n"
+            << "# TYPE " << counter.name << " counter\n";
+        for (int i = 0; i < numWorkers; ++i) {
+            out << counter.name << "{worker=\"" << i << "\"} " << (worker(i).*counter.field).load(memory_order_relaxed) << "\n";
+        }
+    }
+
+    out << "# HELP poi_worker_busy_seconds_total Time the worker spent on documents.\n"
+        << "# TYPE poi_worker_busy_seconds_total counter\n";
+    for (int i = 0; i < numWorkers; ++i) {
+        out << "poi_worker_busy_seconds_total{worker=\"" << i << "\"} " << toSeconds(worker(i).busyNanos.load(memory_order_relaxed)) << "\n";
+    }
+
+    out << "# HELP poi_worker_throughput_bytes_per_second Bytes classified per busy second.\n"
+        << "# TYPE poi_worker_throughput_bytes_per_second gauge\n";
+    for (int i = 0; i < numWorkers; ++i) {
+        out << "poi_worker_throughput_bytes_per_second{worker=\"" << i << "\"} " << throughput(i) << "\n";
+    }
+
+    out << "# HELP poi_stage_latency_seconds Per-document time spent in each pipeline stage.\n"
+        << "# TYPE poi_stage_latency_seconds summary\n";
+    for (size_t s = 0; s < stageCount; ++s) {
+        for (int i = 0; i < numWorkers; ++i) {
+            string labels = "worker=\"" + to_string(i) + "\",stage=\"" + stageName(static_cast<Stage>(s)) + "\"";
+            appendPrometheusSummary(out, "poi_stage_latency_seconds", labels, worker(i).stages[s].snapshot());
+        }
+    }
+
+    if (occupancy(Stage::Read).threads.load(memory_order_relaxed) > 0) {
+        struct Gauge { const char* name; const char* type; const char* help; atomic<uint64_t> StageOccupancy::*field; bool nanos; };
+        const Gauge gauges[] = {
+            {"poi_pipeline_threads", "gauge", "Threads of the pipeline stage.", &StageOccupancy::threads, false},
+            {"poi_pipeline_items_total", "counter", "Items the pipeline stage handled.", &StageOccupancy::items, false},
+            {"poi_pipeline_busy_seconds_total", "counter", "Time the stage threads spent working.", &StageOccupancy::busyNanos, true},
+            {"poi_pipeline_starved_seconds_total", "counter", "Time the stage threads waited for input.", &StageOccupancy::starvedNanos, true},
+            {"poi_pipeline_blocked_seconds_total", "counter", "Time the stage threads waited for buffers or downstream room.", &StageOccupancy::blockedNanos, true},
+            {"poi_pipeline_queue_depth", "gauge", "Items waiting in the stage's input queue.", &StageOccupancy::queued, false},
+            {"poi_pipeline_queue_capacity", "gauge", "Capacity of the stage's input queue.", &StageOccupancy::queueCapacity, false},
+        };
+        for (const Gauge& gauge : gauges) {
+            out << "# HELP " << gauge.name << " " << gauge.help << "\n"
+                << "# TYPE " << gauge.name << " " << gauge.type << "\n";
+            for (Stage s : pipelineStageList) {
+                uint64_t value = (occupancy(s).*gauge.field).load(memory_order_relaxed);
+                out << gauge.name << "{stage=\"" << stageName(s) << "\"} ";
+                if (gauge.nanos) out << toSeconds(value); else out << value;
+                out << "\n";
+            }
+        }
+        out << "# HELP poi_pipeline_utilization Share of the stage threads' time spent working.\n"
+            << "# TYPE poi_pipeline_utilization gauge\n";
+        for (Stage s : pipelineStageList) {
+            out << "poi_pipeline_utilization{stage=\"" << stageName(s) << "\"} " << utilization(s) << "\n";
+        }
+    }
+
+    out << "# HELP poi_report_flush_seconds Time the report sink spends writing one batch.\n"
+        << "# TYPE poi_report_flush_seconds summary\n";
+    appendPrometheusSummary(out, "poi_report_flush_seconds", "", flushLatency.snapshot());
+
+    out << "# HELP poi_uptime_seconds Time since the run started.\n"
+        << "# TYPE poi_uptime_seconds gauge\n"
+        << "poi_uptime_seconds " << chrono::duration<double>(chrono::steady_clock::now() - started).count() << "\n";
+    return out.str();
+}
+
+string RuntimeMetrics::formatJson() const {
+    ostringstream out;
+    int numWorkers = getNumWorkers();
+    vector<HistogramSnapshot> stageTotals(stageCount);
+
+    out << "{\n  \"uptimeSeconds\": " << chrono::duration<double>(chrono::steady_clock::now() - started).count()
+        << ",\n  \"workers\": [\n";
+    for (int i = 0; i < numWorkers; ++i) {
+        const WorkerMetrics& stats = worker(i);
+        out << "    {\"worker\": " << i
+            << ", \"files\": " << stats.files.load(memory_order_relaxed)
+            << ", \"bytes\": " << stats.bytes.load(memory_order_relaxed)
+            << ", \"tokens\": " << stats.tokens.load(memory_order_relaxed)
+            << ", \"errors\": " << stats.errors.load(memory_order_relaxed)
+            << ", \"skippedTokens\": " << stats.skippedTokens.load(memory_order_relaxed)
+            << ", \"skippedBytes\": " << stats.skippedBytes.load(memory_order_relaxed)
+            << ", \"timeouts\": " << stats.timeouts.load(memory_order_relaxed)
+            << ", \"cacheHits\": " << stats.cacheHits.load(memory_order_relaxed)
+            << ", \"cacheMisses\": " << stats.cacheMisses.load(memory_order_relaxed)
+            << ", \"busySeconds\": " << toSeconds(stats.busyNanos.load(memory_order_relaxed))
+            << ", \"bytesPerSecond\": " << throughput(i)
+            << ",\n     \"stages\": {";
+        for (size_t s = 0; s < stageCount; ++s) {
+            HistogramSnapshot snapshot = stats.stages[s].snapshot();
+            out << (s ? ",\n                " : "") << "\"" << stageName(static_cast<Stage>(s)) << "\": ";
+            appendJsonHistogram(out, snapshot);
+            stageTotals[s].merge(snapshot);
+        }
+        out << "}}" << (i + 1 < numWorkers ? "," : "") << "\n";
+    }
+
+    out << "  ],\n  \"stages\": {";
+    for (size_t s = 0; s < stageCount; ++s) {
+        out << (s ? ",\n             " : "") << "\"" << stageName(static_cast<Stage>(s)) << "\": ";
+        appendJsonHistogram(out, stageTotals[s]);
+    }
+    out << "},\n  \"reportFlush\": ";
+    appendJsonHistogram(out, flushLatency.snapshot());
+    if (occupancy(Stage::Read).threads.load(memory_order_relaxed) > 0) {
+        out << ",\n  \"pipeline\": {";
+        bool first = true;
+        for (Stage s : pipelineStageList) {
+            const StageOccupancy& stage = occupancy(s);
+            out << (first ? "" : ",\n               ") << "\"" << stageName(s) << "\": {"
+                << "\"threads\": " << stage.threads.load(memory_order_relaxed)
+                << ", \"items\": " << stage.items.load(memory_order_relaxed)
+                << ", \"busySeconds\": " << toSeconds(stage.busyNanos.load(memory_order_relaxed))
+                << ", \"starvedSeconds\": " << toSeconds(stage.starvedNanos.load(memory_order_relaxed))
+                << ", \"blockedSeconds\": " << toSeconds(stage.blockedNanos.load(memory_order_relaxed))
+                << ", \"utilization\": " << utilization(s)
+                << ", \"queueDepth\": " << stage.queued.load(memory_order_relaxed)
+                << ", \"queueCapacity\": " << stage.queueCapacity.load(memory_order_relaxed) << "}";
+            first = false;
+        }
+        out << "}";
+    }
+    out << "\n}\n";
+    return out.str();
+}
+
+bool RuntimeMetrics::dump(const string& filename, StatsFormat statsFormat) const {
+    string text = format(statsFormat);
+    string temporary = filename + ".tmp";
+
+    FILE* file = fopen(temporary.c_str(), "w");
+    if (file == nullptr) {
+        return false;
+    }
+    bool ok = fwrite(text.data(), 1, text.size(), file) == text.size();
+    ok = fclose(file) == 0 && ok;
+    if (!ok || rename(temporary.c_str(), filename.c_str()) != 0) {
+        remove(temporary.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool RuntimeMetrics::parseFormat(const string& name, StatsFormat& statsFormat) {
+    if (name == "prometheus") statsFormat = StatsFormat::Prometheus;
+    else if (name == "json") statsFormat = StatsFormat::Json;
+    else return false;
+    return true;
+}
+
+StatsDumper::StatsDumper(const RuntimeMetrics& metrics, string filename, StatsFormat statsFormat,
+                         chrono::milliseconds interval)
+    : metrics(metrics), filename(std::move(filename)), statsFormat(statsFormat), interval(interval),
+      dumper(&StatsDumper::run, this) {}
+
+StatsDumper::~StatsDumper() {
+    stop();
+}
+
+void StatsDumper::stop() {
+    {
+        lock_guard<mutex> lock(stopMutex);
+        if (stopping) {
+            return;
+        }
+        stopping = true;
+    }
+    wake.notify_one();
+    dumper.join();
+}
+
+void StatsDumper::run() {
+    while (true) {
+        bool finished;
+        {
+            unique_lock<mutex> lock(stopMutex);
+            if (interval.count() > 0) {
+                wake.wait_for(lock, interval, [this] { return stopping; });
+            } else {
+                wake.wait(lock, [this] { return stopping; });
+            }
+            finished = stopping;
+        }
+
+        if (!metrics.dump(filename, statsFormat)) {
+            LOG_ERROR("Failed writing runtime stats to " << filename);
+        }
+        if (finished) {
+            return;
+        }
+    }
+}
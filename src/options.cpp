@@ -0,0 +1,189 @@
+#include "options.hpp"
+#include "logger.hpp"
+#include "config.hpp"
+#include "model_format.hpp"
+#include <cctype>
+#include <cstdint>
+#include <limits>
+
+using namespace std;
+
+namespace {
+
+// Returns true and sets value when arg looks like "<name>=<value>"
+bool matchFlag(const string& arg, const string& name, string& value) {
+    if (arg.compare(0, name.size() + 1, name + "=") != 0) {
+        return false;
+    }
+    value = arg.substr(name.size() + 1);
+    return true;
+}
+
+bool parseNumber(const string& text, int& value, int minimum) {
+    try {
+        size_t used;
+        int parsed = stoi(text, &used);
+        if (used != text.size() || parsed < minimum) return false;
+        value = parsed;
+        return true;
+    } catch (...) {
+        return false;
+    }
+}
+
+bool parsePositive(const string& text, int& value) {
+    return parseNumber(text, value, 1);
+}
+
+// Byte count with an optional K, M or G suffix (powers of 1024)
+bool parseSize(const string& text, uint64_t& value) {
+    try {
+        size_t used;
+        unsigned long long parsed = stoull(text, &used);
+        if (text.empty() || text[0] == '-') return false;
+        int shift = 0;
+        if (used + 1 == text.size()) {
+            switch (toupper(static_cast<unsigned char>(text[used]))) {
+                case 'K': shift = 10; break;
+                case 'M': shift = 20; break;
+                case 'G': shift = 30; break;
+                default: return false;
+            }
+        } else if (used != text.size()) {
+            return false;
+        }
+        if (parsed > (numeric_limits<uint64_t>::max() >> shift)) return false;
+        value = static_cast<uint64_t>(parsed) << shift;
+        return true;
+    } catch (...) {
+        return false;
+    }
+}
+
+bool isNumber(const string& text) {
+    return !text.empty() && text.find_first_not_of("0123456789") == string::npos;
+}
+
+} // namespace
+
+void parseOptions(int argc, char* argv[], Options& options) {
+    bool threadsGiven = false;
+
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        string value;
+
+        if (matchFlag(arg, "--report", value)) {
+            options.reportFilename = value;
+        } else if (matchFlag(arg, "--report-format", value)) {
+            if (!ReportWriter::parseFormat(value, options.reportFormat)) {
+                LOG_ERROR("Unknown report format '" << value << "'. Using text.");
+            }
+        } else if (matchFlag(arg, "--report-flush-ms", value)) {
+            if (!parsePositive(value, options.reportFlushMs)) {
+                LOG_ERROR("Invalid report flush interval '" << value << "'. Using " << options.reportFlushMs << " ms.");
+            }
+        } else if (matchFlag(arg, "--stats", value)) {
+            options.statsFilename = value;
+        } else if (matchFlag(arg, "--stats-format", value)) {
+            if (!RuntimeMetrics::parseFormat(value, options.statsFormat)) {
+                LOG_ERROR("Unknown stats format '" << value << "'. Using prometheus.");
+            }
+        } else if (matchFlag(arg, "--stats-interval-ms", value)) {
+            if (!parseNumber(value, options.statsIntervalMs, 0)) {
+                LOG_ERROR("Invalid stats interval '" << value << "'. Using " << options.statsIntervalMs << " ms.");
+            }
+        } else if (matchFlag(arg, "--include", value)) {
+            options.discovery.includes.push_back(value);
+        } else if (matchFlag(arg, "--exclude", value)) {
+            options.discovery.excludes.push_back(value);
+        } else if (matchFlag(arg, "--min-size", value)) {
+            if (!parseSize(value, options.discovery.minBytes)) {
+                LOG_ERROR("Invalid minimum file size '" << value << "'. Ignoring it.");
+            }
+        } else if (matchFlag(arg, "--max-size", value)) {
+            if (!parseSize(value, options.discovery.maxBytes)) {
+                LOG_ERROR("Invalid maximum file size '" << value << "'. Ignoring it.");
+            }
+        } else if (matchFlag(arg, "--discovery-threads", value)) {
+            if (!parsePositive(value, options.discovery.threads)) {
+                LOG_ERROR("Invalid discovery thread count '" << value << "'. Choosing automatically.");
+            }
+        } else if (matchFlag(arg, "--readers", value) || matchFlag(arg, "--tokenizers", value) ||
+                   matchFlag(arg, "--scorers", value) || matchFlag(arg, "--pipeline-depth", value)) {
+            string name = arg.substr(2, arg.find('=') - 2);
+            int& target = name == "readers" ? options.pipeline.readers
+                        : name == "tokenizers" ? options.pipeline.tokenizers
+                        : name == "scorers" ? options.pipeline.scorers
+                        : options.pipeline.queueDepth;
+            options.pipeline.enabled = true;
+            if (!parsePositive(value, target)) {
+                LOG_ERROR("Invalid " << name << " value '" << value << "'. Using " << target << ".");
+            }
+        } else if (matchFlag(arg, "--log-level", value)) {
+            LogLevel level;
+            if (Logger::parseLevel(value, level)) {
+                Logger::setLevel(level);
+            } else {
+                LOG_ERROR("Unknown log level '" << value << "'. Keeping the current level.");
+            }
+        } else if (matchFlag(arg, "--hash-bits", value)) {
+            int bits;
+            if (parsePositive(value, bits) && bits >= int(ModelFormat::minHashBits) && bits <= int(ModelFormat::maxHashBits)) {
+                options.hashBits = bits;
+            } else {
+                LOG_ERROR("Hash bits must be between " << ModelFormat::minHashBits << " and " << ModelFormat::maxHashBits
+                          << ". Training a vocabulary model.");
+            }
+        } else if (matchFlag(arg, "--serve", value)) {
+            options.server.socketPath = value;
+            if (value == "-") {
+                // Answers go to stdout; only errors (on stderr) may be logged next to them
+                Logger::setLevel(LogLevel::Error);
+            }
+        } else if (matchFlag(arg, "--serve-batch", value)) {
+            int batch;
+            if (parsePositive(value, batch)) {
+                options.server.maxBatch = static_cast<size_t>(batch);
+            } else {
+                LOG_ERROR("Invalid batch size '" << value << "'. Using " << options.server.maxBatch << ".");
+            }
+        } else if (arg == "--pin") {
+            options.pinThreads = true;
+        } else if (arg == "--early-exit") {
+            options.earlyExit = true;
+        } else if (matchFlag(arg, "--cache", value)) {
+            options.cacheFilename = value;
+            options.dedup = true;
+        } else if (arg == "--dedup") {
+            options.dedup = true;
+        } else if (arg.rfind("--", 0) == 0) {
+            LOG_ERROR("Unknown option " << arg);
+        } else if (!isNumber(arg)) {
+            // Anything that is not a thread count is a file or directory to classify
+            options.discovery.roots.push_back(arg);
+        } else if (parsePositive(arg, options.numWorkers)) {
+            threadsGiven = true;
+            LOG_DEBUG("Using " << options.numWorkers << " threads.");
+        } else {
+            LOG_ERROR("Invalid thread count argument. Using one worker per usable CPU.");
+        }
+    }
+
+    if (options.pipeline.enabled) {
+        LOG_DEBUG("Pipeline mode: " << options.pipeline.readers << " readers, " << options.pipeline.tokenizers
+                  << " tokenizers, " << options.pipeline.scorers << " scorers.");
+    } else if (!threadsGiven) {
+        LOG_DEBUG("No thread count provided. Using one worker per usable CPU.");
+    }
+    options.server.workers = options.numWorkers;
+    if (options.discovery.roots.empty()) {
+        options.discovery.roots.push_back(Config::directoryPath);
+    }
+    if (options.discovery.minBytes > options.discovery.maxBytes) {
+        LOG_ERROR("Minimum file size is above the maximum; no file can match.");
+    }
+    if (options.statsFilename.empty()) {
+        options.statsFilename = options.statsFormat == StatsFormat::Json ? "runtime_stats.json" : "runtime_stats.prom";
+    }
+}
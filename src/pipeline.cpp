@@ -0,0 +1,367 @@
+#include "pipeline.hpp"
+#include "classifier.hpp"
+#include "tokenizer.hpp"
+#include "config.hpp"
+#include "logger.hpp"
+#include "thread_pool.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace {
+
+uint64_t nanosSince(chrono::steady_clock::time_point started) {
+    return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - started).count();
+}
+
+// Enough buffers to fill both queues while every thread holds one and every reader a spare
+size_t bufferCount(const PipelineOptions& options) {
+    return 2 * options.queueDepth + options.threadCount() + options.readers;
+}
+
+} // namespace
+
+// A document in flight; kept alive by its blocks and by the reader until it finished reading
+struct Pipeline::Document {
+    FileTask task;
+    uint64_t bytes = 0;
+    uint64_t readNanos = 0;
+    bool failed = false;  // Set by the reader before it drops its hold
+    chrono::steady_clock::time_point started;
+
+    atomic<uint32_t> pendingBlocks{1};  // Blocks in flight plus the reader's own hold
+    atomic<uint64_t> tokens{0};
+
+    mutex partialMutex;
+    vector<vector<double>> partialScores;  // Per block, in document order
+};
+
+Pipeline::Pipeline(const PipelineOptions& options, TaskScheduler& scheduler, ReportWriter& reportWriter,
+                   RuntimeMetrics& metrics)
+    : options(options), scheduler(scheduler), reportWriter(reportWriter), metrics(metrics),
+      freeBlocks(bufferCount(options)), tokenizeQueue(options.queueDepth), scoreQueue(options.queueDepth) {
+    for (size_t i = 0; i < bufferCount(options); ++i) {
+        blocks.push_back(make_unique<Block>());
+        blocks.back()->text.resize(Config::pipelineBlockSize);
+        freeBlocks.push(blocks.back().get());
+    }
+
+    metrics.occupancy(Stage::Read).threads = options.readers;
+    metrics.occupancy(Stage::Tokenize).threads = options.tokenizers;
+    metrics.occupancy(Stage::Score).threads = options.scorers;
+    metrics.occupancy(Stage::Read).queueCapacity = Config::workerQueueCapacity * options.readers;
+    metrics.occupancy(Stage::Tokenize).queueCapacity = tokenizeQueue.capacity();
+    metrics.occupancy(Stage::Score).queueCapacity = scoreQueue.capacity();
+}
+
+Pipeline::~Pipeline() {
+    join();
+}
+
+void Pipeline::start() {
+    activeReaders = options.readers;
+    activeTokenizers = options.tokenizers;
+
+    ThreadPool& pool = ThreadPool::instance();
+    int slot = 0;
+    for (int i = 0; i < options.readers; ++i) {
+        stageJobs.push_back(pool.start([this, slot] { readerLoop(slot); }));
+        ++slot;
+    }
+    for (int i = 0; i < options.tokenizers; ++i) {
+        stageJobs.push_back(pool.start([this, slot] { tokenizerLoop(slot); }));
+        ++slot;
+    }
+    for (int i = 0; i < options.scorers; ++i) {
+        stageJobs.push_back(pool.start([this, slot] { scorerLoop(slot); }));
+        ++slot;
+    }
+    LOG_DEBUG("Pipeline started: " << options.readers << " readers, " << options.tokenizers << " tokenizers, "
+              << options.scorers << " scorers, " << blocks.size() << " buffers of " << Config::pipelineBlockSize
+              << " bytes.");
+}
+
+void Pipeline::join() {
+    for (auto& job : stageJobs) {
+        if (job.valid()) {
+            job.get();
+        }
+    }
+}
+
+void Pipeline::readerLoop(int readerId) {
+    StageOccupancy& occupancy = metrics.occupancy(Stage::Read);
+    WorkerMetrics& stats = metrics.worker(readerId);
+
+    FileTask task;
+    while (true) {
+        auto waitStarted = chrono::steady_clock::now();
+        if (!scheduler.next(readerId, task)) {
+            break;
+        }
+        occupancy.starvedNanos.fetch_add(nanosSince(waitStarted), memory_order_relaxed);
+        size_t queued = 0;
+        for (int i = 0; i < options.readers; ++i) {
+            queued += scheduler.queueSize(i);
+        }
+        occupancy.queued.store(queued, memory_order_relaxed);
+        stats.stage(Stage::QueueWait).record(chrono::steady_clock::now() - task.enqueuedAt);
+
+        try {
+            readDocument(readerId, std::move(task));
+        } catch (const exception& e) {
+            LOG_ERROR("Reader " << readerId << ": " << e.what());
+        }
+    }
+
+    // The last reader out tells the tokenizers nothing else is coming
+    if (activeReaders.fetch_sub(1) == 1) {
+        tokenizeQueue.close();
+    }
+    LOG_DEBUG("Reader " << readerId << " finished.");
+}
+
+void Pipeline::readDocument(int readerId, FileTask&& task) {
+    StageOccupancy& occupancy = metrics.occupancy(Stage::Read);
+    WorkerMetrics& stats = metrics.worker(readerId);
+    auto started = chrono::steady_clock::now();
+
+    int fd = open(task.filePath.c_str(), O_RDONLY);
+    if (fd < 0) {
+        LOG_ERROR("Reader " << readerId << " cannot open file " << task.filePath << ": " << strerror(errno));
+        stats.errors.fetch_add(1, memory_order_relaxed);
+        scheduler.taskDone(task);
+        return;
+    }
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    auto document = make_shared<Document>();
+    document->task = std::move(task);
+    document->started = started;
+
+    uint64_t blockedNanos = 0;
+    uint32_t sequence = 0;
+    Block* block = acquireBlock(blockedNanos);
+    block->size = 0;
+
+    while (true) {
+        // A single token longer than the whole buffer: grow instead of splitting it
+        if (block->size == block->text.size()) {
+            block->text.resize(block->text.size() * 2);
+        }
+        auto readStarted = chrono::steady_clock::now();
+        ssize_t bytesRead = read(fd, block->text.data() + block->size, block->text.size() - block->size);
+        document->readNanos += nanosSince(readStarted);
+        if (bytesRead < 0) {
+            if (errno == EINTR) continue;
+            LOG_ERROR("Reader " << readerId << " reading file " << document->task.filePath << ": " << strerror(errno));
+            document->failed = true;
+            break;
+        }
+        if (bytesRead == 0) {
+            break;
+        }
+        block->size += static_cast<size_t>(bytesRead);
+        document->bytes += static_cast<uint64_t>(bytesRead);
+        if (block->size < block->text.size()) {
+            continue;
+        }
+
+        // Full block: ship everything up to the last separator and carry the partial token over
+        size_t cut = block->size;
+        while (cut > 0 && !Tokenizer::isSpace(block->text[cut - 1])) {
+            --cut;
+        }
+        if (cut == 0) {
+            continue;
+        }
+        Block* next = acquireBlock(blockedNanos);
+        next->size = block->size - cut;
+        if (next->text.size() < next->size) {
+            next->text.resize(block->text.size());
+        }
+        memcpy(next->text.data(), block->text.data() + cut, next->size);
+        block->size = cut;
+        blockedNanos += ship(block, document, sequence++);
+        block = next;
+    }
+    close(fd);
+
+    if (block->size > 0 && !document->failed) {
+        blockedNanos += ship(block, document, sequence++);
+    } else {
+        releaseBlock(block);
+    }
+
+    uint64_t elapsed = nanosSince(started);
+    uint64_t busyNanos = elapsed - min(blockedNanos, elapsed);
+    occupancy.busyNanos.fetch_add(busyNanos, memory_order_relaxed);
+    occupancy.blockedNanos.fetch_add(blockedNanos, memory_order_relaxed);
+    occupancy.items.fetch_add(1, memory_order_relaxed);
+    stats.stage(Stage::Read).record(document->readNanos);
+    stats.bytes.fetch_add(document->bytes, memory_order_relaxed);
+    stats.busyNanos.fetch_add(busyNanos, memory_order_relaxed);
+
+    // Drop the reader's hold; if the blocks are all scored already, finish here
+    if (document->pendingBlocks.fetch_sub(1) == 1) {
+        finishDocument(*document, readerId);
+    }
+}
+
+Pipeline::Block* Pipeline::acquireBlock(uint64_t& blockedNanos) {
+    auto waitStarted = chrono::steady_clock::now();
+    Block* block = nullptr;
+    freeBlocks.pop(block);
+    blockedNanos += nanosSince(waitStarted);
+    return block;
+}
+
+void Pipeline::releaseBlock(Block* block) {
+    block->document.reset();
+    block->size = 0;
+    freeBlocks.push(std::move(block));
+}
+
+uint64_t Pipeline::ship(Block* block, const shared_ptr<Document>& document, uint32_t sequence) {
+    block->document = document;
+    block->sequence = sequence;
+    document->pendingBlocks.fetch_add(1);
+
+    auto pushStarted = chrono::steady_clock::now();
+    if (!tokenizeQueue.push(std::move(block))) {
+        return 0;
+    }
+    return nanosSince(pushStarted);
+}
+
+void Pipeline::tokenizerLoop(int slot) {
+    const CompiledModel& model = Classifier::getInstance().localModel();
+    StageOccupancy& occupancy = metrics.occupancy(Stage::Tokenize);
+    WorkerMetrics& stats = metrics.worker(slot);
+    vector<string_view> tokens;
+
+    Block* block;
+    while (true) {
+        auto waitStarted = chrono::steady_clock::now();
+        if (!tokenizeQueue.pop(block)) {
+            break;
+        }
+        auto started = chrono::steady_clock::now();
+        occupancy.starvedNanos.fetch_add(chrono::duration_cast<chrono::nanoseconds>(started - waitStarted).count(),
+                                         memory_order_relaxed);
+        occupancy.queued.store(tokenizeQueue.sizeApprox(), memory_order_relaxed);
+
+        // Blocks end after a separator (or at the end of the file), so every token is complete
+        tokens.clear();
+        Tokenizer::tokenize(block->text.data(), block->size, tokens);
+        block->terms.clear();
+        for (string_view token : tokens) {
+            block->terms.push_back(model.lookup(token));
+        }
+
+        uint64_t busyNanos = nanosSince(started);
+        block->document->tokens.fetch_add(block->terms.size(), memory_order_relaxed);
+        stats.stage(Stage::Tokenize).record(busyNanos);
+        stats.tokens.fetch_add(block->terms.size(), memory_order_relaxed);
+        stats.busyNanos.fetch_add(busyNanos, memory_order_relaxed);
+        occupancy.busyNanos.fetch_add(busyNanos, memory_order_relaxed);
+        occupancy.items.fetch_add(1, memory_order_relaxed);
+
+        auto pushStarted = chrono::steady_clock::now();
+        if (scoreQueue.push(std::move(block))) {
+            occupancy.blockedNanos.fetch_add(nanosSince(pushStarted), memory_order_relaxed);
+        }
+    }
+
+    if (activeTokenizers.fetch_sub(1) == 1) {
+        scoreQueue.close();
+    }
+}
+
+void Pipeline::scorerLoop(int slot) {
+    const CompiledModel& model = Classifier::getInstance().localModel();
+    StageOccupancy& occupancy = metrics.occupancy(Stage::Score);
+    WorkerMetrics& stats = metrics.worker(slot);
+    size_t numGenres = model.genreCount();
+
+    Block* block;
+    while (true) {
+        auto waitStarted = chrono::steady_clock::now();
+        if (!scoreQueue.pop(block)) {
+            break;
+        }
+        auto started = chrono::steady_clock::now();
+        occupancy.starvedNanos.fetch_add(chrono::duration_cast<chrono::nanoseconds>(started - waitStarted).count(),
+                                         memory_order_relaxed);
+        occupancy.queued.store(scoreQueue.sizeApprox(), memory_order_relaxed);
+
+        vector<double> partial(numGenres, 0.0);
+        model.accumulate(block->terms.data(), block->terms.size(), partial.data());
+
+        shared_ptr<Document> document = std::move(block->document);
+        {
+            lock_guard<mutex> lock(document->partialMutex);
+            if (document->partialScores.size() <= block->sequence) {
+                document->partialScores.resize(block->sequence + 1);
+            }
+            document->partialScores[block->sequence] = std::move(partial);
+        }
+        releaseBlock(block);
+
+        uint64_t busyNanos = nanosSince(started);
+        stats.stage(Stage::Score).record(busyNanos);
+        stats.busyNanos.fetch_add(busyNanos, memory_order_relaxed);
+        occupancy.busyNanos.fetch_add(busyNanos, memory_order_relaxed);
+        occupancy.items.fetch_add(1, memory_order_relaxed);
+
+        if (document->pendingBlocks.fetch_sub(1) == 1) {
+            finishDocument(*document, slot);
+        }
+    }
+}
+
+void Pipeline::finishDocument(Document& document, int slot) {
+    auto started = chrono::steady_clock::now();
+    WorkerMetrics& stats = metrics.worker(slot);
+
+    if (document.failed) {
+        stats.errors.fetch_add(1, memory_order_relaxed);
+        scheduler.taskDone(document.task);
+        return;
+    }
+
+    // Priors first, then the blocks in document order, so the sum does not depend on timing
+    Classifier& classifier = Classifier::getInstance();
+    const CompiledModel& model = classifier.getModel();
+    vector<double> totals(model.logPriors(), model.logPriors() + model.genreCount());
+    for (const auto& partial : document.partialScores) {
+        for (size_t g = 0; g < partial.size(); ++g) {
+            totals[g] += partial[g];
+        }
+    }
+    ClassificationResult result = classifier.pickBestGenre(std::move(totals), document.tokens.load());
+    stats.files.fetch_add(1, memory_order_relaxed);
+
+    if (!result.genre.empty()) {
+        ReportRecord record;
+        record.filePath = document.task.filePath;
+        record.genre = std::move(result.genre);
+        record.logProbability = result.logProbability;
+        record.scores = std::move(result.scores);
+        record.tokens = result.tokens;
+        record.workerId = slot;
+        record.elapsedMs = chrono::duration<double, milli>(started - document.started).count();
+        reportWriter.submit(std::move(record));
+    } else {
+        LOG_ERROR("Pipeline failed to classify file " << document.task.filePath);
+        stats.errors.fetch_add(1, memory_order_relaxed);
+    }
+
+    stats.stage(Stage::Report).record(chrono::steady_clock::now() - started);
+    scheduler.taskDone(document.task);
+}
@@ -0,0 +1,234 @@
+#include "report_writer.hpp"
+#include "logger.hpp"
+#include <cmath>
+#include <cstdio>
+#include <stdexcept>
+
+using namespace std;
+
+namespace {
+
+const size_t batchFlushBytes = 1 << 20;
+
+// Scores are written with full round-trip precision, timings with microseconds
+void appendNumber(string& out, double value, const char* pattern = "%.17g") {
+    if (!isfinite(value)) {
+        out += "null";
+        return;
+    }
+    char number[32];
+    int length = snprintf(number, sizeof(number), pattern, value);
+    out.append(number, static_cast<size_t>(length));
+}
+
+void appendJsonString(string& out, const string& value) {
+    out += '"';
+    for (char c : value) {
+        switch (c) {
+        case '"': out += "\\\""; break;
+        case '\\': out += "\\\\"; break;
+        case '\n': out += "\\n"; break;
+        case '\t': out += "\\t"; break;
+        default:
+            if (static_cast<unsigned char>(c) < 0x20) {
+                char escaped[8];
+                snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+                out += escaped;
+            } else {
+                out += c;
+            }
+        }
+    }
+    out += '"';
+}
+
+void appendCsvField(string& out, const string& value) {
+    if (value.find_first_of(",\"\n") == string::npos) {
+        out += value;
+        return;
+    }
+    out += '"';
+    for (char c : value) {
+        if (c == '"') out += '"';
+        out += c;
+    }
+    out += '"';
+}
+
+} // namespace
+
+ReportWriter::ReportWriter(const string& filename, ReportFormat format, vector<string> genreNames,
+                           chrono::milliseconds flushInterval, size_t ringCapacity)
+    : format(format), genreNames(std::move(genreNames)), flushInterval(flushInterval), ring(ringCapacity) {
+    // Appending keeps the behaviour of the old per-document writes across runs
+    file = fopen(filename.c_str(), "a");
+    if (file == nullptr) {
+        throw runtime_error("Unable to open report file: " + filename);
+    }
+    if (ftell(file) == 0) {
+        appendHeader();
+    }
+    sink = thread(&ReportWriter::sinkLoop, this);
+}
+
+ReportWriter::~ReportWriter() {
+    close();
+}
+
+bool ReportWriter::parseFormat(const string& name, ReportFormat& format) {
+    if (name == "text") format = ReportFormat::Text;
+    else if (name == "csv") format = ReportFormat::Csv;
+    else if (name == "jsonl") format = ReportFormat::Jsonl;
+    else return false;
+    return true;
+}
+
+void ReportWriter::submit(ReportRecord&& record) {
+    while (!ring.tryPush(std::move(record))) {
+        // Ring is full: make sure the sink is awake and give it a moment
+        wake.notify_one();
+        this_thread::yield();
+    }
+    wakeIfBacklogged();
+}
+
+void ReportWriter::submit(const ReportRecord& record) {
+    while (!ring.tryPush(record)) {
+        wake.notify_one();
+        this_thread::yield();
+    }
+    wakeIfBacklogged();
+}
+
+void ReportWriter::wakeIfBacklogged() {
+    if (ring.sizeApprox() > ring.capacity() / 2) {
+        wake.notify_one();
+    }
+}
+
+void ReportWriter::close() {
+    if (!sink.joinable()) {
+        return;
+    }
+    {
+        lock_guard<mutex> lock(wakeMutex);
+        closing.store(true);
+    }
+    wake.notify_one();
+    sink.join();
+
+    fclose(file);
+    file = nullptr;
+}
+
+void ReportWriter::sinkLoop() {
+    auto lastFlush = chrono::steady_clock::now();
+
+    while (true) {
+        drain();
+
+        auto now = chrono::steady_clock::now();
+        if (batch.size() >= batchFlushBytes || (!batch.empty() && now - lastFlush >= flushInterval)) {
+            flush();
+            lastFlush = now;
+        }
+
+        if (closing.load()) {
+            // Producers are done once close() is called; pick up the stragglers and finish
+            drain();
+            flush();
+            return;
+        }
+
+        unique_lock<mutex> lock(wakeMutex);
+        wake.wait_for(lock, flushInterval, [this] { return closing.load() || ring.sizeApprox() > ring.capacity() / 2; });
+    }
+}
+
+size_t ReportWriter::drain() {
+    size_t count = 0;
+    // Formatted straight from the ring slot, which keeps its storage for the next lap
+    while (ring.tryConsume([this](const ReportRecord& record) { appendRecord(record); })) {
+        ++count;
+        if (batch.size() >= batchFlushBytes) {
+            flush();
+        }
+    }
+    written.fetch_add(count, memory_order_relaxed);
+    return count;
+}
+
+void ReportWriter::flush() {
+    if (batch.empty()) {
+        return;
+    }
+    auto started = chrono::steady_clock::now();
+    if (fwrite(batch.data(), 1, batch.size(), file) != batch.size()) {
+        LOG_ERROR("Failed writing " << batch.size() << " bytes to the classification report.");
+    }
+    fflush(file);
+    batch.clear();
+
+    if (LatencyHistogram* histogram = flushLatency.load(memory_order_acquire)) {
+        histogram->record(chrono::steady_clock::now() - started);
+    }
+}
+
+void ReportWriter::appendHeader() {
+    if (format != ReportFormat::Csv) {
+        return;
+    }
+    batch += "file,genre,log_probability,tokens,worker,elapsed_ms";
+    for (const string& genre : genreNames) {
+        batch += ",score_";
+        batch += genre;
+    }
+    batch += '\n';
+}
+
+void ReportWriter::appendRecord(const ReportRecord& record) {
+    switch (format) {
+    case ReportFormat::Text:
+        batch += "File: ";
+        batch += record.filePath;
+        batch += ", Predicted Genre: ";
+        batch += record.genre;
+        batch += '\n';
+        break;
+
+    case ReportFormat::Csv:
+        appendCsvField(batch, record.filePath);
+        batch += ',';
+        appendCsvField(batch, record.genre);
+        batch += ',';
+        appendNumber(batch, record.logProbability);
+        batch += ',' + to_string(record.tokens) + ',' + to_string(record.workerId) + ',';
+        appendNumber(batch, record.elapsedMs, "%.3f");
+        for (size_t g = 0; g < genreNames.size(); ++g) {
+            batch += ',';
+            appendNumber(batch, g < record.scores.size() ? record.scores[g] : NAN);
+        }
+        batch += '\n';
+        break;
+
+    case ReportFormat::Jsonl:
+        batch += "{\"file\":";
+        appendJsonString(batch, record.filePath);
+        batch += ",\"genre\":";
+        appendJsonString(batch, record.genre);
+        batch += ",\"log_probability\":";
+        appendNumber(batch, record.logProbability);
+        batch += ",\"tokens\":" + to_string(record.tokens) + ",\"worker\":" + to_string(record.workerId);
+        batch += ",\"elapsed_ms\":";
+        appendNumber(batch, record.elapsedMs, "%.3f");
+        batch += ",\"scores\":{";
+        for (size_t g = 0; g < genreNames.size() && g < record.scores.size(); ++g) {
+            if (g > 0) batch += ',';
+            appendJsonString(batch, genreNames[g]);
+            batch += ':';
+            appendNumber(batch, record.scores[g]);
+        }
+        batch += "}}\n";
+        break;
+    }
+}
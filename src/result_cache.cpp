@@ -0,0 +1,309 @@
+#include "result_cache.hpp"
+#include "content_hash.hpp"
+#include "logger.hpp"
+#include <cerrno>
+#include <charconv>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string_view>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace {
+
+constexpr const char* cacheMagic = "POI-RESULT-CACHE";
+constexpr int cacheVersion = 1;
+
+int64_t mtimeOf(const struct stat& info) {
+    return int64_t(info.st_mtim.tv_sec) * 1000000000 + info.st_mtim.tv_nsec;
+}
+
+// Hash the file's bytes through a read-only mapping; size and mtime come from the same open
+// file, so they describe exactly the content that was hashed
+uint64_t hashFile(const string& path, uint64_t& size, int64_t& mtimeNanos) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    struct stat info;
+    if (fd < 0 || fstat(fd, &info) != 0) {
+        if (fd >= 0) close(fd);
+        throw runtime_error("Unable to open file: " + path);
+    }
+    size = static_cast<uint64_t>(info.st_size);
+    mtimeNanos = mtimeOf(info);
+    if (size == 0) {
+        close(fd);
+        return ContentHash::hash64(nullptr, 0);
+    }
+
+    void* mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        throw runtime_error("Unable to mmap file: " + path);
+    }
+    madvise(mapping, size, MADV_SEQUENTIAL);
+    uint64_t hash = ContentHash::hash64(mapping, size);
+    munmap(mapping, size);
+    return hash;
+}
+
+// Next tab-separated field of line from pos on; the rest of the line when last is set
+bool nextField(const string& line, size_t& pos, string_view& field, bool last = false) {
+    if (pos > line.size()) return false;
+    size_t end = last ? line.size() : line.find('\t', pos);
+    if (end == string::npos) end = line.size();
+    field = string_view(line).substr(pos, end - pos);
+    pos = end + 1;
+    return true;
+}
+
+template <typename Integer>
+bool parseInteger(string_view text, Integer& value, int base = 10) {
+    auto [end, error] = from_chars(text.data(), text.data() + text.size(), value, base);
+    return error == errc() && end == text.data() + text.size() && !text.empty();
+}
+
+bool parseDouble(string_view text, double& value) {
+    string copy(text);
+    char* end = nullptr;
+    value = strtod(copy.c_str(), &end);
+    return !copy.empty() && end == copy.c_str() + copy.size();
+}
+
+void appendHex(string& out, uint64_t value) {
+    char number[17];
+    snprintf(number, sizeof(number), "%016llx", static_cast<unsigned long long>(value));
+    out += number;
+}
+
+// Enough digits for strtod to read back the same double
+void appendDouble(string& out, double value) {
+    char number[32];
+    snprintf(number, sizeof(number), "%.17g", value);
+    out += number;
+}
+
+} // namespace
+
+ResultCache::ResultCache(string filename, uint64_t modelFingerprint)
+    : filename(std::move(filename)), modelFingerprint(modelFingerprint) {
+    if (!this->filename.empty()) {
+        load();
+    }
+}
+
+uint64_t ResultCache::fingerprint(const CompiledModel& model, bool earlyExit) {
+    unsigned char flags = earlyExit ? 1 : 0;
+    return ContentHash::hash64(&flags, sizeof(flags), model.fingerprint());
+}
+
+bool ResultCache::find(const string& path, ClassificationResult& result, Ticket& ticket) {
+    ticket = Ticket{};
+    ticket.path = path;
+
+    // Fast path: the file looks exactly as when it was last hashed
+    struct stat info;
+    if (stat(path.c_str(), &info) == 0) {
+        unique_lock<mutex> lock(entriesMutex);
+        auto file = files.find(path);
+        if (file != files.end() && file->second.size == static_cast<uint64_t>(info.st_size) &&
+            file->second.mtimeNanos == mtimeOf(info) && awaitReady(lock, file->second.contentHash, result)) {
+            ++counts.pathHits;
+            result.bytes = file->second.size;
+            return true;
+        }
+    }
+
+    ticket.contentHash = hashFile(path, ticket.size, ticket.mtimeNanos);
+
+    unique_lock<mutex> lock(entriesMutex);
+    files[path] = FileKey{ticket.size, ticket.mtimeNanos, ticket.contentHash};
+    auto entry = results.find(ticket.contentHash);
+    if (entry != results.end()) {
+        bool earlierRun = !entry->second.fromThisRun;
+        if (awaitReady(lock, ticket.contentHash, result)) {
+            ++(earlierRun ? counts.contentHits : counts.duplicateHits);
+            result.bytes = ticket.size;
+            return true;
+        }
+    }
+
+    // First worker with this content: the others wait on the pending entry
+    Entry& pending = results[ticket.contentHash];
+    pending.fromThisRun = true;
+    ticket.owner = true;
+    ++counts.misses;
+    return false;
+}
+
+bool ResultCache::awaitReady(unique_lock<mutex>& lock, uint64_t contentHash, ClassificationResult& result) {
+    while (true) {
+        auto entry = results.find(contentHash);
+        if (entry == results.end()) return false;
+        if (entry->second.ready) {
+            result.clear();
+            result.genre = entry->second.genre;
+            result.logProbability = entry->second.logProbability;
+            result.scores = entry->second.scores;
+            result.tokens = entry->second.tokens;
+            return true;
+        }
+        published.wait(lock);
+    }
+}
+
+void ResultCache::store(const Ticket& ticket, const ClassificationResult& result) {
+    if (!ticket.owner) return;
+    if (result.genre.empty()) {
+        abandon(ticket);
+        return;
+    }
+    {
+        lock_guard<mutex> lock(entriesMutex);
+        Entry& entry = results[ticket.contentHash];
+        entry.ready = true;
+        entry.fromThisRun = true;
+        entry.genre = result.genre;
+        entry.logProbability = result.logProbability;
+        entry.scores = result.scores;
+        entry.tokens = result.tokens;
+    }
+    published.notify_all();
+}
+
+void ResultCache::abandon(const Ticket& ticket) {
+    if (!ticket.owner) return;
+    {
+        lock_guard<mutex> lock(entriesMutex);
+        auto entry = results.find(ticket.contentHash);
+        if (entry != results.end() && !entry->second.ready) {
+            results.erase(entry);
+        }
+    }
+    published.notify_all();
+}
+
+ResultCache::Stats ResultCache::stats() const {
+    lock_guard<mutex> lock(entriesMutex);
+    return counts;
+}
+
+// Text, one record per line:
+//   POI-RESULT-CACHE <version> <model fingerprint>
+//   R <content hash> <tokens> <genre> <log probability> <score per genre>...
+//   F <content hash> <size> <mtime ns> <path>
+// Fields are tab-separated (the path is the rest of the line) and hashes are hex
+void ResultCache::load() {
+    ifstream in(filename);
+    if (!in.is_open()) return;  // First run
+
+    string line;
+    string expected = string(cacheMagic) + "\t" + to_string(cacheVersion) + "\t";
+    appendHex(expected, modelFingerprint);
+    if (!getline(in, line) || line != expected) {
+        LOG_INFO("Result cache " << filename << " belongs to another model or version; starting over.");
+        return;
+    }
+
+    size_t lineNumber = 1;
+    while (getline(in, line)) {
+        ++lineNumber;
+        size_t pos = 0;
+        string_view kind, hashText;
+        bool valid = nextField(line, pos, kind) && nextField(line, pos, hashText);
+        uint64_t contentHash = 0;
+        valid = valid && parseInteger(hashText, contentHash, 16);
+
+        if (valid && kind == "R") {
+            Entry entry;
+            string_view tokens, genre, logProbability, score;
+            valid = nextField(line, pos, tokens) && parseInteger(tokens, entry.tokens) &&
+                    nextField(line, pos, genre) && !genre.empty() &&
+                    nextField(line, pos, logProbability) && parseDouble(logProbability, entry.logProbability);
+            while (valid && pos <= line.size()) {
+                double value;
+                valid = nextField(line, pos, score) && parseDouble(score, value);
+                entry.scores.push_back(value);
+            }
+            if (valid) {
+                entry.ready = true;
+                entry.genre = genre;
+                results[contentHash] = std::move(entry);
+            }
+        } else if (valid && kind == "F") {
+            FileKey key;
+            key.contentHash = contentHash;
+            string_view size, mtime, path;
+            valid = nextField(line, pos, size) && parseInteger(size, key.size) &&
+                    nextField(line, pos, mtime) && parseInteger(mtime, key.mtimeNanos) &&
+                    nextField(line, pos, path, true) && !path.empty();
+            if (valid) {
+                files[string(path)] = key;
+            }
+        } else {
+            valid = false;
+        }
+
+        if (!valid) {
+            LOG_ERROR("Result cache " << filename << " is damaged at line " << lineNumber << "; starting over.");
+            results.clear();
+            files.clear();
+            return;
+        }
+    }
+    LOG_DEBUG("Result cache loaded: " << results.size() << " results for " << files.size() << " files.");
+}
+
+bool ResultCache::save() {
+    if (filename.empty()) return true;
+
+    string out = string(cacheMagic) + "\t" + to_string(cacheVersion) + "\t";
+    {
+        lock_guard<mutex> lock(entriesMutex);
+        appendHex(out, modelFingerprint);
+        out += '\n';
+        for (const auto& [contentHash, entry] : results) {
+            if (!entry.ready) continue;
+            out += "R\t";
+            appendHex(out, contentHash);
+            out += '\t' + to_string(entry.tokens) + '\t' + entry.genre + '\t';
+            appendDouble(out, entry.logProbability);
+            for (double score : entry.scores) {
+                out += '\t';
+                appendDouble(out, score);
+            }
+            out += '\n';
+        }
+        for (const auto& [path, key] : files) {
+            auto entry = results.find(key.contentHash);
+            // A path with a line break cannot be stored; it is simply hashed again next run
+            if (entry == results.end() || !entry->second.ready || path.find('\n') != string::npos) continue;
+            out += "F\t";
+            appendHex(out, key.contentHash);
+            out += '\t' + to_string(key.size) + '\t' + to_string(key.mtimeNanos) + '\t' + path + '\n';
+        }
+    }
+
+    string temporary = filename + ".tmp";
+    {
+        ofstream outFile(temporary, ios::binary | ios::trunc);
+        outFile.write(out.data(), static_cast<streamsize>(out.size()));
+        outFile.close();
+        if (!outFile) {
+            LOG_ERROR("Failed writing result cache to " << temporary);
+            remove(temporary.c_str());
+            return false;
+        }
+    }
+    if (rename(temporary.c_str(), filename.c_str()) != 0) {
+        LOG_ERROR("Could not replace " << filename << ": " << strerror(errno));
+        remove(temporary.c_str());
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,214 @@
+#include "score_kernel.hpp"
+#include "compiled_model.hpp"
+#include <array>
+#include <atomic>
+#include <utility>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define POI_SCORE_KERNEL_X86 1
+#endif
+
+using namespace std;
+using ScoreKernel::AddRows;
+using ScoreKernel::AddWeightedRows;
+
+namespace {
+
+// The sums are a fixed-size array, so the compiler unrolls the genre loop and keeps them in
+// registers; the target of the caller decides how wide the adds are
+template <size_t N>
+__attribute__((always_inline)) inline void addFixedRows(const double* values, uint64_t stride, uint64_t unknownRow,
+                                                         const uint32_t* termIds, size_t count, double* scores) {
+    array<double, N> sums;
+    for (size_t g = 0; g < N; ++g) {
+        sums[g] = scores[g];
+    }
+    for (size_t i = 0; i < count; ++i) {
+        const double* row = values + (termIds[i] == CompiledModel::unknownTerm ? unknownRow : termIds[i]) * stride;
+        for (size_t g = 0; g < N; ++g) {
+            sums[g] += row[g];
+        }
+    }
+    for (size_t g = 0; g < N; ++g) {
+        scores[g] = sums[g];
+    }
+}
+
+// The same with every row scaled by its term's count: one row per distinct term
+template <size_t N>
+__attribute__((always_inline)) inline void addFixedWeightedRows(const double* values, uint64_t stride,
+                                                                 uint64_t unknownRow, const uint32_t* termIds,
+                                                                 const uint64_t* counts, size_t count, double* scores) {
+    array<double, N> sums;
+    for (size_t g = 0; g < N; ++g) {
+        sums[g] = scores[g];
+    }
+    for (size_t i = 0; i < count; ++i) {
+        const double* row = values + (termIds[i] == CompiledModel::unknownTerm ? unknownRow : termIds[i]) * stride;
+        double weight = static_cast<double>(counts[i]);
+        for (size_t g = 0; g < N; ++g) {
+            sums[g] += weight * row[g];
+        }
+    }
+    for (size_t g = 0; g < N; ++g) {
+        scores[g] = sums[g];
+    }
+}
+
+void addAnyRows(const double* values, uint64_t stride, uint64_t unknownRow, const uint32_t* termIds, size_t count,
+                size_t numGenres, double* scores) {
+    for (size_t i = 0; i < count; ++i) {
+        const double* row = values + (termIds[i] == CompiledModel::unknownTerm ? unknownRow : termIds[i]) * stride;
+        for (size_t g = 0; g < numGenres; ++g) {
+            scores[g] += row[g];
+        }
+    }
+}
+
+void addAnyWeightedRows(const double* values, uint64_t stride, uint64_t unknownRow, const uint32_t* termIds,
+                        const uint64_t* counts, size_t count, size_t numGenres, double* scores) {
+    for (size_t i = 0; i < count; ++i) {
+        const double* row = values + (termIds[i] == CompiledModel::unknownTerm ? unknownRow : termIds[i]) * stride;
+        double weight = static_cast<double>(counts[i]);
+        for (size_t g = 0; g < numGenres; ++g) {
+            scores[g] += weight * row[g];
+        }
+    }
+}
+
+struct GenericIsa {
+    template <size_t N>
+    static void addRows(const double* values, uint64_t stride, uint64_t unknownRow, const uint32_t* termIds,
+                        size_t count, size_t, double* scores) {
+        addFixedRows<N>(values, stride, unknownRow, termIds, count, scores);
+    }
+    template <size_t N>
+    static void addWeightedRows(const double* values, uint64_t stride, uint64_t unknownRow, const uint32_t* termIds,
+                                const uint64_t* counts, size_t count, size_t, double* scores) {
+        addFixedWeightedRows<N>(values, stride, unknownRow, termIds, counts, count, scores);
+    }
+};
+
+#ifdef POI_SCORE_KERNEL_X86
+
+struct AVX2Isa {
+    template <size_t N>
+    __attribute__((target("avx2")))
+    static void addRows(const double* values, uint64_t stride, uint64_t unknownRow, const uint32_t* termIds,
+                        size_t count, size_t, double* scores) {
+        addFixedRows<N>(values, stride, unknownRow, termIds, count, scores);
+    }
+    template <size_t N>
+    __attribute__((target("avx2")))
+    static void addWeightedRows(const double* values, uint64_t stride, uint64_t unknownRow, const uint32_t* termIds,
+                                const uint64_t* counts, size_t count, size_t, double* scores) {
+        addFixedWeightedRows<N>(values, stride, unknownRow, termIds, counts, count, scores);
+    }
+};
+
+// 512-bit registers have to be asked for; the default tuning stays at 256 bits
+struct AVX512Isa {
+    template <size_t N>
+    __attribute__((target("avx512f,prefer-vector-width=512")))
+    static void addRows(const double* values, uint64_t stride, uint64_t unknownRow, const uint32_t* termIds,
+                        size_t count, size_t, double* scores) {
+        addFixedRows<N>(values, stride, unknownRow, termIds, count, scores);
+    }
+    template <size_t N>
+    __attribute__((target("avx512f,prefer-vector-width=512")))
+    static void addWeightedRows(const double* values, uint64_t stride, uint64_t unknownRow, const uint32_t* termIds,
+                                const uint64_t* counts, size_t count, size_t, double* scores) {
+        addFixedWeightedRows<N>(values, stride, unknownRow, termIds, counts, count, scores);
+    }
+};
+
+#endif // POI_SCORE_KERNEL_X86
+
+// Entry g is the kernel for g + 1 genres
+template <typename Isa, size_t... Counts>
+constexpr array<AddRows, sizeof...(Counts)> kernelTable(index_sequence<Counts...>) {
+    return {{&Isa::template addRows<Counts + 1>...}};
+}
+
+template <typename Isa, size_t... Counts>
+constexpr array<AddWeightedRows, sizeof...(Counts)> weightedKernelTable(index_sequence<Counts...>) {
+    return {{&Isa::template addWeightedRows<Counts + 1>...}};
+}
+
+const auto genericKernels = kernelTable<GenericIsa>(make_index_sequence<ScoreKernel::maxSpecializedGenres>());
+const auto genericWeightedKernels =
+    weightedKernelTable<GenericIsa>(make_index_sequence<ScoreKernel::maxSpecializedGenres>());
+#ifdef POI_SCORE_KERNEL_X86
+const auto avx2Kernels = kernelTable<AVX2Isa>(make_index_sequence<ScoreKernel::maxSpecializedGenres>());
+const auto avx512Kernels = kernelTable<AVX512Isa>(make_index_sequence<ScoreKernel::maxSpecializedGenres>());
+const auto avx2WeightedKernels =
+    weightedKernelTable<AVX2Isa>(make_index_sequence<ScoreKernel::maxSpecializedGenres>());
+const auto avx512WeightedKernels =
+    weightedKernelTable<AVX512Isa>(make_index_sequence<ScoreKernel::maxSpecializedGenres>());
+#endif
+
+ScoreKernel::Isa detectIsa() {
+#ifdef POI_SCORE_KERNEL_X86
+    if (__builtin_cpu_supports("avx512f")) {
+        return ScoreKernel::Isa::AVX512;
+    }
+    if (__builtin_cpu_supports("avx2")) {
+        return ScoreKernel::Isa::AVX2;
+    }
+#endif
+    return ScoreKernel::Isa::Generic;
+}
+
+atomic<ScoreKernel::Isa> currentIsa{detectIsa()};
+
+} // namespace
+
+ScoreKernel::Isa ScoreKernel::bestIsa() {
+    static const Isa best = detectIsa();
+    return best;
+}
+
+ScoreKernel::Isa ScoreKernel::activeIsa() {
+    return currentIsa.load(memory_order_relaxed);
+}
+
+void ScoreKernel::setIsa(Isa isa) {
+    if (static_cast<int>(isa) > static_cast<int>(bestIsa())) {
+        isa = bestIsa();
+    }
+    currentIsa.store(isa, memory_order_relaxed);
+}
+
+const char* ScoreKernel::isaName(Isa isa) {
+    switch (isa) {
+    case Isa::AVX512: return "avx512";
+    case Isa::AVX2: return "avx2";
+    default: return "generic";
+    }
+}
+
+AddRows ScoreKernel::addRows(size_t numGenres) {
+    if (numGenres == 0 || numGenres > maxSpecializedGenres) {
+        return &addAnyRows;
+    }
+    switch (activeIsa()) {
+#ifdef POI_SCORE_KERNEL_X86
+    case Isa::AVX512: return avx512Kernels[numGenres - 1];
+    case Isa::AVX2: return avx2Kernels[numGenres - 1];
+#endif
+    default: return genericKernels[numGenres - 1];
+    }
+}
+
+AddWeightedRows ScoreKernel::addWeightedRows(size_t numGenres) {
+    if (numGenres == 0 || numGenres > maxSpecializedGenres) {
+        return &addAnyWeightedRows;
+    }
+    switch (activeIsa()) {
+#ifdef POI_SCORE_KERNEL_X86
+    case Isa::AVX512: return avx512WeightedKernels[numGenres - 1];
+    case Isa::AVX2: return avx2WeightedKernels[numGenres - 1];
+#endif
+    default: return genericWeightedKernels[numGenres - 1];
+    }
+}
@@ -0,0 +1,386 @@
+#include "server.hpp"
+#include "classifier.hpp"
+#include "logger.hpp"
+#include "thread_pool.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <limits>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace {
+
+const size_t readChunkSize = 64 << 10;
+const size_t maxLineBytes = 64 << 20;  // Longer lines end the connection
+
+void appendNumber(string& out, double value, const char* pattern) {
+    char number[32];
+    int length = snprintf(number, sizeof(number), pattern, value);
+    out.append(number, static_cast<size_t>(length));
+}
+
+double millisSince(chrono::steady_clock::time_point started) {
+    return chrono::duration<double, milli>(chrono::steady_clock::now() - started).count();
+}
+
+// Up to maxFields tab-separated fields; the last one takes the rest of the line
+vector<string_view> splitFields(string_view line, size_t maxFields) {
+    vector<string_view> fields;
+    while (fields.size() + 1 < maxFields) {
+        size_t tab = line.find('\t');
+        if (tab == string_view::npos) break;
+        fields.push_back(line.substr(0, tab));
+        line.remove_prefix(tab + 1);
+    }
+    fields.push_back(line);
+    return fields;
+}
+
+} // namespace
+
+// One client (or stdin/stdout); closed once the reader and every answer are done with it
+struct ClassificationServer::Connection {
+    int readFd;
+    int writeFd;
+    bool isSocket;
+    mutex writeMutex;
+
+    Connection(int readFd, int writeFd, bool isSocket) : readFd(readFd), writeFd(writeFd), isSocket(isSocket) {}
+    ~Connection() {
+        if (isSocket) {
+            close(readFd);
+        }
+    }
+};
+
+ClassificationServer::ClassificationServer(const ServerOptions& options, RuntimeMetrics& metrics)
+    : options(options), metrics(metrics), requests(max<size_t>(1, options.queueDepth)) {}
+
+ClassificationServer::~ClassificationServer() {
+    if (listenFd >= 0) close(listenFd);
+    if (wakePipe[0] >= 0) close(wakePipe[0]);
+    if (wakePipe[1] >= 0) close(wakePipe[1]);
+}
+
+bool ClassificationServer::run() {
+    bool useStdin = options.socketPath == "-";
+    if (pipe2(wakePipe, O_CLOEXEC) != 0) {
+        LOG_ERROR("Cannot create the wake-up pipe: " << strerror(errno));
+        return false;
+    }
+    if (!useStdin && !listenOnSocket()) {
+        return false;
+    }
+
+    for (int i = 0; i < options.workers; ++i) {
+        workers.push_back(ThreadPool::instance().start([this, i] { workerLoop(i); }));
+    }
+
+    if (useStdin) {
+        LOG_DEBUG("Serving requests from stdin with " << options.workers << " workers.");
+        {
+            lock_guard<mutex> lock(readersMutex);
+            ++activeReaders;
+        }
+        readLoop(make_shared<Connection>(STDIN_FILENO, STDOUT_FILENO, false));
+    } else {
+        LOG_INFO("Listening on " << options.socketPath << " with " << options.workers << " workers.");
+        acceptLoop();
+        unlink(options.socketPath.c_str());
+    }
+
+    // No new requests once every reader is out; then the workers answer what is queued
+    unique_lock<mutex> lock(readersMutex);
+    readersDone.wait(lock, [this] { return activeReaders == 0; });
+    lock.unlock();
+
+    requests.close();
+    for (auto& worker : workers) {
+        worker.get();
+    }
+    LOG_DEBUG("Server stopped.");
+    return true;
+}
+
+void ClassificationServer::stop() {
+    stopping.store(true);
+    if (wakePipe[1] >= 0) {
+        char byte = 0;
+        ssize_t ignored = write(wakePipe[1], &byte, 1);
+        (void)ignored;
+    }
+}
+
+bool ClassificationServer::listenOnSocket() {
+    sockaddr_un address{};
+    if (options.socketPath.size() >= sizeof(address.sun_path)) {
+        LOG_ERROR("Socket path is too long: " << options.socketPath);
+        return false;
+    }
+    address.sun_family = AF_UNIX;
+    memcpy(address.sun_path, options.socketPath.c_str(), options.socketPath.size() + 1);
+
+    // A socket left behind by an earlier daemon is replaced; any other file is not
+    struct stat existing;
+    if (lstat(options.socketPath.c_str(), &existing) == 0) {
+        if (!S_ISSOCK(existing.st_mode)) {
+            LOG_ERROR(options.socketPath << " exists and is not a socket.");
+            return false;
+        }
+        unlink(options.socketPath.c_str());
+    }
+
+    listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listenFd < 0 || bind(listenFd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 ||
+        listen(listenFd, SOMAXCONN) != 0) {
+        LOG_ERROR("Cannot listen on " << options.socketPath << ": " << strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+void ClassificationServer::acceptLoop() {
+    while (!stopping.load()) {
+        pollfd waiting[2] = {{listenFd, POLLIN, 0}, {wakePipe[0], POLLIN, 0}};
+        if (poll(waiting, 2, -1) < 0) {
+            if (errno == EINTR) continue;
+            LOG_ERROR("poll failed: " << strerror(errno));
+            return;
+        }
+        if (waiting[1].revents != 0) {
+            return;
+        }
+
+        int clientFd = accept4(listenFd, nullptr, nullptr, SOCK_CLOEXEC);
+        if (clientFd < 0) {
+            if (errno != EINTR && errno != ECONNABORTED) {
+                LOG_ERROR("accept failed: " << strerror(errno));
+            }
+            continue;
+        }
+
+        auto connection = make_shared<Connection>(clientFd, clientFd, true);
+        {
+            lock_guard<mutex> lock(readersMutex);
+            ++activeReaders;
+        }
+        thread(&ClassificationServer::readLoop, this, std::move(connection)).detach();
+    }
+}
+
+void ClassificationServer::readLoop(shared_ptr<Connection> connection) {
+    string pending;
+    vector<char> chunk(readChunkSize);
+
+    while (!stopping.load()) {
+        // Signals may land on any thread, so stop() wakes every reader through the pipe
+        pollfd waiting[2] = {{connection->readFd, POLLIN, 0}, {wakePipe[0], POLLIN, 0}};
+        if (poll(waiting, 2, -1) < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        if (waiting[1].revents != 0) break;
+
+        ssize_t count = read(connection->readFd, chunk.data(), chunk.size());
+        if (count < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        if (count == 0) break;
+        pending.append(chunk.data(), static_cast<size_t>(count));
+
+        size_t start = 0;
+        for (size_t end; (end = pending.find('\n', start)) != string::npos; start = end + 1) {
+            string line = pending.substr(start, end - start);
+            if (!line.empty() && line.back() == '\r') line.pop_back();
+            if (line.empty()) continue;
+
+            Request request;
+            string error;
+            if (!parseRequest(line, request, error)) {
+                sendAll(*connection, request.id + "\terror\t" + error + "\n");
+                continue;
+            }
+            request.connection = connection;
+            requests.push(std::move(request));
+        }
+        pending.erase(0, start);
+        if (pending.size() > maxLineBytes) {
+            sendAll(*connection, "\terror\trequest line too long\n");
+            break;
+        }
+    }
+
+    connection.reset();
+    lock_guard<mutex> lock(readersMutex);
+    if (--activeReaders == 0) {
+        readersDone.notify_all();
+    }
+}
+
+bool ClassificationServer::parseRequest(const string& line, Request& request, string& error) {
+    vector<string_view> fields = splitFields(line, 4);
+    request.id = string(fields[0]);
+    if (fields.size() < 4) {
+        error = "expected <id> TAB <deadline ms> TAB file|text TAB <payload>";
+        return false;
+    }
+
+    long long deadlineMs;
+    try {
+        size_t used;
+        string deadline(fields[1]);
+        deadlineMs = stoll(deadline, &used);
+        if (used != deadline.size() || deadlineMs < 0) throw invalid_argument(deadline);
+    } catch (...) {
+        error = "invalid deadline";
+        return false;
+    }
+
+    if (fields[2] == "file") {
+        request.inlineText = false;
+    } else if (fields[2] == "text") {
+        request.inlineText = true;
+    } else {
+        error = "unknown request kind '" + string(fields[2]) + "'";
+        return false;
+    }
+    request.payload = string(fields[3]);
+    request.received = chrono::steady_clock::now();
+    request.deadline = deadlineMs == 0 ? chrono::steady_clock::time_point::max()
+                                       : request.received + chrono::milliseconds(deadlineMs);
+    return true;
+}
+
+void ClassificationServer::workerLoop(int workerId) {
+    vector<Request> batch;
+    Request request;
+    while (true) {
+        {
+            // Waiting for a request, the worker's core can help score a large one in ranges
+            ThreadPool::Parked parked;
+            if (!requests.pop(request)) break;
+        }
+        batch.push_back(std::move(request));
+        while (batch.size() < options.maxBatch && requests.tryPop(request)) {
+            batch.push_back(std::move(request));
+        }
+        handleBatch(batch, workerId);
+        batch.clear();
+    }
+}
+
+void ClassificationServer::handleBatch(vector<Request>& batch, int workerId) {
+    // Earliest deadline first; requests without one keep their arrival order at the back
+    stable_sort(batch.begin(), batch.end(),
+                [](const Request& a, const Request& b) { return a.deadline < b.deadline; });
+
+    // One buffer, and so one write, per connection in the batch
+    vector<pair<Connection*, string>> replies;
+    for (Request& request : batch) {
+        auto reply = find_if(replies.begin(), replies.end(),
+                             [&](const pair<Connection*, string>& entry) { return entry.first == request.connection.get(); });
+        if (reply == replies.end()) {
+            replies.emplace_back(request.connection.get(), string());
+            reply = replies.end() - 1;
+        }
+        answer(request, workerId, reply->second);
+    }
+
+    auto started = chrono::steady_clock::now();
+    for (auto& reply : replies) {
+        sendAll(*reply.first, reply.second);
+    }
+    metrics.worker(workerId).stage(Stage::Report).record(chrono::steady_clock::now() - started);
+}
+
+void ClassificationServer::answer(Request& request, int workerId, string& out) {
+    WorkerMetrics& stats = metrics.worker(workerId);
+    auto started = chrono::steady_clock::now();
+    stats.stage(Stage::QueueWait).record(started - request.received);
+
+    out += request.id;
+    if (started > request.deadline) {
+        stats.timeouts.fetch_add(1, memory_order_relaxed);
+        out += "\ttimeout\t";
+        appendNumber(out, millisSince(request.received), "%.3f");
+        out += '\n';
+        return;
+    }
+
+    Classifier& classifier = Classifier::getInstance();
+    ClassificationResult result;
+    try {
+        result = request.inlineText ? classifier.classifyBuffer(request.payload.data(), request.payload.size())
+                                    : classifier.classifyFile(request.payload);
+    } catch (const exception& e) {
+        stats.errors.fetch_add(1, memory_order_relaxed);
+        out += "\terror\t";
+        out += e.what();
+        out += '\n';
+        return;
+    }
+    auto finished = chrono::steady_clock::now();
+
+    stats.stage(Stage::Read).record(result.readNanos);
+    stats.stage(Stage::Tokenize).record(result.tokenizeNanos);
+    stats.stage(Stage::Score).record(result.scoreNanos);
+    stats.files.fetch_add(1, memory_order_relaxed);
+    stats.bytes.fetch_add(result.bytes, memory_order_relaxed);
+    stats.tokens.fetch_add(result.tokens, memory_order_relaxed);
+    stats.skippedTokens.fetch_add(result.skippedTokens, memory_order_relaxed);
+    stats.skippedBytes.fetch_add(result.skippedBytes, memory_order_relaxed);
+    stats.busyNanos.fetch_add(chrono::duration_cast<chrono::nanoseconds>(finished - started).count(),
+                              memory_order_relaxed);
+
+    // Scored too late to be of use
+    if (finished > request.deadline) {
+        stats.timeouts.fetch_add(1, memory_order_relaxed);
+        out += "\ttimeout\t";
+        appendNumber(out, millisSince(request.received), "%.3f");
+        out += '\n';
+        return;
+    }
+
+    const CompiledModel& model = classifier.getModel();
+    out += "\tok\t";
+    out += result.genre;
+    out += '\t';
+    appendNumber(out, result.logProbability, "%.17g");
+    out += '\t';
+    out += to_string(result.tokens);
+    out += '\t';
+    appendNumber(out, millisSince(request.received), "%.3f");
+    for (size_t g = 0; g < result.scores.size(); ++g) {
+        out += '\t';
+        out += model.genreName(g);
+        out += '=';
+        appendNumber(out, result.scores[g], "%.17g");
+    }
+    out += '\n';
+}
+
+void ClassificationServer::sendAll(Connection& connection, const string& data) {
+    lock_guard<mutex> lock(connection.writeMutex);
+    size_t sent = 0;
+    while (sent < data.size()) {
+        // MSG_NOSIGNAL: a client that went away must not kill the daemon with SIGPIPE
+        ssize_t count = connection.isSocket
+            ? send(connection.writeFd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL)
+            : write(connection.writeFd, data.data() + sent, data.size() - sent);
+        if (count < 0) {
+            if (errno == EINTR) continue;
+            LOG_DEBUG("Dropping answers for a closed connection: " << strerror(errno));
+            return;
+        }
+        sent += static_cast<size_t>(count);
+    }
+}
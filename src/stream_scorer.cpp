@@ -0,0 +1,184 @@
+#include "stream_scorer.hpp"
+#include "config.hpp"
+#include "tokenizer.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+using namespace std;
+
+StreamScorer::StreamScorer(const CompiledModel& model, size_t blockSize) : model(model), buffer(blockSize) {
+    reset();
+}
+
+void StreamScorer::reset(bool startFromPriors) {
+    carried = 0;
+    tokensScored = 0;
+    bag.clear();
+    tokenizeTime = scoreTime = 0;
+    documentBytes = bytesCommitted = 0;
+    settled = false;
+    winner = 0;
+    tokensSkipped = 0;
+    contending.assign(model.genreCount(), 1);
+    fromPriors = startFromPriors;
+    if (startFromPriors) {
+        logProbabilities.assign(model.logPriors(), model.logPriors() + model.genreCount());
+    } else {
+        logProbabilities.assign(model.genreCount(), 0.0);
+    }
+}
+
+char* StreamScorer::prepare(size_t& capacity) {
+    // A single token longer than the whole buffer: grow instead of splitting it
+    if (carried == buffer.size()) {
+        buffer.resize(buffer.size() * 2);
+    }
+    capacity = buffer.size() - carried;
+    return buffer.data() + carried;
+}
+
+void StreamScorer::commit(size_t bytes) {
+    bytesCommitted += bytes;
+    scanBuffer(carried + bytes, false);
+}
+
+void StreamScorer::feed(const char* data, size_t size) {
+    while (size > 0) {
+        size_t capacity;
+        char* target = prepare(capacity);
+        size_t chunk = min(capacity, size);
+        memcpy(target, data, chunk);
+        commit(chunk);
+        data += chunk;
+        size -= chunk;
+    }
+}
+
+void StreamScorer::finish() {
+    scanBuffer(carried, true);
+    scoreBag();
+}
+
+void StreamScorer::scoreBag() {
+    if (bag.empty()) {
+        return;
+    }
+    auto started = chrono::steady_clock::now();
+    model.accumulate(bag, logProbabilities.data());
+    bag.clear();
+    scoreTime += chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - started).count();
+}
+
+void StreamScorer::addTokens(const vector<string_view>& words, uint64_t tokensAfter) {
+    if (settled) {
+        tokensSkipped += words.size();
+        return;
+    }
+    // A slice of a document (no priors) says nothing about the winner on its own
+    if (contributionBounds == nullptr || !fromPriors) {
+        addRange(words.data(), words.size());
+        return;
+    }
+
+    for (size_t start = 0; start < words.size(); start += checkInterval) {
+        size_t count = min(checkInterval, words.size() - start);
+        addRange(words.data() + start, count);
+        size_t left = words.size() - start - count;
+        if (tokensAfter != numeric_limits<uint64_t>::max() && prune(left + tokensAfter)) {
+            tokensSkipped += left;
+            return;
+        }
+    }
+}
+
+bool StreamScorer::countingWords() const {
+    return documentBytes >= Config::termBagThreshold && (contributionBounds == nullptr || !fromPriors);
+}
+
+void StreamScorer::addRange(const string_view* words, size_t count) {
+    tokensScored += count;
+    if (countingWords()) {
+        bag.add(words, count);  // Looked up and scored once per distinct word by finish()
+        return;
+    }
+
+    // One hash per word, then the rows are added up in order
+    termIds.resize(count);
+    for (size_t i = 0; i < count; ++i) {
+        termIds[i] = model.lookup(words[i]);
+    }
+    model.accumulate(termIds.data(), count, logProbabilities.data());
+}
+
+bool StreamScorer::prune(uint64_t tokensAfter) {
+    size_t numGenres = model.genreCount();
+    const double* scores = logProbabilities.data();
+
+    // Leader among the genres still in the race (the first of equals, as in the final argmax)
+    size_t leader = numGenres;
+    for (size_t g = 0; g < numGenres; ++g) {
+        if (contending[g] && (leader == numGenres || scores[g] > scores[leader])) {
+            leader = g;
+        }
+    }
+    if (leader == numGenres || !isfinite(scores[leader])) {
+        return false;
+    }
+
+    // g cannot win if, even gaining the most it can on every remaining token, it stays below.
+    // The slack (far above the rounding error of summing this many terms) keeps it exact.
+    double remaining = static_cast<double>(tokensAfter);
+    const double* maxMagnitude = contributionBounds + numGenres * numGenres;
+    size_t left = 0;
+    for (size_t g = 0; g < numGenres; ++g) {
+        if (!contending[g] || g == leader) {
+            left += contending[g];
+            continue;
+        }
+        if (scores[g] == -HUGE_VAL) {
+            contending[g] = 0;  // A zero prior never recovers
+            continue;
+        }
+        double reach = scores[g] + remaining * contributionBounds[g * numGenres + leader];
+        double slack = 1e-6 * (fabs(scores[g]) + fabs(scores[leader]) +
+                               remaining * (maxMagnitude[g] + maxMagnitude[leader]));
+        if (reach + slack < scores[leader]) {
+            contending[g] = 0;
+        } else {
+            ++left;
+        }
+    }
+
+    if (left == 1) {
+        settled = true;
+        winner = leader;
+    }
+    return settled;
+}
+
+void StreamScorer::scanBuffer(size_t filled, bool finalBlock) {
+    // At most the carried token plus one token per two unread bytes can still follow
+    uint64_t tokensAfter = 0;
+    if (!finalBlock) {
+        bool sizeKnown = documentBytes > 0 && documentBytes >= bytesCommitted;
+        tokensAfter = sizeKnown ? 1 + (documentBytes - bytesCommitted + 1) / 2 : numeric_limits<uint64_t>::max();
+    }
+
+    auto started = chrono::steady_clock::now();
+    tokens.clear();
+    string_view partial = Tokenizer::tokenize(buffer.data(), filled, tokens, finalBlock);
+    auto tokenized = chrono::steady_clock::now();
+    addTokens(tokens, tokensAfter);
+    auto scored = chrono::steady_clock::now();
+    tokenizeTime += chrono::duration_cast<chrono::nanoseconds>(tokenized - started).count();
+    scoreTime += chrono::duration_cast<chrono::nanoseconds>(scored - tokenized).count();
+
+    // The partial token is already normalized; move it to the front for the next block
+    carried = partial.size();
+    if (carried > 0 && partial.data() != buffer.data()) {
+        memmove(buffer.data(), partial.data(), carried);
+    }
+}
@@ -0,0 +1,121 @@
+#include "task_scheduler.hpp"
+#include "thread_pool.hpp"
+
+using namespace std;
+
+TaskScheduler::TaskScheduler(int numWorkers, size_t queueCapacity)
+    : outstanding(make_unique<atomic<uint64_t>[]>(numWorkers)) {
+    for (int i = 0; i < numWorkers; ++i) {
+        queues.push_back(make_unique<BoundedQueue<FileTask>>(queueCapacity));
+        outstanding[i].store(0, memory_order_relaxed);
+    }
+    totalCapacity = numWorkers > 0 ? queues[0]->capacity() * numWorkers : 0;
+}
+
+void TaskScheduler::submit(int workerId, FileTask&& task) {
+    int numWorkers = getNumWorkers();
+
+    while (true) {
+        task.enqueuedAt = chrono::steady_clock::now();
+
+        // Counted before the push, like the bytes below: a worker that took the task first
+        // would wrap pendingTasks, and parked workers would then spin on empty queues
+        pendingTasks.fetch_add(1);
+
+        // Preferred worker first, then any queue with room left
+        for (int i = 0; i < numWorkers; ++i) {
+            int target = (workerId + i) % numWorkers;
+            // Charged before the push so a fast worker can never release it first
+            uint64_t bytes = task.bytes;
+            task.assignedWorker = target;
+            outstanding[target].fetch_add(bytes, memory_order_relaxed);
+            if (queues[target]->tryPush(std::move(task))) {
+                if (sleepingWorkers.load() > 0) {
+                    lock_guard<mutex> lock(parkMutex);
+                    workAvailable.notify_one();
+                }
+                return;
+            }
+            outstanding[target].fetch_sub(bytes, memory_order_relaxed);
+        }
+        pendingTasks.fetch_sub(1);
+        wakeProducer();  // Another producer may have seen the count this task held for a moment
+
+        // Every queue is full: wait until a worker frees a slot
+        unique_lock<mutex> lock(parkMutex);
+        waitingProducers.fetch_add(1);
+        spaceAvailable.wait(lock, [this] { return pendingTasks.load() < totalCapacity; });
+        waitingProducers.fetch_sub(1);
+    }
+}
+
+bool TaskScheduler::tryTake(int workerId, FileTask& task) {
+    if (queues[workerId]->tryPop(task)) {
+        return true;
+    }
+
+    // Own queue is empty: steal from the worker with the most outstanding work first...
+    int numWorkers = getNumWorkers();
+    int victim = -1;
+    uint64_t mostBytes = 0;
+    for (int i = 0; i < numWorkers; ++i) {
+        uint64_t bytes = outstandingBytes(i);
+        if (i != workerId && queues[i]->sizeApprox() > 0 && (victim < 0 || bytes > mostBytes)) {
+            victim = i;
+            mostBytes = bytes;
+        }
+    }
+    if (victim >= 0 && queues[victim]->tryPop(task)) {
+        stealCount.fetch_add(1, memory_order_relaxed);
+        return true;
+    }
+
+    // ...then from anyone, starting with the neighbour
+    for (int i = 1; i < numWorkers; ++i) {
+        if (queues[(workerId + i) % numWorkers]->tryPop(task)) {
+            stealCount.fetch_add(1, memory_order_relaxed);
+            return true;
+        }
+    }
+    return false;
+}
+
+void TaskScheduler::wakeProducer() {
+    if (waitingProducers.load() > 0) {
+        lock_guard<mutex> lock(parkMutex);
+        spaceAvailable.notify_all();
+    }
+}
+
+bool TaskScheduler::next(int workerId, FileTask& task) {
+    while (true) {
+        if (tryTake(workerId, task)) {
+            pendingTasks.fetch_sub(1);
+            wakeProducer();
+            return true;
+        }
+
+        // Parked, the worker's core can help another worker score a large file in ranges
+        ThreadPool::Parked parked;
+        unique_lock<mutex> lock(parkMutex);
+        sleepingWorkers.fetch_add(1);
+        workAvailable.wait(lock, [this] { return pendingTasks.load() > 0 || stopping.load(); });
+        sleepingWorkers.fetch_sub(1);
+
+        if (pendingTasks.load() == 0 && stopping.load()) {
+            return false;
+        }
+    }
+}
+
+void TaskScheduler::taskDone(const FileTask& task) {
+    if (task.assignedWorker >= 0) {
+        outstanding[task.assignedWorker].fetch_sub(task.bytes, memory_order_relaxed);
+    }
+}
+
+void TaskScheduler::shutdown() {
+    lock_guard<mutex> lock(parkMutex);
+    stopping.store(true);
+    workAvailable.notify_all();
+}
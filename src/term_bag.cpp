@@ -0,0 +1,108 @@
+#include "term_bag.hpp"
+#include <cstring>
+
+using namespace std;
+
+namespace {
+
+constexpr size_t initialSlots = 1 << 10;
+constexpr uint64_t mixMultiplier = 0x9E3779B97F4A7C15ull;
+
+} // namespace
+
+TermBag::TermBag() {
+    slots.assign(initialSlots, Slot{0, emptySlot});
+    slotMask = slots.size() - 1;
+}
+
+void TermBag::clear() {
+    for (uint32_t slot : entrySlots) {
+        slots[slot].entry = emptySlot;
+    }
+    entries.clear();
+    counts.clear();
+    entrySlots.clear();
+    characters.clear();
+    tokens = 0;
+}
+
+uint64_t TermBag::hashWord(string_view word) {
+    // Eight bytes per multiply; only needs to spread the words of one document, not to be
+    // the model's hash (CompiledModel::lookup() runs once per distinct word)
+    const char* pos = word.data();
+    size_t left = word.size();
+    uint64_t hash = left * mixMultiplier;
+    while (left > 8) {
+        uint64_t chunk;
+        memcpy(&chunk, pos, 8);
+        hash = (hash ^ chunk) * mixMultiplier;
+        hash ^= hash >> 29;
+        pos += 8;
+        left -= 8;
+    }
+
+    // The last 1 to 8 bytes, read without going past the word
+    uint64_t tail = 0;
+    if (left >= 4) {
+        uint32_t head, end;
+        memcpy(&head, pos, 4);
+        memcpy(&end, pos + left - 4, 4);
+        tail = (uint64_t(head) << 32) | end;
+    } else if (left > 0) {
+        tail = (uint64_t(static_cast<unsigned char>(pos[0])) << 16) |
+               (uint64_t(static_cast<unsigned char>(pos[left / 2])) << 8) | static_cast<unsigned char>(pos[left - 1]);
+    }
+    hash = (hash ^ tail) * mixMultiplier;
+    return hash ^ (hash >> 32);
+}
+
+void TermBag::add(string_view word, uint64_t count) {
+    tokens += count;
+    uint64_t hash = hashWord(word);
+    uint32_t tag = static_cast<uint32_t>(hash >> 32);
+
+    size_t slot = hash & slotMask;
+    for (; slots[slot].entry != emptySlot; slot = (slot + 1) & slotMask) {
+        if (slots[slot].tag == tag) {
+            uint32_t entry = slots[slot].entry;
+            if (entries[entry].length == word.size() &&
+                memcmp(characters.data() + entries[entry].offset, word.data(), word.size()) == 0) {
+                counts[entry] += count;
+                return;
+            }
+        }
+    }
+
+    // A new word
+    uint32_t entry = static_cast<uint32_t>(entries.size());
+    entries.push_back(Entry{static_cast<uint32_t>(characters.size()), static_cast<uint32_t>(word.size())});
+    characters.insert(characters.end(), word.begin(), word.end());
+    counts.push_back(count);
+    slots[slot] = Slot{tag, entry};
+    entrySlots.push_back(static_cast<uint32_t>(slot));
+    if (entries.size() * 2 > slots.size()) {
+        grow();
+    }
+}
+
+void TermBag::add(const string_view* words, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        add(words[i]);
+    }
+}
+
+void TermBag::grow() {
+    slots.assign(slots.size() * 2, Slot{0, emptySlot});
+    slotMask = slots.size() - 1;
+
+    // Entries keep their order; only their slots move
+    for (size_t entry = 0; entry < entries.size(); ++entry) {
+        uint64_t hash = hashWord(word(entry));
+        size_t slot = hash & slotMask;
+        while (slots[slot].entry != emptySlot) {
+            slot = (slot + 1) & slotMask;
+        }
+        slots[slot] = Slot{static_cast<uint32_t>(hash >> 32), static_cast<uint32_t>(entry)};
+        entrySlots[entry] = static_cast<uint32_t>(slot);
+    }
+}
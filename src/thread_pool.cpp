@@ -0,0 +1,366 @@
+#include "thread_pool.hpp"
+#include "logger.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <pthread.h>
+#include <sched.h>
+
+using namespace std;
+namespace fs = filesystem;
+
+namespace {
+
+int configuredThreads = 0;
+bool configuredPin = false;
+atomic<bool> poolCreated{false};
+
+// Node of the calling thread when it is bound to one; -1 otherwise
+thread_local int threadNode = -1;
+// Whether the calling thread is a pool thread running a job
+thread_local bool inPoolJob = false;
+
+// "0-3,8,10-11" as written in sysfs
+vector<int> parseCpuList(const string& text) {
+    vector<int> cpus;
+    stringstream ranges(text);
+    string range;
+    while (getline(ranges, range, ',')) {
+        int first, last;
+        char dash;
+        stringstream parts(range);
+        if (!(parts >> first)) continue;
+        last = (parts >> dash >> last) && dash == '-' ? last : first;
+        for (int cpu = first; cpu <= last; ++cpu) {
+            cpus.push_back(cpu);
+        }
+    }
+    return cpus;
+}
+
+// CPUs per period allowed to the process's cgroup; 0 without a quota
+double readCpuQuota() {
+    // cgroup v2: the process's own group first, then the root
+    string group;
+    ifstream cgroups("/proc/self/cgroup");
+    for (string line; getline(cgroups, line);) {
+        if (line.rfind("0::", 0) == 0) {
+            group = line.substr(3);
+        }
+    }
+    for (const string& path : {"/sys/fs/cgroup" + group + "/cpu.max", string("/sys/fs/cgroup/cpu.max")}) {
+        ifstream file(path);
+        string quota;
+        long long period;
+        if (file >> quota >> period) {
+            if (quota == "max" || period <= 0) return 0.0;
+            long long microseconds = atoll(quota.c_str());
+            return microseconds > 0 ? static_cast<double>(microseconds) / period : 0.0;
+        }
+    }
+
+    // cgroup v1 (a quota of -1 means none)
+    ifstream quotaFile("/sys/fs/cgroup/cpu/cpu.cfs_quota_us");
+    ifstream periodFile("/sys/fs/cgroup/cpu/cpu.cfs_period_us");
+    long long quota, period;
+    if (quotaFile >> quota && periodFile >> period && quota > 0 && period > 0) {
+        return static_cast<double>(quota) / period;
+    }
+    return 0.0;
+}
+
+// Shared by the participants of one parallelFor
+struct Loop {
+    size_t count;
+    const function<void(size_t, size_t)>* body;
+    atomic<size_t> next{0};
+
+    mutex doneMutex;
+    condition_variable finished;
+    size_t done = 0;
+    exception_ptr error;
+
+    void run(size_t participant) {
+        size_t completed = 0;
+        for (size_t index; (index = next.fetch_add(1, memory_order_relaxed)) < count;) {
+            try {
+                (*body)(index, participant);
+            } catch (...) {
+                lock_guard<mutex> lock(doneMutex);
+                if (!error) error = current_exception();
+            }
+            ++completed;
+        }
+        if (completed > 0) {
+            lock_guard<mutex> lock(doneMutex);
+            done += completed;
+            if (done == count) finished.notify_all();
+        }
+    }
+};
+
+} // namespace
+
+int CpuTopology::usableThreads() const {
+    int usable = static_cast<int>(cpus.size());
+    if (quotaCpus > 0.0) {
+        usable = min(usable, static_cast<int>(ceil(quotaCpus)));
+    }
+    return max(1, usable);
+}
+
+CpuTopology CpuTopology::detect() {
+    CpuTopology topology;
+
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) == 0) {
+        for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+            if (CPU_ISSET(cpu, &allowed)) topology.cpus.push_back(cpu);
+        }
+    }
+    if (topology.cpus.empty()) {
+        for (int cpu = 0; cpu < static_cast<int>(max(1u, thread::hardware_concurrency())); ++cpu) {
+            topology.cpus.push_back(cpu);
+        }
+    }
+
+    // Node ids as sysfs has them (CPUs it does not list count as node 0), then renumbered densely
+    map<int, int> sysfsNode;
+    error_code error;
+    for (const auto& entry : fs::directory_iterator("/sys/devices/system/node", error)) {
+        string name = entry.path().filename().string();
+        if (name.rfind("node", 0) != 0 || name.size() == 4 || !isdigit(static_cast<unsigned char>(name[4]))) continue;
+        ifstream cpuList(entry.path() / "cpulist");
+        string text;
+        if (getline(cpuList, text)) {
+            for (int cpu : parseCpuList(text)) {
+                sysfsNode[cpu] = atoi(name.c_str() + 4);
+            }
+        }
+    }
+    map<int, int> denseNode;
+    for (int cpu : topology.cpus) {
+        denseNode.emplace(sysfsNode.count(cpu) ? sysfsNode[cpu] : 0, 0);
+    }
+    int nextNode = 0;
+    for (auto& nodeEntry : denseNode) {
+        nodeEntry.second = nextNode++;
+    }
+    topology.nodeCount = max(1, nextNode);
+
+    auto nodeOf = [&](int cpu) { return denseNode[sysfsNode.count(cpu) ? sysfsNode[cpu] : 0]; };
+    stable_sort(topology.cpus.begin(), topology.cpus.end(), [&](int a, int b) { return nodeOf(a) < nodeOf(b); });
+    for (int cpu : topology.cpus) {
+        topology.cpuNodes.push_back(nodeOf(cpu));
+    }
+
+    topology.quotaCpus = readCpuQuota();
+    return topology;
+}
+
+void ThreadPool::configure(int threads, bool pin) {
+    if (poolCreated.load()) {
+        LOG_ERROR("The thread pool is already running; its size and pinning stay as they are.");
+        return;
+    }
+    configuredThreads = threads;
+    configuredPin = pin;
+}
+
+ThreadPool& ThreadPool::instance() {
+    static ThreadPool pool(configuredThreads, configuredPin);
+    return pool;
+}
+
+ThreadPool::ThreadPool(int threads, bool pinThreads) : cpuTopology(CpuTopology::detect()), pin(pinThreads) {
+    poolCreated.store(true);
+    baseThreads = static_cast<size_t>(threads > 0 ? threads : cpuTopology.usableThreads());
+
+    lock_guard<mutex> lock(jobsMutex);
+    for (size_t i = 0; i < baseThreads; ++i) {
+        spawnThread();
+    }
+    LOG_DEBUG("Thread pool: " << baseThreads << " threads over " << cpuTopology.cpus.size() << " CPUs in "
+              << cpuTopology.nodeCount << " NUMA node(s)"
+              << (cpuTopology.quotaCpus > 0.0 ? ", cgroup quota " + to_string(cpuTopology.quotaCpus) + " CPUs" : "")
+              << (pin ? ", pinned." : "."));
+}
+
+void ThreadPool::shutdown() {
+    if (poolCreated.load()) {
+        instance().stop();
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    stop();
+}
+
+void ThreadPool::stop() {
+    {
+        lock_guard<mutex> lock(jobsMutex);
+        stopping = true;
+    }
+    jobAvailable.notify_all();
+    for (auto& thread : threads) {
+        if (thread.joinable()) {
+            thread.join();
+        }
+    }
+}
+
+ThreadPool::Parked::Parked() {
+    if (inPoolJob) {
+        instance().parkedJobs.fetch_add(1);
+        counted = true;
+    }
+}
+
+ThreadPool::Parked::~Parked() {
+    if (counted) {
+        instance().parkedJobs.fetch_sub(1);
+    }
+}
+
+void ThreadPool::spawnThread() {
+    threads.emplace_back(&ThreadPool::threadLoop, this, threads.size());
+}
+
+void ThreadPool::bindToCpus(const vector<int>& cpus) const {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : cpus) {
+        CPU_SET(cpu, &set);
+    }
+    int error = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if (error != 0) {
+        LOG_DEBUG("Could not pin a thread to CPU " << cpus.front() << ": error " << error);
+    }
+}
+
+void ThreadPool::threadLoop(size_t index) {
+    if (pin) {
+        // Threads past the CPU count (the pool grew) wrap around
+        size_t slot = index % cpuTopology.cpus.size();
+        bindToCpus({cpuTopology.cpus[slot]});
+        threadNode = cpuTopology.cpuNodes[slot];
+    }
+
+    unique_lock<mutex> lock(jobsMutex);
+    while (true) {
+        ++waitingThreads;
+        jobAvailable.wait(lock, [this] { return stopping || !jobs.empty(); });
+        --waitingThreads;
+        if (jobs.empty()) {
+            return;
+        }
+        function<void()> job = std::move(jobs.front());
+        jobs.pop_front();
+        ++runningJobs;
+        lock.unlock();
+        inPoolJob = true;
+        job();
+        inPoolJob = false;
+        lock.lock();
+        --runningJobs;
+    }
+}
+
+int ThreadPool::currentNode() const {
+    if (threadNode >= 0 || cpuTopology.nodeCount == 1) {
+        return max(threadNode, 0);
+    }
+    int cpu = sched_getcpu();
+    for (size_t i = 0; i < cpuTopology.cpus.size(); ++i) {
+        if (cpuTopology.cpus[i] == cpu) return cpuTopology.cpuNodes[i];
+    }
+    return 0;
+}
+
+future<void> ThreadPool::start(function<void()> job) {
+    // std::function needs a copyable target
+    auto task = make_shared<packaged_task<void()>>(std::move(job));
+    future<void> finished = task->get_future();
+
+    lock_guard<mutex> lock(jobsMutex);
+    jobs.emplace_back([task] { (*task)(); });
+    if (waitingThreads < jobs.size()) {
+        spawnThread();
+    }
+    jobAvailable.notify_one();
+    return finished;
+}
+
+void ThreadPool::parallelFor(size_t count, const function<void(size_t, size_t)>& body) {
+    if (count == 0) {
+        return;
+    }
+    if (parallelism(count) == 1) {
+        for (size_t index = 0; index < count; ++index) {
+            body(index, 0);
+        }
+        return;
+    }
+
+    auto loop = make_shared<Loop>();
+    loop->count = count;
+    loop->body = &body;
+    {
+        // Helpers take the cores free right now: jobs running or queued hold one each, except
+        // parked ones, and a caller from outside the pool holds one too. A parked job that wakes
+        // while the loop runs shares its core until the helpers are done; late helpers find
+        // every index taken and leave.
+        lock_guard<mutex> lock(jobsMutex);
+        size_t parked = min(parkedJobs.load(), runningJobs);
+        size_t busy = runningJobs - parked + jobs.size() + (inPoolJob ? 0 : 1);
+        size_t freeCores = baseThreads > busy ? baseThreads - busy : 0;
+        size_t helpers = min(parallelism(count) - 1, freeCores);
+        size_t idle = waitingThreads > jobs.size() ? waitingThreads - jobs.size() : 0;
+        for (size_t participant = 1; participant <= helpers; ++participant) {
+            jobs.emplace_back([loop, participant] { loop->run(participant); });
+            if (participant > idle) {
+                spawnThread();
+            }
+            jobAvailable.notify_one();
+        }
+    }
+
+    loop->run(0);
+    unique_lock<mutex> lock(loop->doneMutex);
+    loop->finished.wait(lock, [&] { return loop->done == count; });
+    if (loop->error) {
+        rethrow_exception(loop->error);
+    }
+}
+
+void ThreadPool::runOnNode(int node, const function<void()>& job) {
+    vector<int> nodeCpus;
+    for (size_t i = 0; i < cpuTopology.cpus.size(); ++i) {
+        if (cpuTopology.cpuNodes[i] == node) nodeCpus.push_back(cpuTopology.cpus[i]);
+    }
+    if (!pin || nodeCpus.empty()) {
+        job();
+        return;
+    }
+
+    exception_ptr error;
+    thread bound([&] {
+        bindToCpus(nodeCpus);
+        threadNode = node;
+        try {
+            job();
+        } catch (...) {
+            error = current_exception();
+        }
+    });
+    bound.join();
+    if (error) {
+        rethrow_exception(error);
+    }
+}
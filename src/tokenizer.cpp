@@ -0,0 +1,224 @@
+#include "tokenizer.hpp"
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define POI_TOKENIZER_X86 1
+#endif
+
+using namespace std;
+
+namespace {
+
+enum ByteClass : uint8_t { Keep = 0, Space = 1, Drop = 2 };
+
+struct ByteTables {
+    array<uint8_t, 256> byteClass;
+    array<char, 256> folded;
+
+    ByteTables() {
+        for (int c = 0; c < 256; ++c) {
+            folded[c] = static_cast<char>(c);
+            if (c >= 0x80 || (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z')) {
+                byteClass[c] = Keep;
+            } else if (c >= 'A' && c <= 'Z') {
+                byteClass[c] = Keep;
+                folded[c] = static_cast<char>(c + ('a' - 'A'));
+            } else if (c == ' ' || (c >= '\t' && c <= '\r')) {
+                byteClass[c] = Space;
+            } else {
+                byteClass[c] = Drop;
+            }
+        }
+    }
+};
+
+const ByteTables tables;
+
+// Scan state shared by the kernels. Tokens are compacted in place: write trails read
+// only inside a token that had bytes dropped, and jumps back to read at every space.
+struct ScanState {
+    char* data;
+    size_t write;
+    size_t tokenStart;
+    vector<string_view>& tokens;
+
+    void endToken(size_t nextStart) {
+        if (write > tokenStart) {
+            tokens.emplace_back(data + tokenStart, write - tokenStart);
+        }
+        tokenStart = write = nextStart;
+    }
+
+    // Keep the already-folded bytes [from, to) of the current token
+    void keepRun(size_t from, size_t to) {
+        if (write != from) {
+            memmove(data + write, data + from, to - from);
+        }
+        write += to - from;
+    }
+};
+
+void scanScalar(ScanState& state, size_t from, size_t to) {
+    char* data = state.data;
+    for (size_t i = from; i < to; ++i) {
+        unsigned char c = static_cast<unsigned char>(data[i]);
+        switch (tables.byteClass[c]) {
+        case Keep:
+            data[state.write++] = tables.folded[c];
+            break;
+        case Space:
+            state.endToken(i + 1);
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+// Walk the space/drop positions of one folded block; runs between them are kept in bulk
+inline void scanBlockMasks(ScanState& state, size_t base, size_t width, uint32_t spaceMask, uint32_t dropMask) {
+    uint32_t special = spaceMask | dropMask;
+    if (special == 0 && state.write == base) {
+        state.write += width;
+        return;
+    }
+
+    size_t pos = 0;
+    while (special != 0) {
+        size_t i = static_cast<size_t>(__builtin_ctz(special));
+        state.keepRun(base + pos, base + i);
+        if (spaceMask & (1u << i)) {
+            state.endToken(base + i + 1);
+        }
+        pos = i + 1;
+        special &= special - 1;
+    }
+    state.keepRun(base + pos, base + width);
+}
+
+#ifdef POI_TOKENIZER_X86
+
+size_t scanSSE2(ScanState& state, size_t size) {
+    const __m128i upperLo = _mm_set1_epi8('A' - 1), upperHi = _mm_set1_epi8('Z' + 1);
+    const __m128i lowerLo = _mm_set1_epi8('a' - 1), lowerHi = _mm_set1_epi8('z' + 1);
+    const __m128i digitLo = _mm_set1_epi8('0' - 1), digitHi = _mm_set1_epi8('9' + 1);
+    const __m128i ctrlLo = _mm_set1_epi8('\t' - 1), ctrlHi = _mm_set1_epi8('\r' + 1);
+    const __m128i space = _mm_set1_epi8(' '), caseBit = _mm_set1_epi8(0x20);
+
+    size_t i = 0;
+    for (; i + 16 <= size; i += 16) {
+        __m128i* block = reinterpret_cast<__m128i*>(state.data + i);
+        __m128i v = _mm_loadu_si128(block);
+
+        // Bytes >= 0x80 are negative as signed chars, so the range compares only hit ASCII
+        __m128i upper = _mm_and_si128(_mm_cmpgt_epi8(v, upperLo), _mm_cmplt_epi8(v, upperHi));
+        v = _mm_or_si128(v, _mm_and_si128(upper, caseBit));
+        _mm_storeu_si128(block, v);
+
+        __m128i keep = _mm_or_si128(_mm_and_si128(_mm_cmpgt_epi8(v, lowerLo), _mm_cmplt_epi8(v, lowerHi)),
+                                    _mm_and_si128(_mm_cmpgt_epi8(v, digitLo), _mm_cmplt_epi8(v, digitHi)));
+        __m128i spaces = _mm_or_si128(_mm_cmpeq_epi8(v, space),
+                                      _mm_and_si128(_mm_cmpgt_epi8(v, ctrlLo), _mm_cmplt_epi8(v, ctrlHi)));
+
+        uint32_t keepMask = static_cast<uint32_t>(_mm_movemask_epi8(keep) | _mm_movemask_epi8(v));
+        uint32_t spaceMask = static_cast<uint32_t>(_mm_movemask_epi8(spaces));
+        uint32_t dropMask = ~(keepMask | spaceMask) & 0xFFFFu;
+        scanBlockMasks(state, i, 16, spaceMask, dropMask);
+    }
+    return i;
+}
+
+__attribute__((target("avx2")))
+size_t scanAVX2(ScanState& state, size_t size) {
+    const __m256i upperLo = _mm256_set1_epi8('A' - 1), upperHi = _mm256_set1_epi8('Z' + 1);
+    const __m256i lowerLo = _mm256_set1_epi8('a' - 1), lowerHi = _mm256_set1_epi8('z' + 1);
+    const __m256i digitLo = _mm256_set1_epi8('0' - 1), digitHi = _mm256_set1_epi8('9' + 1);
+    const __m256i ctrlLo = _mm256_set1_epi8('\t' - 1), ctrlHi = _mm256_set1_epi8('\r' + 1);
+    const __m256i space = _mm256_set1_epi8(' '), caseBit = _mm256_set1_epi8(0x20);
+
+    size_t i = 0;
+    for (; i + 32 <= size; i += 32) {
+        __m256i* block = reinterpret_cast<__m256i*>(state.data + i);
+        __m256i v = _mm256_loadu_si256(block);
+
+        __m256i upper = _mm256_and_si256(_mm256_cmpgt_epi8(v, upperLo), _mm256_cmpgt_epi8(upperHi, v));
+        v = _mm256_or_si256(v, _mm256_and_si256(upper, caseBit));
+        _mm256_storeu_si256(block, v);
+
+        __m256i keep = _mm256_or_si256(_mm256_and_si256(_mm256_cmpgt_epi8(v, lowerLo), _mm256_cmpgt_epi8(lowerHi, v)),
+                                       _mm256_and_si256(_mm256_cmpgt_epi8(v, digitLo), _mm256_cmpgt_epi8(digitHi, v)));
+        __m256i spaces = _mm256_or_si256(_mm256_cmpeq_epi8(v, space),
+                                         _mm256_and_si256(_mm256_cmpgt_epi8(v, ctrlLo), _mm256_cmpgt_epi8(ctrlHi, v)));
+
+        uint32_t keepMask = static_cast<uint32_t>(_mm256_movemask_epi8(keep)) | static_cast<uint32_t>(_mm256_movemask_epi8(v));
+        uint32_t spaceMask = static_cast<uint32_t>(_mm256_movemask_epi8(spaces));
+        uint32_t dropMask = ~(keepMask | spaceMask);
+        scanBlockMasks(state, i, 32, spaceMask, dropMask);
+    }
+    return i;
+}
+
+#endif // POI_TOKENIZER_X86
+
+Tokenizer::Kernel detectKernel() {
+#ifdef POI_TOKENIZER_X86
+    if (__builtin_cpu_supports("avx2")) {
+        return Tokenizer::Kernel::AVX2;
+    }
+    return Tokenizer::Kernel::SSE2;
+#else
+    return Tokenizer::Kernel::Scalar;
+#endif
+}
+
+atomic<Tokenizer::Kernel> currentKernel{detectKernel()};
+
+} // namespace
+
+Tokenizer::Kernel Tokenizer::bestKernel() {
+    static const Kernel best = detectKernel();
+    return best;
+}
+
+Tokenizer::Kernel Tokenizer::activeKernel() {
+    return currentKernel.load(memory_order_relaxed);
+}
+
+void Tokenizer::setKernel(Kernel kernel) {
+    if (static_cast<int>(kernel) > static_cast<int>(bestKernel())) {
+        kernel = bestKernel();
+    }
+    currentKernel.store(kernel, memory_order_relaxed);
+}
+
+const char* Tokenizer::kernelName(Kernel kernel) {
+    switch (kernel) {
+    case Kernel::AVX2: return "avx2";
+    case Kernel::SSE2: return "sse2";
+    default: return "scalar";
+    }
+}
+
+string_view Tokenizer::tokenize(char* data, size_t size, vector<string_view>& tokens, bool finalBlock) {
+    ScanState state{data, 0, 0, tokens};
+
+    size_t scanned = 0;
+#ifdef POI_TOKENIZER_X86
+    switch (activeKernel()) {
+    case Kernel::AVX2: scanned = scanAVX2(state, size); break;
+    case Kernel::SSE2: scanned = scanSSE2(state, size); break;
+    default: break;
+    }
+#endif
+    scanScalar(state, scanned, size);
+
+    if (finalBlock) {
+        state.endToken(size);
+        return {};
+    }
+    return string_view(data + state.tokenStart, state.write - state.tokenStart);
+}
@@ -1,90 +1,256 @@
 #include "train_model.hpp"
+#include "tokenizer.hpp"
+#include "compiled_model.hpp"
+#include "config.hpp"
+#include "logger.hpp"
+#include "training_csv.hpp"
+#include "thread_pool.hpp"
 #include <iostream>
 #include <fstream>
-#include <sstream>
+#include <cstring>
+#include <iterator>
 #include <unordered_map>
 #include <algorithm>
 #include <cmath>
 #include <sys/stat.h>
 #include <filesystem>
-#include <locale>
-#include <codecvt>
+#include <memory>
+#include <stdexcept>
 
 using namespace std;
 namespace fs = filesystem;
 
-TrainModel::TrainModel() : totalDocuments(0) {}
-
-vector<string> TrainModel::preprocessText(const string& text) {
-    vector<string> words;
-    stringstream ss(text);
-    string word;
+// Word and document counts of every genre, indexed like Config::predefinedGenres
+struct GenreCounts {
+    vector<TokenMap<int>> wordCounts;
+    vector<int> documentCounts;
+
+    explicit GenreCounts(size_t numGenres) : wordCounts(numGenres), documentCounts(numGenres, 0) {}
+};
+
+namespace {
+
+// Reader for the original model.dat layout. A record is "name\0" followed by either a
+// word probability (8 bytes) or, when it starts a genre, the prior and the total word
+// count (12 bytes). Nothing marks which one it is, so a genre name is only taken as a
+// header when reading it that way keeps the next few records well-formed and reading it
+// as an ordinary word does not. Trained words only ever contain [a-z0-9].
+class LegacyModelReader {
+public:
+    LegacyModelReader(const string& data, const vector<string>& genres) : data(data), genres(genres) {}
+
+    bool read(unordered_map<string, GenreModel>& genreModels) const {
+        size_t pos = 0;
+        GenreModel* current = nullptr;
+
+        while (pos < data.size()) {
+            string_view name;
+            size_t next;
+            if (!nameAt(pos, name, next)) {
+                return false;
+            }
 
-    while (ss >> word) {
-        transform(word.begin(), word.end(), word.begin(), ::tolower);
-        word.erase(remove_if(word.begin(), word.end(), [](char c) { return !isalnum(c); }), word.end());
-        words.push_back(word);
+            bool isHeader = current == nullptr
+                || (isGenre(name) && headerAt(next) && validFrom(next + headerSize, lookahead)
+                    && !(wordAt(next) && validFrom(next + wordSize, lookahead)));
+
+            if (isHeader) {
+                if (!headerAt(next)) {
+                    return false;
+                }
+                GenreModel& genreModel = genreModels[string(name)];
+                genreModel = GenreModel(string(name), readValue<double>(next), readValue<int32_t>(next + sizeof(double)));
+                current = &genreModel;
+                pos = next + headerSize;
+            } else {
+                if (!wordAt(next)) {
+                    return false;
+                }
+                current->wordProbabilities[string(name)] = readValue<double>(next);
+                pos = next + wordSize;
+            }
+        }
+        return true;
     }
-    return words;
-}
 
-vector<pair<string, string>> TrainModel::readCSV(const string& fileName) {
-    vector<pair<string, string>> rows;
-    wifstream file(fileName);
-    wstring line;
+private:
+    static constexpr size_t wordSize = sizeof(double);
+    static constexpr size_t headerSize = sizeof(double) + sizeof(int32_t);
+    static constexpr int lookahead = 8;
 
-    file.imbue(locale(locale::classic(), new codecvt_utf8<wchar_t>()));
+    template <typename T>
+    T readValue(size_t pos) const {
+        T value;
+        memcpy(&value, data.data() + pos, sizeof(T));
+        return value;
+    }
 
-    if (!file.is_open()) {
-        cerr << "Error opening file: " << fileName << endl;
-        return rows;
+    bool isGenre(string_view name) const {
+        return find(genres.begin(), genres.end(), name) != genres.end();
     }
 
-    std::getline(file, line);  // Skip header (index and title)
+    bool nameAt(size_t pos, string_view& name, size_t& next) const {
+        size_t end = data.find('\0', pos);
+        if (end == string::npos) {
+            return false;
+        }
+        for (size_t i = pos; i < end; ++i) {
+            char c = data[i];
+            if (!((c >= 'a' && c <= 'z') || (c >= '0' && c <= '9'))) {
+                return false;
+            }
+        }
+        name = string_view(data.data() + pos, end - pos);
+        next = end + 1;
+        return true;
+    }
 
-    while (std::getline(file, line)) {
-        std::wstringstream ss(line);
-        std::wstring dummy;
+    bool wordAt(size_t pos) const {
+        if (pos + wordSize > data.size()) return false;
+        double probability = readValue<double>(pos);
+        return probability > 0.0 && probability <= 1.0;
+    }
 
-        // Skip the first two columns (index and title)
-        std::getline(ss, dummy, L',');  // Skip first column (index)
-        std::getline(ss, dummy, L',');  // Skip second column (title)
+    bool headerAt(size_t pos) const {
+        if (pos + headerSize > data.size()) return false;
+        double prior = readValue<double>(pos);
+        return prior >= 0.0 && prior <= 1.0 && readValue<int32_t>(pos + sizeof(double)) >= 0;
+    }
 
-        // Now get the genre from the third column
-        std::wstring genre;
-        std::getline(ss, genre, L',');
+    bool validFrom(size_t pos, int depth) const {
+        if (pos == data.size() || depth == 0) {
+            return true;
+        }
+        string_view name;
+        size_t next;
+        if (!nameAt(pos, name, next)) {
+            return false;
+        }
+        return (wordAt(next) && validFrom(next + wordSize, depth - 1))
+            || (isGenre(name) && headerAt(next) && validFrom(next + headerSize, depth - 1));
+    }
 
-        // If genre is empty, continue with next line
-        if (genre.empty()) continue;
+    const string& data;
+    const vector<string>& genres;
+};
 
-        // Read the summary from the remaining columns (might span multiple lines)
-        std::wstring summary;
-        bool inSummary = true;
-        std::wstring summaryLine;
-        std::getline(ss, summaryLine);  // Start reading the summary (fourth column)
+// Fold source into target, iterating over the smaller of the two
+void mergeWordCounts(TokenMap<int>& target, TokenMap<int>& source) {
+    if (source.size() > target.size()) {
+        swap(target, source);
+    }
+    for (auto& wordEntry : source) {
+        target[wordEntry.first] += wordEntry.second;
+    }
+    source.clear();
+}
 
-        // Add the initial summary line
-        summary += summaryLine;
+// Count one document into counts, unless its genre is not a predefined one
+void countDocument(GenreCounts& counts, string_view genre, string_view text) {
+    const vector<string>& predefinedGenres = Config::predefinedGenres;
+    auto genreIt = std::find(predefinedGenres.begin(), predefinedGenres.end(), genre);
+    if (genreIt == predefinedGenres.end()) {
+        return;
+    }
+    size_t genreIndex = genreIt - predefinedGenres.begin();
+
+    // Same tokenizer as the classifier; it normalizes the copied summary in place, and the
+    // thread's scratch keeps its capacity from one document to the next
+    thread_local std::string summary;
+    thread_local std::vector<std::string_view> words;
+    summary.assign(text);
+    words.clear();
+    Tokenizer::tokenize(summary.data(), summary.size(), words);
+
+    counts.documentCounts[genreIndex]++;
+    TokenMap<int>& wordCounts = counts.wordCounts[genreIndex];
+    for (string_view word : words) {
+        auto it = wordCounts.find(word);
+        if (it == wordCounts.end()) {
+            wordCounts.emplace(word, 1);
+        } else {
+            it->second++;
+        }
+    }
+}
 
-        // Now, read the rest of the summary until we encounter "(less)"
-        while (std::getline(file, line)) {
-            // If the line contains "(less)", we stop reading the summary
-            if (line.find(L"(less)") != std::wstring::npos) {
-                break;
+// Tree merge: each round folds table i + stride into table i, all pairs and genres in parallel,
+// so merging takes log2(tables) rounds instead of one serial pass per table
+GenreCounts mergeThreadCounts(vector<GenreCounts>& threadCounts) {
+    const size_t numGenres = Config::predefinedGenres.size();
+    for (size_t stride = 1; stride < threadCounts.size(); stride *= 2) {
+        size_t pairs = (threadCounts.size() - stride + 2 * stride - 1) / (2 * stride);
+
+        ThreadPool::instance().parallelFor(pairs * numGenres, [&](size_t index, size_t) {
+            size_t target = index / numGenres * 2 * stride;
+            size_t genreIndex = index % numGenres;
+            mergeWordCounts(threadCounts[target].wordCounts[genreIndex], threadCounts[target + stride].wordCounts[genreIndex]);
+            if (genreIndex == 0) {
+                for (size_t g = 0; g < numGenres; ++g) {
+                    threadCounts[target].documentCounts[g] += threadCounts[target + stride].documentCounts[g];
+                }
             }
+        });
+    }
+    return std::move(threadCounts[0]);
+}
 
-            // Skip empty lines
-            if (line.empty()) continue;
+// Count the documents of every predefined genre; summaries are tokenized in parallel, 64 at a time
+GenreCounts countDocuments(const vector<pair<string, string>>& trainingData) {
+    constexpr size_t blockSize = 64;
+    ThreadPool& pool = ThreadPool::instance();
+    size_t blocks = (trainingData.size() + blockSize - 1) / blockSize;
 
-            // Add the line to the summary
-            summary += L" " + line;
+    // Every participant counts into its own table, so the counting loop needs no locks
+    vector<GenreCounts> threadCounts(max<size_t>(1, pool.parallelism(blocks)), GenreCounts(Config::predefinedGenres.size()));
+
+    pool.parallelFor(blocks, [&](size_t block, size_t participant) {
+        size_t end = min(trainingData.size(), (block + 1) * blockSize);
+        for (size_t i = block * blockSize; i < end; ++i) {
+            countDocument(threadCounts[participant], trainingData[i].first, trainingData[i].second);
+
+            // Debugging: Output progress every 1000 documents processed
+            if (i % 1000 == 0) {
+                LOG_DEBUG("Processed " << i << " documents...");
+            }
         }
+    });
+    return mergeThreadCounts(threadCounts);
+}
 
-        // Store the genre and the summary in the vector
-        rows.push_back({std::string(genre.begin(), genre.end()), std::string(summary.begin(), summary.end())});
-    }
+// Same, straight from the mapped file: every participant parses and counts whole chunks
+GenreCounts countDocuments(const TrainingCsv& csv) {
+    ThreadPool& pool = ThreadPool::instance();
+    const size_t chunks = csv.chunkCount();
+    vector<GenreCounts> threadCounts(max<size_t>(1, pool.parallelism(chunks)), GenreCounts(Config::predefinedGenres.size()));
+
+    pool.parallelFor(chunks, [&](size_t chunk, size_t participant) {
+        csv.forEachRecord(chunk, [&](string_view genre, string_view text) {
+            countDocument(threadCounts[participant], genre, text);
+        });
+        LOG_DEBUG("Counted chunk " << chunk + 1 << " of " << chunks);
+    });
+    return mergeThreadCounts(threadCounts);
+}
+
+} // namespace
 
-    file.close();
+TrainModel::TrainModel() : totalDocuments(0), hashBits(0) {}
+
+vector<pair<string, string>> TrainModel::readCSV(const string& fileName) {
+    vector<pair<string, string>> rows;
+    try {
+        TrainingCsv csv(fileName);
+        for (size_t chunk = 0; chunk < csv.chunkCount(); ++chunk) {
+            csv.forEachRecord(chunk, [&](string_view genre, string_view summary) {
+                if (!genre.empty()) {
+                    rows.emplace_back(string(genre), string(summary));
+                }
+            });
+        }
+    } catch (const runtime_error& e) {
+        LOG_ERROR(e.what());
+    }
     return rows;
 }
 
@@ -94,97 +260,259 @@ void TrainModel::trainOrLoadModel(const string& modelFilename) {
 
     if (fs::exists(fullPath)) {
         loadModel(fullPath);
-        cout << "Model loaded from file: " << modelFilename << endl;
+        LOG_INFO("Model loaded from file: " << modelFilename);
     } else {
         trainNaiveBayes();
         saveModel(modelFilename);
-        cout << "New model saved as: " << modelFilename << endl;
+        LOG_INFO("New model saved as: " << modelFilename);
     }
 }
 
 void TrainModel::trainNaiveBayes() {
-    vector<pair<string, string>> trainingData = readCSV("../extracted_book/output.csv");
+    trainNaiveBayes(Config::trainingDataPath);
+}
+
+void TrainModel::trainNaiveBayes(const string& csvPath) {
+    genreModels.clear();
+    totalDocuments = 0;
+    update(csvPath);
+    displayModel();
+}
+
+bool TrainModel::update(const string& csvPath) {
+    if (!hasCounts()) {
+        LOG_ERROR("Model has no raw counts (it was read from a legacy or v2 file); retrain it before updating.");
+        return false;
+    }
 
+    // Counted straight out of the mapping, so the dataset is never held in memory
+    unique_ptr<TrainingCsv> csv;
+    try {
+        csv = make_unique<TrainingCsv>(csvPath);
+    } catch (const runtime_error& e) {
+        LOG_ERROR(e.what());
+        return false;
+    }
+    LOG_DEBUG("Reading " << csvPath << " (" << csv->size() << " bytes) in " << csv->chunkCount() << " chunks"
+              << (csv->hasLessMarkers() ? ", summaries ended by (less) lines" : ""));
+
+    GenreCounts counts = countDocuments(*csv);
+    addCounts(counts);
+    return true;
+}
+
+bool TrainModel::update(const vector<pair<string, string>>& documents) {
+    if (!hasCounts()) {
+        LOG_ERROR("Model has no raw counts (it was read from a legacy or v2 file); retrain it before updating.");
+        return false;
+    }
+    GenreCounts counts = countDocuments(documents);
+    addCounts(counts);
+    return true;
+}
+
+void TrainModel::addCounts(GenreCounts& counts) {
     // Predefined list of genres to ensure they're included in the model
-    vector<string> predefinedGenres = {
-        "horror", "fantasy", "science", "crime", "history", 
-        "thriller", "romance", "psychology", "sports", "travel"
-    };
+    const vector<string>& predefinedGenres = Config::predefinedGenres;
+    const size_t numGenres = predefinedGenres.size();
 
     // Add predefined genres to the model if they don't exist
-    for (const auto& genre : predefinedGenres) {
-        if (genreModels.find(genre) == genreModels.end()) {
-            GenreModel newGenreModel;
-            genreModels[genre] = newGenreModel;  // Initialize the genre with empty data
+    vector<GenreModel*> targets(numGenres);
+    for (size_t genreIndex = 0; genreIndex < numGenres; ++genreIndex) {
+        GenreModel& genreModel = genreModels[predefinedGenres[genreIndex]];
+        genreModel.genre = predefinedGenres[genreIndex];
+        if (hashBits != 0) {
+            genreModel.bucketCounts.resize(size_t(1) << hashBits);
         }
+        targets[genreIndex] = &genreModel;
     }
 
-    unordered_map<string, int> genreDocumentCounts;
-    unordered_map<string, unordered_map<string, int>> tempWordCounts;
-
-    // Parallelizing the document processing using OpenMP
-    #pragma omp parallel for
-    for (size_t i = 0; i < trainingData.size(); ++i) {
-        std::string genre = trainingData[i].first;
-
-        // Only process genres that are in predefinedGenres
-        if (std::find(predefinedGenres.begin(), predefinedGenres.end(), genre) == predefinedGenres.end()) {
-            continue;  // Skip this document if the genre is not in predefinedGenres
+    // Fold the new counts into the model, one genre per participant
+    int64_t added = 0;
+    for (int documents : counts.documentCounts) {
+        added += documents;
+    }
+    ThreadPool::instance().parallelFor(numGenres, [&](size_t genreIndex, size_t) {
+        GenreModel& genreModel = *targets[genreIndex];
+        genreModel.documentCount += counts.documentCounts[genreIndex];
+
+        TokenMap<int>& wordCounts = counts.wordCounts[genreIndex];
+        if (hashBits != 0) {
+            // Only this batch's words are ever held as strings
+            for (const auto& wordEntry : wordCounts) {
+                genreModel.bucketCounts[ModelFormat::hashBucket(wordEntry.first, hashBits)] += wordEntry.second;
+                genreModel.totalWordsInGenre += wordEntry.second;
+            }
+            return;
+        }
+        genreModel.wordCounts.reserve(genreModel.wordCounts.size() + wordCounts.size());
+        for (const auto& wordEntry : wordCounts) {
+            genreModel.wordCounts[wordEntry.first] += wordEntry.second;
+            genreModel.totalWordsInGenre += wordEntry.second;
         }
+    });
+    refreshPriors();
 
-        std::string summary = trainingData[i].second;
-        std::vector<std::string> words = preprocessText(summary);
+    LOG_INFO("Added " << added << " documents; the model now counts " << totalDocuments << ".");
+}
 
-        #pragma omp critical
-        {
-            genreDocumentCounts[genre]++;
-            totalDocuments++;
+TrainModel TrainModel::merge(const TrainModel& modelA, const TrainModel& modelB) {
+    if (!modelA.hasCounts() || !modelB.hasCounts()) {
+        throw runtime_error("Only models with raw counts can be merged");
+    }
+    if (modelA.hashBits != modelB.hashBits) {
+        throw runtime_error("Only models hashed into the same number of buckets (or both not hashed) can be merged");
+    }
 
-            // Count the word occurrences per genre (critical section)
-            for (const std::string& word : words) {
-                tempWordCounts[genre][word]++;
+    TrainModel merged = modelA;
+    for (const auto& genreEntry : modelB.genreModels) {
+        const GenreModel& source = genreEntry.second;
+        GenreModel& target = merged.genreModels[genreEntry.first];
+        target.genre = genreEntry.first;
+        target.documentCount += source.documentCount;
+        target.totalWordsInGenre += source.totalWordsInGenre;
+        if (merged.hashBits != 0) {
+            target.bucketCounts.resize(size_t(1) << merged.hashBits);
+            for (size_t bucket = 0; bucket < source.bucketCounts.size(); ++bucket) {
+                target.bucketCounts[bucket] += source.bucketCounts[bucket];
             }
         }
+        for (const auto& wordEntry : source.wordCounts) {
+            target.wordCounts[wordEntry.first] += wordEntry.second;
+        }
+    }
+    merged.refreshPriors();
+    return merged;
+}
 
-        // Debugging: Output progress every 1000 documents processed
-        if (i % 1000 == 0) {
-            std::cout << "Processed " << i << " documents..." << std::endl;
+bool TrainModel::hasCounts() const {
+    for (const auto& genreEntry : genreModels) {
+        if (!genreEntry.second.hasCounts()) {
+            return false;
         }
     }
+    return true;
+}
 
-    // Debugging: Output intermediate information about total documents processed
-    std::cout << "Total Documents Processed: " << totalDocuments << std::endl;
+bool TrainModel::hashFeatures(uint32_t bits) {
+    if (bits < ModelFormat::minHashBits || bits > ModelFormat::maxHashBits) {
+        LOG_ERROR("Hash bits must be between " << ModelFormat::minHashBits << " and " << ModelFormat::maxHashBits << ".");
+        return false;
+    }
+    if (hashBits != 0) {
+        if (hashBits != bits) {
+            LOG_ERROR("Model is already hashed into 2^" << hashBits << " buckets.");
+        }
+        return hashBits == bits;
+    }
+    if (!hasCounts()) {
+        LOG_ERROR("Model has no raw counts to hash; retrain it instead.");
+        return false;
+    }
 
-    // Building the model for each genre
-    #pragma omp parallel for
-    for (auto& genreEntry : tempWordCounts) {
-        std::string genre = genreEntry.first;
-        GenreModel model;
-        model.totalWordsInGenre = 0;
+    for (auto& genreEntry : genreModels) {
+        GenreModel& genreModel = genreEntry.second;
+        genreModel.bucketCounts.assign(size_t(1) << bits, 0);
+        for (const auto& wordEntry : genreModel.wordCounts) {
+            genreModel.bucketCounts[ModelFormat::hashBucket(wordEntry.first, bits)] += wordEntry.second;
+        }
+        genreModel.wordCounts = {};
+    }
+    hashBits = bits;
+    return true;
+}
 
-        for (const auto& wordEntry : genreEntry.second) {
-            model.wordProbabilities[wordEntry.first] = static_cast<double>(wordEntry.second);
-            model.totalWordsInGenre += wordEntry.second;
+bool TrainModel::wordTotals(unordered_map<string_view, int64_t>& totals) const {
+    if (!hasCounts() || hashBits != 0) {
+        LOG_ERROR("Only vocabulary models with raw counts can be pruned.");
+        return false;
+    }
+    for (const auto& genreEntry : genreModels) {
+        for (const auto& wordEntry : genreEntry.second.wordCounts) {
+            totals[wordEntry.first] += wordEntry.second;
         }
+    }
+    return true;
+}
 
-        model.priorProbability = static_cast<double>(genreDocumentCounts[genre]) / totalDocuments;
+size_t TrainModel::dropWords(const vector<string>& words) {
+    for (auto& genreEntry : genreModels) {
+        for (const string& word : words) {
+            genreEntry.second.wordCounts.erase(word);
+        }
+    }
+    return words.size();
+}
 
-        // Normalize word probabilities
-        for (auto& wordEntry : model.wordProbabilities) {
-            wordEntry.second /= model.totalWordsInGenre;
+size_t TrainModel::pruneRareWords(int64_t minCount) {
+    unordered_map<string_view, int64_t> totals;
+    if (!wordTotals(totals)) {
+        return 0;
+    }
+    vector<string> rare;
+    for (const auto& wordEntry : totals) {
+        if (wordEntry.second < minCount) {
+            rare.emplace_back(wordEntry.first);
         }
+    }
+    return dropWords(rare);
+}
 
-        // Store the final model for the genre
-        #pragma omp critical
-        {
-            genreModels[genre] = model;
+size_t TrainModel::pruneByInformation(size_t keepWords) {
+    unordered_map<string_view, int64_t> totals;
+    if (!wordTotals(totals) || totals.size() <= keepWords) {
+        return 0;
+    }
+
+    // Each word's share of I(word; genre) over token occurrences:
+    // sum over genres of p(w, g) * log(p(w, g) / (p(w) * p(g)))
+    double allWords = 0.0;
+    for (const auto& genreEntry : genreModels) {
+        allWords += static_cast<double>(genreEntry.second.totalWordsInGenre);
+    }
+    unordered_map<string_view, double> information;
+    information.reserve(totals.size());
+    for (const auto& genreEntry : genreModels) {
+        double genreWords = static_cast<double>(genreEntry.second.totalWordsInGenre);
+        for (const auto& wordEntry : genreEntry.second.wordCounts) {
+            if (wordEntry.second <= 0) continue;
+            double joint = wordEntry.second / allWords;
+            double word = totals[wordEntry.first] / allWords;
+            information[wordEntry.first] += joint * log(joint / (word * (genreWords / allWords)));
         }
+    }
+
+    vector<pair<double, string_view>> ranked;
+    ranked.reserve(information.size());
+    for (const auto& wordEntry : information) {
+        ranked.emplace_back(wordEntry.second, wordEntry.first);
+    }
+    if (ranked.size() <= keepWords) {
+        return 0;
+    }
+    // Highest first; ties broken by the word so the result does not depend on hash order
+    auto higher = [](const pair<double, string_view>& a, const pair<double, string_view>& b) {
+        return a.first != b.first ? a.first > b.first : a.second < b.second;
+    };
+    nth_element(ranked.begin(), ranked.begin() + keepWords, ranked.end(), higher);
 
-        // Debugging: Output progress after processing each genre
-        std::cout << "Finished processing genre: " << genre << std::endl;
+    vector<string> dropped;
+    for (size_t i = keepWords; i < ranked.size(); ++i) {
+        dropped.emplace_back(ranked[i].second);
     }
+    return dropWords(dropped);
+}
 
-    displayModel();
+void TrainModel::refreshPriors() {
+    totalDocuments = 0;
+    for (const auto& genreEntry : genreModels) {
+        totalDocuments += genreEntry.second.documentCount;
+    }
+    for (auto& genreEntry : genreModels) {
+        GenreModel& genreModel = genreEntry.second;
+        genreModel.priorProbability = totalDocuments > 0
+            ? static_cast<double>(genreModel.documentCount) / totalDocuments : 0.0;
+    }
 }
 
 void TrainModel::addGenreModel(const std::string& genre, GenreModel& genreModel) {
@@ -197,56 +525,57 @@ void TrainModel::saveModel(const std::string& filename) {
 
     if (!fs::exists(directory)) {
         if (fs::create_directory(directory)) {
-            cout << "Created directory: " << directory << endl;
+            LOG_INFO("Created directory: " << directory);
         } else {
-            cerr << "Error: Failed to create directory: " << directory << endl;
+            LOG_ERROR("Failed to create directory: " << directory);
             return;
         }
     }
 
     if (fs::exists(fullPath)) {
-        cout << "File already exists: " << fullPath << ". Nothing to do." << endl;
-        return;
+        LOG_INFO("Replacing existing model: " << fullPath);
+    } else {
+        LOG_INFO("Saving model to: " << fullPath);
     }
 
-    ofstream outFile(fullPath, ios::binary);
-    if (!outFile.is_open()) {
-        cerr << "Error: Could not open file " << fullPath << " for writing." << endl;
+    // Written in the compiled v5 layout (with the raw counts) so the classifier can mmap it
+    // directly next time and training can continue from it
+    try {
+        CompiledModel(genreModels).save(fullPath);
+    } catch (const exception& e) {
+        LOG_ERROR(e.what());
         return;
     }
 
-    cout << "Saving model to: " << fullPath << endl;
-
-    for (const auto& genreEntry : genreModels) {
-        outFile.write(genreEntry.first.c_str(), genreEntry.first.size());
-        outFile.put('\0');
-        outFile.write(reinterpret_cast<const char*>(&genreEntry.second.priorProbability), sizeof(genreEntry.second.priorProbability));
-        outFile.write(reinterpret_cast<const char*>(&genreEntry.second.totalWordsInGenre), sizeof(genreEntry.second.totalWordsInGenre));
-
-        for (const auto& wordEntry : genreEntry.second.wordProbabilities) {
-            outFile.write(wordEntry.first.c_str(), wordEntry.first.size());
-            outFile.put('\0');
-            outFile.write(reinterpret_cast<const char*>(&wordEntry.second), sizeof(wordEntry.second));
-        }
-    }
-
-    outFile.close();
-    cout << "Model successfully saved to: " << fullPath << endl;
+    LOG_INFO("Model successfully saved to: " << fullPath);
 
     displayModel();
 }
 
 void TrainModel::displayModel() const {
+    // The table goes straight to stdout; write out buffered log lines first so they stay in front of it
+    Logger::flush();
     for (const auto& genreEntry : genreModels) {
         cout << "Genre: " << genreEntry.first << endl;
         cout << "Prior Probability: " << genreEntry.second.priorProbability << endl;
         cout << "Total Words in Genre: " << genreEntry.second.totalWordsInGenre << endl;
-        cout << "Top Word Probabilities:" << endl;
+        cout << (genreEntry.second.isHashed() ? "Top Bucket Probabilities:" : "Top Word Probabilities:") << endl;
 
+        // Count models derive the probabilities on the fly
+        const GenreModel& genreModel = genreEntry.second;
         vector<pair<string, double>> wordProbabilities;
-        for (const auto& wordEntry : genreEntry.second.wordProbabilities) {
+        for (size_t bucket = 0; bucket < genreModel.bucketCounts.size(); ++bucket) {
+            if (genreModel.bucketCounts[bucket] > 0) {
+                wordProbabilities.emplace_back("#" + to_string(bucket),
+                                               static_cast<double>(genreModel.bucketCounts[bucket]) / genreModel.totalWordsInGenre);
+            }
+        }
+        for (const auto& wordEntry : genreModel.wordProbabilities) {
             wordProbabilities.push_back(wordEntry);
         }
+        for (const auto& wordEntry : genreModel.wordCounts) {
+            wordProbabilities.emplace_back(wordEntry.first, static_cast<double>(wordEntry.second) / genreModel.totalWordsInGenre);
+        }
 
         sort(wordProbabilities.begin(), wordProbabilities.end(),
             [](const pair<string, double>& a, const pair<string, double>& b) {
@@ -263,35 +592,39 @@ void TrainModel::displayModel() const {
 }
 
 void TrainModel::loadModel(const string& filename) {
+    if (CompiledModel::isCompiledModelFile(filename)) {
+        LOG_INFO("Loading compiled model from: " << filename);
+        try {
+            CompiledModel compiled = CompiledModel::mapFile(filename);
+            genreModels = compiled.toGenreModels();
+            hashBits = compiled.hashBits();
+        } catch (const exception& e) {
+            LOG_ERROR(e.what());
+            return;
+        }
+        if (hasCounts()) {
+            refreshPriors();
+        }
+        LOG_INFO("Model loaded successfully.");
+        return;
+    }
+
     ifstream inFile(filename, ios::binary);
     if (!inFile.is_open()) {
-        cerr << "Error: Could not open file " << filename << " for reading." << endl;
+        LOG_ERROR("Could not open file " << filename << " for reading.");
         return;
     }
 
-    std::cout << "Loading model from: " << filename << std::endl;
+    LOG_INFO("Loading legacy model from: " << filename);
 
-    while (inFile.peek() != EOF) {
-        std::string genre;
-        std::getline(inFile, genre, '\0');
-
-        GenreModel genreModel;
-        inFile.read(reinterpret_cast<char*>(&genreModel.priorProbability), sizeof(genreModel.priorProbability));
-        inFile.read(reinterpret_cast<char*>(&genreModel.totalWordsInGenre), sizeof(genreModel.totalWordsInGenre));
-
-        while (inFile.peek() != EOF) {
-            std::string word;
-            std::getline(inFile, word, '\0');
-            if (word.empty()) break;
-
-            double probability;
-            inFile.read(reinterpret_cast<char*>(&probability), sizeof(probability));
-            genreModel.wordProbabilities[word] = probability;
-        }
+    string data((istreambuf_iterator<char>(inFile)), istreambuf_iterator<char>());
+    inFile.close();
 
-        genreModels[genre] = genreModel;
+    LegacyModelReader reader(data, Config::predefinedGenres);
+    if (!reader.read(genreModels)) {
+        LOG_ERROR(filename << " is not a readable legacy model.");
+        return;
     }
 
-    inFile.close();
-    std::cout << "Model loaded successfully." << std::endl;
+    LOG_INFO("Model loaded successfully.");
 }
@@ -0,0 +1,177 @@
+#include "training_csv.hpp"
+#include "thread_pool.hpp"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace {
+
+constexpr char lessMarker[] = "(less)";
+constexpr size_t lessMarkerLength = sizeof(lessMarker) - 1;
+constexpr size_t layoutProbeBytes = 1 << 20;  // Searched for "(less)" lines to pick the layout
+constexpr size_t minChunkBytes = 1 << 20;
+constexpr size_t chunksPerThread = 8;  // Uneven records still balance out over the threads
+
+// Closing quote of a quoted field whose content starts at pos ("" is an escaped quote)
+const char* closingQuote(const char* pos, const char* end) {
+    while (true) {
+        const char* quote = static_cast<const char*>(memchr(pos, '"', end - pos));
+        if (quote == nullptr) return end;
+        if (quote + 1 < end && quote[1] == '"') {
+            pos = quote + 2;
+            continue;
+        }
+        return quote;
+    }
+}
+
+} // namespace
+
+TrainingCsv::TrainingCsv(const string& fileName) {
+    int fd = open(fileName.c_str(), O_RDONLY | O_CLOEXEC);
+    struct stat info;
+    if (fd < 0 || fstat(fd, &info) != 0) {
+        if (fd >= 0) close(fd);
+        throw runtime_error("Error opening file: " + fileName);
+    }
+    fileSize = static_cast<size_t>(info.st_size);
+    if (fileSize > 0) {
+        void* mapping = mmap(nullptr, fileSize, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapping == MAP_FAILED) {
+            close(fd);
+            throw runtime_error("Unable to mmap file: " + fileName);
+        }
+        data = static_cast<const char*>(mapping);
+    }
+    close(fd);
+    dataEnd = data + fileSize;
+
+    lessMarkers = fileSize > 0 &&
+                  memmem(data, min(fileSize, layoutProbeBytes), lessMarker, lessMarkerLength) != nullptr;
+    splitIntoChunks();
+}
+
+TrainingCsv::~TrainingCsv() {
+    if (data != nullptr) {
+        munmap(const_cast<char*>(data), fileSize);
+    }
+}
+
+const char* TrainingCsv::nextLine(const char* pos) const {
+    const char* lineBreak = static_cast<const char*>(memchr(pos, '\n', dataEnd - pos));
+    return lineBreak ? lineBreak + 1 : dataEnd;
+}
+
+const char* TrainingCsv::findLessLine(const char* pos) const {
+    const char* marker = static_cast<const char*>(memmem(pos, dataEnd - pos, lessMarker, lessMarkerLength));
+    if (marker == nullptr) return dataEnd;
+    const char* lineBreak = static_cast<const char*>(memrchr(pos, '\n', marker - pos));
+    return lineBreak ? lineBreak + 1 : pos;
+}
+
+const char* TrainingCsv::nextRecord(const char* pos, string_view& genre, string_view& summary) const {
+    genre = summary = string_view();
+
+    // Index, title and genre
+    for (int field = 0; field < 3; ++field) {
+        bool quoted = pos < dataEnd && *pos == '"';
+        const char* fieldStart = quoted ? pos + 1 : pos;
+        if (quoted) {
+            pos = closingQuote(fieldStart, dataEnd);
+        }
+        const char* fieldEnd = pos;
+        while (pos < dataEnd && *pos != ',' && *pos != '\n') {
+            ++pos;
+        }
+        if (!quoted) {
+            fieldEnd = pos;
+        }
+        if (pos == dataEnd || *pos == '\n') {
+            // Too few fields: the line is no document
+            return pos == dataEnd ? dataEnd : pos + 1;
+        }
+        if (field == 2) {
+            genre = string_view(fieldStart, fieldEnd - fieldStart);
+        }
+        ++pos;  // The comma
+    }
+
+    // The summary: a line break inside quotes belongs to it
+    const char* summaryStart = pos;
+    if (pos < dataEnd && *pos == '"') {
+        pos = min(closingQuote(pos + 1, dataEnd) + 1, dataEnd);
+    }
+    const char* lineEnd = static_cast<const char*>(memchr(pos, '\n', dataEnd - pos));
+    if (lineEnd == nullptr) {
+        summary = string_view(summaryStart, dataEnd - summaryStart);
+        return dataEnd;
+    }
+    if (!lessMarkers) {
+        summary = string_view(summaryStart, lineEnd - summaryStart);
+        return lineEnd + 1;
+    }
+
+    // Scraped layout: the summary goes on up to the "(less)" line, which is dropped
+    const char* lessLine = findLessLine(lineEnd);
+    summary = string_view(summaryStart, lessLine - summaryStart);
+    return nextLine(lessLine);
+}
+
+const char* TrainingCsv::guessRecordStart(const char* pos) const {
+    if (!lessMarkers) {
+        return nextLine(pos - 1);
+    }
+    // From the line holding pos - 1, so a record starting exactly at pos is found
+    const char* lineStart = static_cast<const char*>(memrchr(data, '\n', (pos - 1) - data));
+    lineStart = lineStart ? lineStart + 1 : data;
+    while (lineStart < dataEnd) {
+        const char* recordStart = nextLine(findLessLine(lineStart));
+        if (recordStart >= pos) return recordStart;
+        lineStart = recordStart;
+    }
+    return dataEnd;
+}
+
+const char* TrainingCsv::skipRecords(const char* pos, const char* limit) const {
+    string_view genre, summary;
+    while (pos < limit) {
+        pos = nextRecord(pos, genre, summary);
+    }
+    return pos;
+}
+
+void TrainingCsv::splitIntoChunks() {
+    const char* first = fileSize > 0 ? nextLine(data) : dataEnd;  // Past the header
+    size_t body = static_cast<size_t>(dataEnd - first);
+    ThreadPool& pool = ThreadPool::instance();
+    size_t maxChunks = pool.size() * chunksPerThread;
+    size_t chunks = max<size_t>(1, min(body / minChunkBytes, maxChunks));
+
+    vector<const char*> nominal(chunks + 1);
+    for (size_t i = 0; i < chunks; ++i) {
+        nominal[i] = first + body / chunks * i;
+    }
+    nominal[chunks] = dataEnd;
+
+    // Guess every chunk start and scan its records to where the next chunk should begin
+    vector<const char*> guesses(chunks), ends(chunks);
+    pool.parallelFor(chunks, [&](size_t i, size_t) {
+        guesses[i] = i == 0 ? first : guessRecordStart(nominal[i]);
+        ends[i] = skipRecords(guesses[i], nominal[i + 1]);
+    });
+
+    // Keep the guesses that match the previous chunk's real end; rescan the others from there
+    chunkStarts.clear();
+    const char* pos = first;
+    for (size_t i = 0; i < chunks; ++i) {
+        chunkStarts.push_back(static_cast<size_t>(pos - data));
+        pos = guesses[i] == pos ? ends[i] : skipRecords(pos, nominal[i + 1]);
+    }
+    chunkStarts.push_back(fileSize);
+}
@@ -8,6 +8,7 @@
 #include <vector>
 #include "config.hpp"
 #include "utils.hpp"
+#include "logger.hpp"
 
 using namespace std;
 namespace fs = filesystem;
@@ -18,7 +19,7 @@ void readFileLineByLine(const string& filename) {
     ifstream file(filename);
 
     if(!file) {
-        cerr << "Error opening file:" << filename << endl;
+        LOG_ERROR("Error opening file: " << filename);
         return;
     }
 
@@ -1,66 +1,95 @@
 #include "worker.hpp"
-#include <iostream>
-#include <fstream>
+#include "logger.hpp"
+#include <chrono>
 #include <classifier.hpp> 
-#include <sstream>        
-#include <utils.hpp>      
-#include <thread>   
-#include <chrono>   
 
 using namespace std;
 
-// Worker function that processes tasks from the queue
-void workerFunction(int workerId, std::queue<std::string>& workerQueue) {
+// Worker function that processes tasks from the scheduler
+void workerFunction(int workerId, TaskScheduler& scheduler, ReportWriter& reportWriter, RuntimeMetrics& metrics,
+                    ResultCache* resultCache) {
     try {
-        std::cout << "[DEBUG] Worker " << workerId << " started." << std::endl;
+        LOG_DEBUG("Worker " << workerId << " started.");
 
         Classifier& classifier = Classifier::getInstance();
+        WorkerMetrics& stats = metrics.worker(workerId);
 
-        while (true) {
-            if (workerQueue.empty()) {
-                std::this_thread::sleep_for(std::chrono::milliseconds(50)); // Wait a bit before retrying
-                continue;
-            }
+        // Kept across documents: once their storage has grown, a document allocates nothing
+        ClassificationResult result;
+        ReportRecord record;
 
-            std::string file = workerQueue.front();
-            workerQueue.pop();
+        // Blocks while there is nothing to do; returns false once the manager shut down and all work is done
+        FileTask task;
+        while (scheduler.next(workerId, task)) {
+            const std::string& file = task.filePath;
 
-            // Check for shutdown signal
-            if (file == "__EXIT__") {
-                std::cout << "[DEBUG] Worker " << workerId << " received shutdown signal." << std::endl;
-                break;
-            }
+            LOG_DEBUG("Worker " << workerId << " processing file: " << file);
 
-            std::cout << "[DEBUG] Worker " << workerId << " processing file: " << file << std::endl;
-
-            // Read and classify file
-            std::string fileContent;
+            // Stream the file through the classifier in fixed-size blocks, unless the cache knows its content
+            auto started = std::chrono::steady_clock::now();
+            stats.stage(Stage::QueueWait).record(started - task.enqueuedAt);
+            ResultCache::Ticket ticket;
+            bool cached = false;
             try {
-                processFile(file, fileContent);
-                std::cout << "[DEBUG] Worker " << workerId << " read file: " << file << std::endl;
+                cached = resultCache && resultCache->find(file, result, ticket);
+                if (!cached) {
+                    classifier.classifyFile(file, result);
+                    LOG_DEBUG("Worker " << workerId << " read file: " << file);
+                    if (resultCache) resultCache->store(ticket, result);
+                }
             } catch (const std::exception& e) {
-                std::cerr << "[ERROR] Worker " << workerId << " reading file " << file << ": " << e.what() << std::endl;
+                // Workers waiting on the same content must not wait for this one
+                if (resultCache) resultCache->abandon(ticket);
+                LOG_ERROR("Worker " << workerId << " reading file " << file << ": " << e.what());
+                stats.errors.fetch_add(1, std::memory_order_relaxed);
+                scheduler.taskDone(task);
                 continue;
             }
+            auto classified = std::chrono::steady_clock::now();
+            std::chrono::duration<double, std::milli> elapsed = classified - started;
 
-            std::string predictedGenre = classifier.classifyText(fileContent);
+            stats.files.fetch_add(1, std::memory_order_relaxed);
+            if (cached) {
+                // Nothing was scored; bytes and busy time (the throughput the manager balances on) are left alone
+                stats.cacheHits.fetch_add(1, std::memory_order_relaxed);
+            } else {
+                stats.stage(Stage::Read).record(result.readNanos);
+                stats.stage(Stage::Tokenize).record(result.tokenizeNanos);
+                stats.stage(Stage::Score).record(result.scoreNanos);
+                stats.bytes.fetch_add(result.bytes, std::memory_order_relaxed);
+                stats.tokens.fetch_add(result.tokens, std::memory_order_relaxed);
+                stats.skippedTokens.fetch_add(result.skippedTokens, std::memory_order_relaxed);
+                stats.skippedBytes.fetch_add(result.skippedBytes, std::memory_order_relaxed);
+                if (resultCache) stats.cacheMisses.fetch_add(1, std::memory_order_relaxed);
+            }
 
-            if (!predictedGenre.empty()) {
-                std::ofstream reportFile("classification_report.txt", std::ios::app);
-                if (reportFile.is_open()) {
-                    reportFile << "File: " << file << ", Predicted Genre: " << predictedGenre << std::endl;
-                    reportFile.close();
-                    std::cout << "[DEBUG] Worker " << workerId << " wrote to classification_report.txt" << std::endl;
-                } else {
-                    std::cerr << "[ERROR] Worker " << workerId << " couldn't open report file!" << std::endl;
-                }
+            if (!result.genre.empty()) {
+                // Hand the result to the report sink; it batches the writes for all workers.
+                // Copied into the record's (and then the ring slot's) existing storage.
+                record.filePath = task.filePath;
+                record.genre = result.genre;
+                record.logProbability = result.logProbability;
+                record.scores = result.scores;
+                record.tokens = result.tokens;
+                record.workerId = workerId;
+                record.elapsedMs = elapsed.count();
+                reportWriter.submit(record);
             } else {
-                std::cerr << "[ERROR] Worker " << workerId << " failed to classify file " << file << std::endl;
+                LOG_ERROR("Worker " << workerId << " failed to classify file " << file);
+                stats.errors.fetch_add(1, std::memory_order_relaxed);
+            }
+
+            auto finished = std::chrono::steady_clock::now();
+            stats.stage(Stage::Report).record(finished - classified);
+            if (!cached) {
+                stats.busyNanos.fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>(finished - started).count(),
+                                          std::memory_order_relaxed);
             }
+            scheduler.taskDone(task);
         }
 
-        std::cout << "[DEBUG] Worker " << workerId << " finished processing." << std::endl;
+        LOG_DEBUG("Worker " << workerId << " finished processing.");
     } catch (const std::exception& e) {
-        std::cerr << "[ERROR] Worker " << workerId << ": " << e.what() << std::endl;
+        LOG_ERROR("Worker " << workerId << ": " << e.what());
     }
 }
@@ -0,0 +1,209 @@
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+#include "train_model.hpp"
+#include "compiled_model.hpp"
+#include "stream_scorer.hpp"
+#include "config.hpp"
+#include "logger.hpp"
+#include "thread_pool.hpp"
+
+using namespace std;
+namespace fs = filesystem;
+
+namespace {
+
+struct CompactOptions {
+    string input;
+    string output;
+    int64_t minCount = 0;
+    size_t keepWords = 0;
+    ModelFormat::CellType cellType = ModelFormat::CellType::Int16;
+    vector<string> documents;  // Files or directories to compare the two models on
+};
+
+void usage(const char* program) {
+    cerr << "Usage: " << program << " <model> <output model> [--min-count=N] [--keep-words=N]\n"
+         << "       " << string(strlen(program), ' ') << " [--cells=double|int16|int8] [PATH...]" << endl;
+}
+
+bool parseCount(const string& text, long long& value) {
+    try {
+        size_t used;
+        value = stoll(text, &used);
+        return used == text.size() && value > 0;
+    } catch (...) {
+        return false;
+    }
+}
+
+bool parseArguments(int argc, char* argv[], CompactOptions& options) {
+    vector<string> positional;
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        long long count;
+        if (arg.rfind("--min-count=", 0) == 0) {
+            if (!parseCount(arg.substr(12), count)) return false;
+            options.minCount = count;
+        } else if (arg.rfind("--keep-words=", 0) == 0) {
+            if (!parseCount(arg.substr(13), count)) return false;
+            options.keepWords = static_cast<size_t>(count);
+        } else if (arg.rfind("--cells=", 0) == 0) {
+            string cells = arg.substr(8);
+            if (cells == "double") options.cellType = ModelFormat::CellType::Double;
+            else if (cells == "int16") options.cellType = ModelFormat::CellType::Int16;
+            else if (cells == "int8") options.cellType = ModelFormat::CellType::Int8;
+            else return false;
+        } else if (arg.rfind("--", 0) == 0) {
+            return false;
+        } else {
+            positional.push_back(arg);
+        }
+    }
+    if (positional.size() < 2) {
+        return false;
+    }
+    options.input = positional[0];
+    options.output = positional[1];
+    options.documents.assign(positional.begin() + 2, positional.end());
+    if (options.documents.empty()) {
+        options.documents.push_back(Config::directoryPath);
+    }
+    return true;
+}
+
+vector<string> listDocuments(const vector<string>& roots) {
+    vector<string> files;
+    for (const string& root : roots) {
+        error_code error;
+        if (fs::is_regular_file(root, error)) {
+            files.push_back(root);
+            continue;
+        }
+        for (fs::recursive_directory_iterator it(root, error), end; !error && it != end; it.increment(error)) {
+            if (it->is_regular_file(error)) {
+                files.push_back(it->path().string());
+            }
+        }
+        if (error) {
+            LOG_ERROR("Cannot list " << root << ": " << error.message());
+        }
+    }
+    sort(files.begin(), files.end());
+    return files;
+}
+
+// Most likely genre of text and the time scoring it took
+size_t classify(StreamScorer& scorer, const string& text, double& seconds) {
+    auto started = chrono::steady_clock::now();
+    scorer.reset();
+    scorer.feed(text.data(), text.size());
+    scorer.finish();
+    seconds += chrono::duration<double>(chrono::steady_clock::now() - started).count();
+
+    const vector<double>& scores = scorer.scores();
+    return static_cast<size_t>(max_element(scores.begin(), scores.end()) - scores.begin());
+}
+
+const char* cellName(ModelFormat::CellType cellType) {
+    switch (cellType) {
+        case ModelFormat::CellType::Int16: return "int16";
+        case ModelFormat::CellType::Int8: return "int8";
+        default: return "double";
+    }
+}
+
+void describe(const string& label, const CompiledModel& model) {
+    cout << left << setw(8) << label << right << setw(12) << model.imageSize() << " bytes  "
+         << setw(9) << model.termCount() << (model.isHashed() ? " buckets  " : " terms    ")
+         << cellName(model.cellType()) << " cells" << endl;
+}
+
+} // namespace
+
+// Prunes and quantizes a model, then reports how much smaller it got and how often it still
+// picks the same genre as the full-precision model on a set of documents
+int main(int argc, char* argv[]) {
+    ThreadPool::ShutdownGuard poolShutdown;
+    CompactOptions options;
+    if (!parseArguments(argc, argv, options)) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    TrainModel model;
+    model.loadModel(options.input);
+    if (model.genreModels.empty()) {
+        LOG_ERROR("No genres could be read from " << options.input);
+        return 1;
+    }
+
+    try {
+        CompiledModel full(model.genreModels);
+
+        if ((options.minCount > 0 || options.keepWords > 0) && (!model.hasCounts() || model.getHashBits() != 0)) {
+            LOG_ERROR("Pruning needs a vocabulary model with raw counts; only quantizing.");
+        } else {
+            if (options.minCount > 0) {
+                LOG_INFO("Dropped " << model.pruneRareWords(options.minCount) << " words seen fewer than "
+                         << options.minCount << " times.");
+            }
+            if (options.keepWords > 0) {
+                LOG_INFO("Dropped " << model.pruneByInformation(options.keepWords)
+                         << " words outside the top " << options.keepWords << " by mutual information.");
+            }
+        }
+
+        CompiledModel compact(model.genreModels, options.cellType);
+        compact.save(options.output);
+        Logger::flush();
+
+        describe("full", full);
+        describe("compact", compact);
+        cout << "size ratio " << fixed << setprecision(3)
+             << static_cast<double>(compact.imageSize()) / max<size_t>(1, full.imageSize()) << endl;
+
+        // The genre order can differ between the two, so winners are compared by name
+        StreamScorer fullScorer(full, Config::streamBlockSize);
+        StreamScorer compactScorer(compact, Config::streamBlockSize);
+        size_t documents = 0;
+        size_t agreed = 0;
+        double fullSeconds = 0.0;
+        double compactSeconds = 0.0;
+        for (const string& path : listDocuments(options.documents)) {
+            ifstream file(path, ios::binary);
+            string text((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+            if (!file && !file.eof()) {
+                LOG_ERROR("Cannot read " << path);
+                continue;
+            }
+            size_t fullGenre = classify(fullScorer, text, fullSeconds);
+            size_t compactGenre = classify(compactScorer, text, compactSeconds);
+            ++documents;
+            if (full.genreName(fullGenre) == compact.genreName(compactGenre)) {
+                ++agreed;
+            } else {
+                LOG_DEBUG(path << ": " << full.genreName(fullGenre) << " -> " << compact.genreName(compactGenre));
+            }
+        }
+
+        cout << "agreement " << agreed << " / " << documents << " documents";
+        if (documents > 0) {
+            cout << " (" << setprecision(2) << 100.0 * agreed / documents << "%)";
+        }
+        cout << "\nscoring   full " << setprecision(3) << fullSeconds * 1000 << " ms, compact "
+             << compactSeconds * 1000 << " ms" << endl;
+    } catch (const exception& e) {
+        LOG_ERROR(e.what());
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,49 @@
+#include <iostream>
+#include <string>
+#include "train_model.hpp"
+#include "compiled_model.hpp"
+#include "logger.hpp"
+#include "thread_pool.hpp"
+
+using namespace std;
+
+// Converts a model.dat written in the original (unversioned) layout to the compiled format.
+// The legacy file only has probabilities, so the result cannot be updated or merged.
+int main(int argc, char* argv[]) {
+    ThreadPool::ShutdownGuard poolShutdown;
+    if (argc != 3) {
+        cerr << "Usage: " << argv[0] << " <legacy model.dat> <output model>" << endl;
+        return 1;
+    }
+
+    string input = argv[1];
+    string output = argv[2];
+
+    if (CompiledModel::isCompiledModelFile(input)) {
+        LOG_ERROR(input << " is already a compiled model.");
+        return 1;
+    }
+
+    TrainModel model;
+    model.loadModel(input);
+    if (model.genreModels.empty()) {
+        LOG_ERROR("No genres could be read from " << input);
+        return 1;
+    }
+
+    try {
+        CompiledModel compiled(model.genreModels);
+        compiled.save(output);
+        LOG_INFO("Wrote " << output << ": " << compiled.genreCount() << " genres, "
+                 << compiled.termCount() << " terms, " << compiled.imageSize() << " bytes.");
+
+        // Read it back through the same path the classifier uses
+        CompiledModel mapped = CompiledModel::mapFile(output);
+        LOG_INFO("Verified mapping of " << mapped.termCount() << " terms.");
+    } catch (const exception& e) {
+        LOG_ERROR(e.what());
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,120 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include "train_model.hpp"
+#include "compiled_model.hpp"
+#include "logger.hpp"
+#include "thread_pool.hpp"
+
+using namespace std;
+
+namespace {
+
+void usage(const char* program) {
+    cerr << "Usage: " << program << " train [--hash-bits=N] <training.csv> <output model>\n"
+         << "       " << program << " update <model> <training.csv> <output model>\n"
+         << "       " << program << " merge <output model> <model> <model>...\n"
+         << "       " << program << " hash <model> <bits> <output model>" << endl;
+}
+
+bool loadCountModel(const string& filename, TrainModel& model) {
+    model.loadModel(filename);
+    if (model.genreModels.empty()) {
+        LOG_ERROR("No genres could be read from " << filename);
+        return false;
+    }
+    if (!model.hasCounts()) {
+        LOG_ERROR(filename << " has no raw counts (legacy or v2 model); retrain it with 'train'.");
+        return false;
+    }
+    return true;
+}
+
+bool parseBits(const string& text, uint32_t& bits) {
+    try {
+        size_t used;
+        int parsed = stoi(text, &used);
+        if (used != text.size() || parsed <= 0) return false;
+        bits = static_cast<uint32_t>(parsed);
+        return true;
+    } catch (...) {
+        return false;
+    }
+}
+
+bool save(const TrainModel& model, const string& output) {
+    try {
+        CompiledModel compiled(model.genreModels);
+        compiled.save(output);
+        LOG_INFO("Wrote " << output << ": " << compiled.genreCount() << " genres, " << compiled.termCount()
+                 << (compiled.isHashed() ? " buckets, " : " terms, ") << model.getTotalDocuments() << " documents, "
+                 << compiled.imageSize() << " bytes.");
+    } catch (const exception& e) {
+        LOG_ERROR(e.what());
+        return false;
+    }
+    return true;
+}
+
+} // namespace
+
+// Trains count-based models, adds new documents to one, merges models trained on separate
+// shards, or folds a model's words into hashed features
+int main(int argc, char* argv[]) {
+    ThreadPool::ShutdownGuard poolShutdown;
+    string command = argc > 1 ? argv[1] : "";
+
+    if (command == "train" && (argc == 4 || argc == 5)) {
+        TrainModel model;
+        string hashFlag = "--hash-bits=";
+        if (argc == 5) {
+            string flag = argv[2];
+            uint32_t bits;
+            if (flag.compare(0, hashFlag.size(), hashFlag) != 0 || !parseBits(flag.substr(hashFlag.size()), bits)) {
+                usage(argv[0]);
+                return 1;
+            }
+            if (!model.hashFeatures(bits)) return 1;
+        }
+        if (!model.update(string(argv[argc - 2]))) return 1;
+        return save(model, argv[argc - 1]) ? 0 : 1;
+    }
+
+    if (command == "update" && argc == 5) {
+        TrainModel model;
+        if (!loadCountModel(argv[2], model)) return 1;
+        if (!model.update(string(argv[3]))) return 1;
+        return save(model, argv[4]) ? 0 : 1;
+    }
+
+    if (command == "merge" && argc >= 5) {
+        TrainModel merged;
+        if (!loadCountModel(argv[3], merged)) return 1;
+        for (int i = 4; i < argc; ++i) {
+            TrainModel shard;
+            if (!loadCountModel(argv[i], shard)) return 1;
+            try {
+                merged = TrainModel::merge(merged, shard);
+            } catch (const exception& e) {
+                LOG_ERROR(e.what());
+                return 1;
+            }
+        }
+        return save(merged, argv[2]) ? 0 : 1;
+    }
+
+    if (command == "hash" && argc == 5) {
+        TrainModel model;
+        uint32_t bits;
+        if (!parseBits(argv[3], bits)) {
+            usage(argv[0]);
+            return 1;
+        }
+        if (!loadCountModel(argv[2], model)) return 1;
+        if (!model.hashFeatures(bits)) return 1;
+        return save(model, argv[4]) ? 0 : 1;
+    }
+
+    usage(argv[0]);
+    return 1;
+}
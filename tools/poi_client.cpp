@@ -0,0 +1,261 @@
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace {
+
+struct ClientOptions {
+    string socketPath;
+    bool inlineText = false;
+    long long deadlineMs = 0;
+    bool bench = false;
+    long long requests = 1000;
+    int concurrency = 4;
+    vector<string> payloads;
+};
+
+void usage(const char* program) {
+    cerr << "Usage: " << program << " <socket> [--text] [--deadline-ms=N] [PAYLOAD...]\n"
+         << "       " << program << " <socket> --bench [--requests=N] [--concurrency=N] [--text] [--deadline-ms=N] PAYLOAD...\n"
+         << "PAYLOADs are file paths (text with --text), read one per line from stdin when none are given.\n"
+         << "--bench keeps one request in flight per connection and reports latency percentiles." << endl;
+}
+
+bool parseCount(const string& text, long long& value, long long minimum) {
+    try {
+        size_t used;
+        value = stoll(text, &used);
+        return used == text.size() && value >= minimum;
+    } catch (...) {
+        return false;
+    }
+}
+
+bool parseArguments(int argc, char* argv[], ClientOptions& options) {
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        long long value;
+        if (arg == "--text") {
+            options.inlineText = true;
+        } else if (arg == "--bench") {
+            options.bench = true;
+        } else if (arg.rfind("--deadline-ms=", 0) == 0) {
+            if (!parseCount(arg.substr(14), options.deadlineMs, 0)) return false;
+        } else if (arg.rfind("--requests=", 0) == 0) {
+            if (!parseCount(arg.substr(11), options.requests, 1)) return false;
+        } else if (arg.rfind("--concurrency=", 0) == 0) {
+            if (!parseCount(arg.substr(14), value, 1)) return false;
+            options.concurrency = static_cast<int>(value);
+        } else if (arg.rfind("--", 0) == 0) {
+            return false;
+        } else if (options.socketPath.empty()) {
+            options.socketPath = arg;
+        } else {
+            options.payloads.push_back(arg);
+        }
+    }
+    return !options.socketPath.empty();
+}
+
+int connectTo(const string& path) {
+    sockaddr_un address{};
+    if (path.size() >= sizeof(address.sun_path)) {
+        cerr << "Socket path is too long: " << path << endl;
+        return -1;
+    }
+    address.sun_family = AF_UNIX;
+    memcpy(address.sun_path, path.c_str(), path.size() + 1);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0 || connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+        cerr << "Cannot connect to " << path << ": " << strerror(errno) << endl;
+        if (fd >= 0) close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+bool sendAll(int fd, const string& data) {
+    size_t sent = 0;
+    while (sent < data.size()) {
+        ssize_t count = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if (count < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        sent += static_cast<size_t>(count);
+    }
+    return true;
+}
+
+// Buffered line reader over a socket
+class LineReader {
+public:
+    explicit LineReader(int fd) : fd(fd) {}
+
+    bool next(string& line) {
+        while (true) {
+            size_t end = buffer.find('\n', start);
+            if (end != string::npos) {
+                line.assign(buffer, start, end - start);
+                start = end + 1;
+                return true;
+            }
+            buffer.erase(0, start);
+            start = 0;
+            char chunk[64 << 10];
+            ssize_t count = read(fd, chunk, sizeof(chunk));
+            if (count < 0 && errno == EINTR) continue;
+            if (count <= 0) return false;
+            buffer.append(chunk, static_cast<size_t>(count));
+        }
+    }
+
+private:
+    int fd;
+    string buffer;
+    size_t start = 0;
+};
+
+string requestLine(const ClientOptions& options, long long id, const string& payload) {
+    string line = to_string(id) + "\t" + to_string(options.deadlineMs) + (options.inlineText ? "\ttext\t" : "\tfile\t");
+    // A request is one line; line breaks in the text are only separators to the tokenizer
+    for (char c : payload) {
+        line += (c == '\n' || c == '\r') ? ' ' : c;
+    }
+    line += '\n';
+    return line;
+}
+
+// Second field of an answer: ok, timeout or error
+string statusOf(const string& answer) {
+    size_t first = answer.find('\t');
+    if (first == string::npos) return "";
+    size_t second = answer.find('\t', first + 1);
+    return answer.substr(first + 1, second == string::npos ? string::npos : second - first - 1);
+}
+
+int sendAndPrint(const ClientOptions& options) {
+    int fd = connectTo(options.socketPath);
+    if (fd < 0) return 1;
+
+    // Requests go out from a second thread so a long batch cannot fill both socket buffers
+    thread sender([&] {
+        for (size_t i = 0; i < options.payloads.size(); ++i) {
+            if (!sendAll(fd, requestLine(options, static_cast<long long>(i + 1), options.payloads[i]))) break;
+        }
+    });
+
+    LineReader reader(fd);
+    string answer;
+    size_t answered = 0;
+    bool allOk = true;
+    while (answered < options.payloads.size() && reader.next(answer)) {
+        cout << answer << '\n';
+        allOk = allOk && statusOf(answer) == "ok";
+        ++answered;
+    }
+    sender.join();
+    close(fd);
+
+    if (answered < options.payloads.size()) {
+        cerr << "Connection closed after " << answered << " of " << options.payloads.size() << " answers." << endl;
+        return 1;
+    }
+    return allOk ? 0 : 2;
+}
+
+double percentile(const vector<double>& sorted, double q) {
+    if (sorted.empty()) return 0.0;
+    size_t index = static_cast<size_t>(q * static_cast<double>(sorted.size() - 1) + 0.5);
+    return sorted[min(index, sorted.size() - 1)];
+}
+
+int runBench(const ClientOptions& options) {
+    atomic<long long> nextRequest{0};
+    atomic<long long> timeouts{0};
+    atomic<long long> errors{0};
+    vector<vector<double>> latencies(options.concurrency);
+    atomic<bool> failed{false};
+
+    auto started = chrono::steady_clock::now();
+    vector<thread> clients;
+    for (int c = 0; c < options.concurrency; ++c) {
+        clients.emplace_back([&, c] {
+            int fd = connectTo(options.socketPath);
+            if (fd < 0) {
+                failed = true;
+                return;
+            }
+            LineReader reader(fd);
+            string answer;
+            for (long long id; (id = nextRequest.fetch_add(1)) < options.requests;) {
+                const string& payload = options.payloads[static_cast<size_t>(id) % options.payloads.size()];
+                auto sent = chrono::steady_clock::now();
+                if (!sendAll(fd, requestLine(options, id, payload)) || !reader.next(answer)) {
+                    failed = true;
+                    break;
+                }
+                latencies[c].push_back(chrono::duration<double, milli>(chrono::steady_clock::now() - sent).count());
+                string status = statusOf(answer);
+                if (status == "timeout") timeouts.fetch_add(1);
+                else if (status != "ok") errors.fetch_add(1);
+            }
+            close(fd);
+        });
+    }
+    for (auto& client : clients) {
+        client.join();
+    }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - started).count();
+
+    vector<double> all;
+    for (const auto& perClient : latencies) {
+        all.insert(all.end(), perClient.begin(), perClient.end());
+    }
+    sort(all.begin(), all.end());
+
+    cout << fixed << setprecision(3)
+         << "requests    " << all.size() << " over " << options.concurrency << " connections in " << seconds << " s ("
+         << (seconds > 0 ? all.size() / seconds : 0.0) << " req/s)\n"
+         << "latency ms  p50 " << percentile(all, 0.50) << "  p90 " << percentile(all, 0.90) << "  p99 "
+         << percentile(all, 0.99) << "  max " << (all.empty() ? 0.0 : all.back()) << "\n"
+         << "timeouts    " << timeouts.load() << "\n"
+         << "errors      " << errors.load() << endl;
+    return failed ? 1 : 0;
+}
+
+} // namespace
+
+// Client of the classification daemon (main --serve=SOCKET): sends requests and prints the
+// answers, or generates load and reports the latency distribution
+int main(int argc, char* argv[]) {
+    ClientOptions options;
+    if (!parseArguments(argc, argv, options)) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (options.payloads.empty()) {
+        for (string line; getline(cin, line);) {
+            if (!line.empty()) options.payloads.push_back(line);
+        }
+    }
+    if (options.payloads.empty()) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    return options.bench ? runBench(options) : sendAndPrint(options);
+}